@@ -23,22 +23,24 @@
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <memory>
 
 #include <algorithm>
 
 #include "analog.hpp"
 #include "analogsegment.hpp"
+#include "mipmapkernels.hpp"
 
 using std::lock_guard;
 using std::recursive_mutex;
+using std::shared_ptr;
 using std::make_pair;
 using std::max;
-using std::max_element;
 using std::min;
-using std::min_element;
 using std::pair;
 using std::unique_ptr;
+using std::vector;
 
 namespace pv {
 namespace data {
@@ -47,46 +49,355 @@ const int AnalogSegment::EnvelopeScalePower = 4;
 const int AnalogSegment::EnvelopeScaleFactor = 1 << EnvelopeScalePower;
 const float AnalogSegment::LogEnvelopeScaleFactor = logf(EnvelopeScaleFactor);
 const uint64_t AnalogSegment::EnvelopeDataUnit = 64 * 1024;	// bytes
+const uint64_t AnalogSegment::StatsBlockLength =
+	EnvelopeScaleFactor * EnvelopeScaleFactor;
+const uint64_t AnalogSegment::ConversionBlockLength = 64 * 1024;
+
+bool AnalogSegment::quantization_enabled_ = true;
+bool AnalogSegment::compression_enabled_ = false;
+
+namespace {
+
+/// Adds up doubles, compensating the rounding errors as Kahan proposed
+struct KahanSum
+{
+	double sum = 0, c = 0;
+
+	void add(double value)
+	{
+		const double y = value - c;
+		const double t = sum + y;
+		// Infinities would turn the compensation into NaN
+		c = std::isfinite(t) ? ((t - sum) - y) : 0;
+		sum = t;
+	}
+};
+
+void add_samples(const float* in, uint64_t count, KahanSum &sum,
+	KahanSum &sum_of_squares)
+{
+	for (uint64_t i = 0; i < count; i++) {
+		sum.add(in[i]);
+		sum_of_squares.add((double)in[i] * in[i]);
+	}
+}
+
+/**
+ * Adds up a block of the envelope scale factor. The products of floats are
+ * exact as doubles, so the few additions don't need to be compensated.
+ */
+inline void sum_block(const float* in, double &sum, double &sum_of_squares)
+{
+	double s[4] = {0, 0, 0, 0}, sq[4] = {0, 0, 0, 0};
+	for (unsigned int i = 0; i < MipMapKernels::BlockLength; i += 4)
+		for (unsigned int j = 0; j < 4; j++) {
+			s[j] += in[i + j];
+			sq[j] += (double)in[i + j] * in[i + j];
+		}
+
+	sum = (s[0] + s[1]) + (s[2] + s[3]);
+	sum_of_squares = (sq[0] + sq[1]) + (sq[2] + sq[3]);
+}
+
+shared_ptr<AnalogSegment::EnvelopeSample> allocate_envelope_samples(
+	uint64_t length)
+{
+	return shared_ptr<AnalogSegment::EnvelopeSample>(
+		new AnalogSegment::EnvelopeSample[length],
+		std::default_delete<AnalogSegment::EnvelopeSample[]>());
+}
+
+/// Extends the minimum and maximum by the samples, ignoring NaNs
+void update_min_max(const float* in, uint64_t count, float &min_value,
+	float &max_value)
+{
+	// Let the envelope kernel summarize the blocks first
+	const uint64_t BatchBlockCount = 64;
+	float pairs[BatchBlockCount * 2];
+
+	uint64_t i = 0;
+	while (count - i >= MipMapKernels::BlockLength) {
+		const uint64_t block_count = min(
+			(count - i) / MipMapKernels::BlockLength, BatchBlockCount);
+		MipMapKernels::min_max_samples(in + i, pairs, block_count);
+
+		for (uint64_t b = 0; b < block_count; b++) {
+			min_value = min(min_value, pairs[b * 2]);
+			max_value = max(max_value, pairs[b * 2 + 1]);
+		}
+
+		i += block_count * MipMapKernels::BlockLength;
+	}
+
+	for (; i < count; i++) {
+		min_value = min(min_value, in[i]);
+		max_value = max(max_value, in[i]);
+	}
+}
+
+template <typename T>
+void deinterleave(const void* in, T* out, uint64_t count, size_t stride,
+	T &min_value, T &max_value)
+{
+	const T* samples = (const T*)in;
+	for (uint64_t i = 0; i < count; i++, samples += stride) {
+		out[i] = *samples;
+		min_value = min(min_value, out[i]);
+		max_value = max(max_value, out[i]);
+	}
+}
+
+template <typename T>
+void dequantize(const uint8_t* in, float* out, uint64_t count, float scale,
+	float offset)
+{
+	const T* const samples = (const T*)in;
+	for (uint64_t i = 0; i < count; i++)
+		out[i] = samples[i] * scale + offset;
+}
+
+/// Rounds to the nearest step, clamping values that don't fit
+template <typename T>
+void quantize(const float* in, T* out, uint64_t count, size_t stride,
+	float scale, float offset)
+{
+	const float lowest = std::numeric_limits<T>::min();
+	const float highest = std::numeric_limits<T>::max();
+
+	for (uint64_t i = 0; i < count; i++, in += stride) {
+		const float q = rintf((*in - offset) / scale);
+		out[i] = (q >= highest) ? (T)highest : ((q > lowest) ? (T)q : (T)lowest);
+	}
+}
+
+} // namespace
 
 AnalogSegment::AnalogSegment(Analog& owner, uint32_t segment_id, uint64_t samplerate) :
-	Segment(segment_id, samplerate, sizeof(float)),
+	AnalogSegment(owner, segment_id, samplerate, false,
+		Quantization{sizeof(float), true, 1.0f, 0.0f})
+{
+}
+
+AnalogSegment::AnalogSegment(Analog& owner, uint32_t segment_id,
+	uint64_t samplerate, const Quantization &quantization) :
+	AnalogSegment(owner, segment_id, samplerate, true, quantization)
+{
+}
+
+AnalogSegment::AnalogSegment(Analog& owner, uint32_t segment_id,
+	uint64_t samplerate, bool quantized, const Quantization &quantization) :
+	Segment(segment_id, samplerate, quantization.unit_size),
 	owner_(owner),
+	quantized_(quantized),
+	quantization_(quantization),
 	min_value_(0),
 	max_value_(0)
 {
+	// The envelope kernels summarize the same blocks, as pairs of floats
+	assert(EnvelopeScaleFactor == MipMapKernels::BlockLength);
+	assert(sizeof(EnvelopeSample) == 2 * sizeof(float));
+	assert(!quantized || (quantization.unit_size == 1) ||
+		(quantization.unit_size == 2));
+	assert(ConversionBlockLength % StatsBlockLength == 0);
+
 	lock_guard<recursive_mutex> lock(mutex_);
-	memset(envelope_levels_, 0, sizeof(envelope_levels_));
+	for (Envelope &e : envelope_levels_)
+		e.length = e.data_length = 0;
+	memset(stats_levels_, 0, sizeof(stats_levels_));
+
+	memory_account_.set_owner(&owner);
+
+	// Slowly changing floats keep most of their bits
+	if (compression_enabled_ && !quantized)
+		set_chunk_compression(XorCompression);
 }
 
 AnalogSegment::~AnalogSegment()
 {
 	lock_guard<recursive_mutex> lock(mutex_);
-	for (Envelope &e : envelope_levels_)
-		free(e.samples);
+	for (StatsLevel &l : stats_levels_)
+		free(l.samples);
+}
+
+void AnalogSegment::set_quantization_enabled(bool enabled)
+{
+	quantization_enabled_ = enabled;
+}
+
+bool AnalogSegment::quantization_enabled()
+{
+	return quantization_enabled_;
+}
+
+void AnalogSegment::set_compression_enabled(bool enabled)
+{
+	compression_enabled_ = enabled;
+}
+
+bool AnalogSegment::is_quantized() const
+{
+	return quantized_;
+}
+
+const AnalogSegment::Quantization& AnalogSegment::quantization() const
+{
+	return quantization_;
 }
 
 void AnalogSegment::append_interleaved_samples(const float *data,
 	size_t sample_count, size_t stride)
 {
-	assert(unit_size_ == sizeof(float));
-
 	lock_guard<recursive_mutex> lock(mutex_);
 
-	uint64_t prev_sample_count = sample_count_;
+	if (quantized_) {
+		// Packets are converted one after another, so the buffer is reused
+		static thread_local vector<uint8_t> quant_data;
+		if (quant_data.size() < sample_count * quantization_.unit_size)
+			quant_data.resize(sample_count * quantization_.unit_size);
+
+		const float scale = quantization_.scale, offset = quantization_.offset;
+
+		if (quantization_.unit_size == 1) {
+			if (quantization_.is_signed)
+				quantize(data, (int8_t*)quant_data.data(), sample_count, stride,
+					scale, offset);
+			else
+				quantize(data, (uint8_t*)quant_data.data(), sample_count, stride,
+					scale, offset);
+		} else {
+			if (quantization_.is_signed)
+				quantize(data, (int16_t*)quant_data.data(), sample_count, stride,
+					scale, offset);
+			else
+				quantize(data, (uint16_t*)quant_data.data(), sample_count, stride,
+					scale, offset);
+		}
+
+		append_interleaved_quantized_samples(quant_data.data(), sample_count, 1);
+		return;
+	}
+
+	float min_value = min_value_, max_value = max_value_;
+
+	// Samples that are already deinterleaved are appended as they are
+	if (stride == 1) {
+		update_min_max(data, sample_count, min_value, max_value);
+		append_deinterleaved_samples((void*)data, sample_count,
+			min_value, max_value);
+		return;
+	}
 
 	// Deinterleave the samples and add them
-	unique_ptr<float[]> deint_data(new float[sample_count]);
-	float *deint_data_ptr = deint_data.get();
-	for (uint32_t i = 0; i < sample_count; i++) {
-		*deint_data_ptr = (float)(*data);
-		deint_data_ptr++;
-		data += stride;
+	static thread_local vector<float> deint_data;
+	if (deint_data.size() < sample_count)
+		deint_data.resize(sample_count);
+
+	deinterleave(data, deint_data.data(), sample_count, stride,
+		min_value, max_value);
+
+	append_deinterleaved_samples(deint_data.data(), sample_count,
+		min_value, max_value);
+}
+
+void AnalogSegment::append_interleaved_channels(
+	const vector<AnalogSegment*> &segments, const float *data,
+	size_t sample_count)
+{
+	static thread_local vector<float> buffer;
+	static thread_local vector<uint8_t> channel_mask;
+
+	const size_t channel_count = segments.size();
+	if (buffer.size() < sample_count * channel_count)
+		buffer.resize(sample_count * channel_count);
+
+	// Only split off the channels that are appended
+	channel_mask.resize(channel_count);
+	for (size_t c = 0; c < channel_count; c++)
+		channel_mask[c] = (segments[c] != nullptr);
+
+	MipMapKernels::deinterleave(data, buffer.data(), sample_count,
+		channel_count, channel_mask.data());
+
+	for (size_t c = 0; c < channel_count; c++)
+		if (segments[c])
+			segments[c]->append_interleaved_samples(
+				buffer.data() + c * sample_count, sample_count, 1);
+}
+
+void AnalogSegment::append_interleaved_quantized_samples(const void *data,
+	size_t sample_count, size_t stride)
+{
+	assert(quantized_);
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	// Deinterleave the samples, the overall minimum and maximum are
+	// converted from the ones of the integers
+	static thread_local vector<uint8_t> deint_data;
+	if (deint_data.size() < sample_count * quantization_.unit_size)
+		deint_data.resize(sample_count * quantization_.unit_size);
+
+	int32_t min_sample, max_sample;
+
+	if (quantization_.unit_size == 1) {
+		if (quantization_.is_signed) {
+			int8_t lo = INT8_MAX, hi = INT8_MIN;
+			deinterleave(data, (int8_t*)deint_data.data(), sample_count, stride,
+				lo, hi);
+			min_sample = lo, max_sample = hi;
+		} else {
+			uint8_t lo = UINT8_MAX, hi = 0;
+			deinterleave(data, (uint8_t*)deint_data.data(), sample_count, stride,
+				lo, hi);
+			min_sample = lo, max_sample = hi;
+		}
+	} else {
+		if (quantization_.is_signed) {
+			int16_t lo = INT16_MAX, hi = INT16_MIN;
+			deinterleave(data, (int16_t*)deint_data.data(), sample_count, stride,
+				lo, hi);
+			min_sample = lo, max_sample = hi;
+		} else {
+			uint16_t lo = UINT16_MAX, hi = 0;
+			deinterleave(data, (uint16_t*)deint_data.data(), sample_count, stride,
+				lo, hi);
+			min_sample = lo, max_sample = hi;
+		}
+	}
+
+	float min_value = min_value_, max_value = max_value_;
+	if (sample_count > 0) {
+		float lo = min_sample * quantization_.scale + quantization_.offset;
+		float hi = max_sample * quantization_.scale + quantization_.offset;
+		if (lo > hi)
+			std::swap(lo, hi);
+		min_value = min(min_value, lo);
+		max_value = max(max_value, hi);
 	}
 
-	append_samples(deint_data.get(), sample_count);
+	append_deinterleaved_samples(deint_data.data(), sample_count,
+		min_value, max_value);
+}
+
+void AnalogSegment::append_deinterleaved_samples(void *data,
+	size_t sample_count, float min_value, float max_value)
+{
+	uint64_t prev_sample_count = get_sample_count();
+
+	append_samples(data, sample_count);
+
+	// The envelope levels are built when they're needed, only the overall
+	// minimum and maximum are kept up to date
+	const float old_min_value = min_value_, old_max_value = max_value_;
+	min_value_ = min_value;
+	max_value_ = max_value;
 
-	// Generate the first mip-map from the data
-	append_payload_to_envelope_levels();
+	prev_sample_count -= min(evict_old_samples(), prev_sample_count);
+	update_deferred_summary_size();
+
+	// Notify if the min or max value changed
+	if ((old_min_value != min_value_) || (old_max_value != max_value_))
+		owner_.min_max_changed(min_value_, max_value_);
 
 	if (sample_count > 1)
 		owner_.notify_samples_added(this, prev_sample_count + 1,
@@ -100,15 +411,42 @@ void AnalogSegment::get_samples(int64_t start_sample, int64_t end_sample,
 	float* dest) const
 {
 	assert(start_sample >= 0);
-	assert(start_sample < (int64_t)sample_count_);
+	assert(start_sample < (int64_t)sample_count_bound());
 	assert(end_sample >= 0);
-	assert(end_sample <= (int64_t)sample_count_);
+	assert(end_sample <= (int64_t)sample_count_bound());
 	assert(start_sample <= end_sample);
 	assert(dest != nullptr);
 
-	lock_guard<recursive_mutex> lock(mutex_);
+	if (!quantized_) {
+		get_raw_samples(start_sample, (end_sample - start_sample), (uint8_t*)dest);
+		return;
+	}
+
+	if (end_sample == start_sample)
+		return;
+
+	process_float_samples(start_sample, end_sample - start_sample,
+		[&](const float* samples, uint64_t count) {
+			memcpy(dest, samples, count * sizeof(float));
+			dest += count;
+		});
+}
+
+void AnalogSegment::get_float_spans(uint64_t start, uint64_t count,
+	vector<SegmentSpan> &spans) const
+{
+	get_sample_spans(start, count, spans);
+	if (!quantized_)
+		return;
 
-	get_raw_samples(start_sample, (end_sample - start_sample), (uint8_t*)dest);
+	for (SegmentSpan &span : spans) {
+		shared_ptr<uint8_t> buffer(
+			new uint8_t[span.sample_count * sizeof(float)],
+			std::default_delete<uint8_t[]>());
+		convert_samples(span.data, (float*)buffer.get(), span.sample_count);
+		span.data = buffer.get();
+		span.pin = buffer;
+	}
 }
 
 const pair<float, float> AnalogSegment::get_min_max() const
@@ -118,20 +456,27 @@ const pair<float, float> AnalogSegment::get_min_max() const
 
 float* AnalogSegment::get_iterator_value_ptr(SegmentDataIterator* it)
 {
-	assert(it->sample_index <= (sample_count_ - 1));
+	assert(!quantized_);
+	assert(it->sample_index <= (get_sample_count() - 1));
 
 	return (float*)(it->chunk + it->chunk_offs);
 }
 
 void AnalogSegment::get_envelope_section(EnvelopeSection &s,
-	uint64_t start, uint64_t end, float min_length) const
+	uint64_t start, uint64_t end, float min_length)
 {
-	assert(end <= get_sample_count());
+	assert(end <= sample_count_bound());
 	assert(start <= end);
 	assert(min_length > 0);
 
 	lock_guard<recursive_mutex> lock(mutex_);
 
+	// The range may have been determined before samples were evicted
+	end = min(end, get_sample_count());
+	start = min(start, end);
+
+	update_envelope_levels(end);
+
 	const unsigned int min_level = max((int)floorf(logf(min_length) /
 		LogEnvelopeScaleFactor) - 1, 0);
 	const unsigned int scale_power = (min_level + 1) *
@@ -142,86 +487,197 @@ void AnalogSegment::get_envelope_section(EnvelopeSection &s,
 	s.start = start << scale_power;
 	s.scale = 1 << scale_power;
 	s.length = end - start;
-	s.samples = new EnvelopeSample[s.length];
-	memcpy(s.samples, envelope_levels_[min_level].samples + start,
-		s.length * sizeof(EnvelopeSample));
+	s.pin = envelope_levels_[min_level].samples;
+	s.samples = s.pin.get() + start;
 }
 
-void AnalogSegment::reallocate_envelope(Envelope &e)
+AnalogSegment::RangeStats AnalogSegment::get_range_stats(uint64_t start,
+	uint64_t end)
 {
-	const uint64_t new_data_length = ((e.length + EnvelopeDataUnit - 1) /
-		EnvelopeDataUnit) * EnvelopeDataUnit;
-	if (new_data_length > e.data_length) {
-		e.data_length = new_data_length;
-		e.samples = (EnvelopeSample*)realloc(e.samples,
-			new_data_length * sizeof(EnvelopeSample));
+	assert(end <= sample_count_bound());
+	assert(start <= end);
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	end = min(end, get_sample_count());
+	start = min(start, end);
+
+	update_stats_levels(end);
+
+	KahanSum sum, sum_of_squares;
+	const auto add_raw_samples = [&](uint64_t from, uint64_t to) {
+		process_float_samples(from, to - from,
+			[&](const float* samples, uint64_t count) {
+				add_samples(samples, count, sum, sum_of_squares);
+			});
+	};
+
+	// Take the largest blocks that fit into the range, and the samples
+	// that don't fill a block of the first level
+	uint64_t index = start;
+	while (index < end) {
+		int level = -1;
+		uint64_t block_length = StatsBlockLength;
+		while ((level + 1 < (int)StatsLevelCount) &&
+			(index % block_length == 0) && (index + block_length <= end) &&
+			(index / block_length < stats_levels_[level + 1].length)) {
+			level++;
+			block_length *= EnvelopeScaleFactor;
+		}
+
+		if (level < 0) {
+			const uint64_t next = min(end,
+				(index / StatsBlockLength + 1) * StatsBlockLength);
+			add_raw_samples(index, next);
+			index = next;
+			continue;
+		}
+
+		block_length /= EnvelopeScaleFactor;
+		const StatsSample &b = stats_levels_[level].samples[index / block_length];
+		sum.add(b.sum);
+		sum_of_squares.add(b.sum_of_squares);
+		index += block_length;
 	}
+
+	RangeStats stats;
+	stats.count = end - start;
+	stats.sum = sum.sum;
+	stats.sum_of_squares = sum_of_squares.sum;
+	return stats;
 }
 
-void AnalogSegment::append_payload_to_envelope_levels()
+void AnalogSegment::convert_samples(const uint8_t* in, float* out,
+	uint64_t count) const
 {
-	Envelope &e0 = envelope_levels_[0];
-	uint64_t prev_length;
-	EnvelopeSample *dest_ptr;
-	SegmentDataIterator* it;
+	assert(quantized_);
+
+	const float scale = quantization_.scale, offset = quantization_.offset;
+	if (quantization_.unit_size == 1) {
+		if (quantization_.is_signed)
+			dequantize<int8_t>(in, out, count, scale, offset);
+		else
+			dequantize<uint8_t>(in, out, count, scale, offset);
+	} else {
+		if (quantization_.is_signed)
+			dequantize<int16_t>(in, out, count, scale, offset);
+		else
+			dequantize<uint16_t>(in, out, count, scale, offset);
+	}
+}
 
-	// Expand the data buffer to fit the new samples
-	prev_length = e0.length;
-	e0.length = sample_count_ / EnvelopeScaleFactor;
+template <class F>
+void AnalogSegment::process_float_samples(uint64_t start, uint64_t count,
+	F f) const
+{
+	vector<SegmentSpan> spans;
+	get_sample_spans(start, count, spans);
 
-	// Calculate min/max values in case we have too few samples for an envelope
-	const float old_min_value = min_value_, old_max_value = max_value_;
-	if (sample_count_ < EnvelopeScaleFactor) {
-		it = begin_sample_iteration(0);
-		for (uint64_t i = 0; i < sample_count_; i++) {
-			const float sample = *get_iterator_value_ptr(it);
-			if (sample < min_value_)
-				min_value_ = sample;
-			if (sample > max_value_)
-				max_value_ = sample;
-			continue_sample_iteration(it, 1);
-		}
-		end_sample_iteration(it);
+	if (!quantized_) {
+		for (const SegmentSpan &span : spans)
+			f((const float*)span.data, span.sample_count);
+		return;
 	}
 
-	// Break off if there are no new samples to compute
-	if (e0.length == prev_length)
+	// Convert the samples piece by piece, reusing the buffer
+	unique_ptr<float[]> buffer(new float[min(count, ConversionBlockLength)]);
+	for (const SegmentSpan &span : spans)
+		for (uint64_t offs = 0; offs < span.sample_count;) {
+			const uint64_t length =
+				min(span.sample_count - offs, ConversionBlockLength);
+			convert_samples(span.data + offs * unit_size_, buffer.get(), length);
+			f(buffer.get(), length);
+			offs += length;
+		}
+}
+
+void AnalogSegment::reallocate_envelope(Envelope &e)
+{
+	uint64_t new_data_length = ((e.length + EnvelopeDataUnit - 1) /
+		EnvelopeDataUnit) * EnvelopeDataUnit;
+	if (new_data_length <= e.data_length)
 		return;
 
-	reallocate_envelope(e0);
+	// Sections may still use the samples, so they're copied instead of
+	// reallocated. Growing by half the size at least keeps copies rare.
+	new_data_length = max(new_data_length, e.data_length + e.data_length / 2);
+	shared_ptr<EnvelopeSample> samples =
+		allocate_envelope_samples(new_data_length);
+	if (e.samples)
+		memcpy(samples.get(), e.samples.get(),
+			e.data_length * sizeof(EnvelopeSample));
 
-	dest_ptr = e0.samples + prev_length;
+	memory_account_.add(MemoryAccount::SummaryData,
+		(new_data_length - e.data_length) * sizeof(EnvelopeSample));
 
-	// Iterate through the samples to populate the first level mipmap
-	uint64_t start_sample = prev_length * EnvelopeScaleFactor;
-	uint64_t end_sample = e0.length * EnvelopeScaleFactor;
+	e.data_length = new_data_length;
+	e.samples = samples;
+}
 
-	it = begin_sample_iteration(start_sample);
-	for (uint64_t i = start_sample; i < end_sample; i += EnvelopeScaleFactor) {
-		const float* samples = get_iterator_value_ptr(it);
+void AnalogSegment::release_envelope(Envelope &e)
+{
+	memory_account_.add(MemoryAccount::SummaryData,
+		-(int64_t)(e.data_length * sizeof(EnvelopeSample)));
 
-		const EnvelopeSample sub_sample = {
-			*min_element(samples, samples + EnvelopeScaleFactor),
-			*max_element(samples, samples + EnvelopeScaleFactor),
-		};
+	e.length = e.data_length = 0;
+	e.samples.reset();
+}
 
-		if (sub_sample.min < min_value_)
-			min_value_ = sub_sample.min;
-		if (sub_sample.max > max_value_)
-			max_value_ = sub_sample.max;
+void AnalogSegment::reallocate_stats_level(StatsLevel &l)
+{
+	const uint64_t new_data_length = ((l.length + EnvelopeDataUnit - 1) /
+		EnvelopeDataUnit) * EnvelopeDataUnit;
+	if (new_data_length > l.data_length) {
+		memory_account_.add(MemoryAccount::SummaryData,
+			(new_data_length - l.data_length) * sizeof(StatsSample));
 
-		continue_sample_iteration(it, EnvelopeScaleFactor);
-		*dest_ptr++ = sub_sample;
+		l.data_length = new_data_length;
+		l.samples = (StatsSample*)realloc(l.samples,
+			new_data_length * sizeof(StatsSample));
 	}
-	end_sample_iteration(it);
+}
 
+void AnalogSegment::update_envelope_levels(uint64_t end)
+{
+	Envelope &e0 = envelope_levels_[0];
+
+	// Expand the data buffer to fit the blocks up to the end sample
+	const uint64_t prev_length = e0.length;
+	const uint64_t length = min(end, get_sample_count()) / EnvelopeScaleFactor;
+
+	// Only build the higher levels if the first one is far enough
+	if (length > prev_length) {
+		e0.length = length;
+		reallocate_envelope(e0);
+
+		// Summarize the samples in place. The chunks hold whole blocks,
+		// so each piece does as well.
+		EnvelopeSample *dest_ptr = e0.samples.get() + prev_length;
+		process_float_samples(prev_length * EnvelopeScaleFactor,
+			(length - prev_length) * EnvelopeScaleFactor,
+			[&](const float* samples, uint64_t count) {
+				assert(count % EnvelopeScaleFactor == 0);
+
+				const uint64_t block_count = count / EnvelopeScaleFactor;
+				MipMapKernels::min_max_samples(samples, (float*)dest_ptr,
+					block_count);
+				dest_ptr += block_count;
+			});
+	}
+
+	append_payload_to_higher_envelope_levels();
+	update_deferred_summary_size();
+}
+
+void AnalogSegment::append_payload_to_higher_envelope_levels()
+{
 	// Compute higher level mipmaps
 	for (unsigned int level = 1; level < ScaleStepCount; level++) {
 		Envelope &e = envelope_levels_[level];
 		const Envelope &el = envelope_levels_[level - 1];
 
 		// Expand the data buffer to fit the new samples
-		prev_length = e.length;
+		const uint64_t prev_length = e.length;
 		e.length = el.length / EnvelopeScaleFactor;
 
 		// Break off if there are no more samples to be computed
@@ -231,29 +687,140 @@ void AnalogSegment::append_payload_to_envelope_levels()
 		reallocate_envelope(e);
 
 		// Subsample the lower level
-		const EnvelopeSample *src_ptr =
-			el.samples + prev_length * EnvelopeScaleFactor;
-		const EnvelopeSample *const end_dest_ptr = e.samples + e.length;
-
-		for (dest_ptr = e.samples + prev_length;
-				dest_ptr < end_dest_ptr; dest_ptr++) {
-			const EnvelopeSample *const end_src_ptr =
-				src_ptr + EnvelopeScaleFactor;
-
-			EnvelopeSample sub_sample = *src_ptr++;
-			while (src_ptr < end_src_ptr) {
-				sub_sample.min = min(sub_sample.min, src_ptr->min);;
-				sub_sample.max = max(sub_sample.max, src_ptr->max);
-				src_ptr++;
+		MipMapKernels::min_max_reduce(
+			(const float*)(el.samples.get() + prev_length * EnvelopeScaleFactor),
+			(float*)(e.samples.get() + prev_length), e.length - prev_length);
+	}
+}
+
+void AnalogSegment::update_stats_levels(uint64_t end)
+{
+	StatsLevel &l0 = stats_levels_[0];
+
+	const uint64_t prev_length = l0.length;
+	const uint64_t length = min(end, get_sample_count()) / StatsBlockLength;
+
+	if (length > prev_length) {
+		l0.length = length;
+		reallocate_stats_level(l0);
+
+		// The pieces hold whole blocks of the envelope scale factor, their
+		// sums are added up to the blocks of the first level
+		StatsSample *dest_ptr = l0.samples + prev_length;
+		KahanSum sum, sum_of_squares;
+		unsigned int block_count = 0;
+		process_float_samples(prev_length * StatsBlockLength,
+			(length - prev_length) * StatsBlockLength,
+			[&](const float* in, uint64_t count) {
+				assert(count % EnvelopeScaleFactor == 0);
+
+				for (uint64_t i = 0; i < count;
+					i += EnvelopeScaleFactor, in += EnvelopeScaleFactor) {
+					double block_sum, block_sum_of_squares;
+					sum_block(in, block_sum, block_sum_of_squares);
+					sum.add(block_sum);
+					sum_of_squares.add(block_sum_of_squares);
+
+					if (++block_count == (unsigned int)EnvelopeScaleFactor) {
+						dest_ptr->sum = sum.sum;
+						dest_ptr->sum_of_squares = sum_of_squares.sum;
+						dest_ptr++;
+						sum = KahanSum();
+						sum_of_squares = KahanSum();
+						block_count = 0;
+					}
+				}
+			});
+	}
+
+	// Add up the blocks of the higher levels
+	for (unsigned int level = 1; level < StatsLevelCount; level++) {
+		StatsLevel &l = stats_levels_[level];
+		const StatsLevel &ll = stats_levels_[level - 1];
+
+		const uint64_t prev_length = l.length;
+		l.length = ll.length / EnvelopeScaleFactor;
+		if (l.length == prev_length)
+			break;
+
+		reallocate_stats_level(l);
+
+		for (uint64_t i = prev_length; i < l.length; i++) {
+			KahanSum sum, sum_of_squares;
+			const StatsSample *in = ll.samples + i * EnvelopeScaleFactor;
+			for (int j = 0; j < EnvelopeScaleFactor; j++) {
+				sum.add(in[j].sum);
+				sum_of_squares.add(in[j].sum_of_squares);
 			}
 
-			*dest_ptr = sub_sample;
+			l.samples[i].sum = sum.sum;
+			l.samples[i].sum_of_squares = sum_of_squares.sum;
 		}
 	}
+}
 
-	// Notify if the min or max value changed
-	if ((old_min_value != min_value_) || (old_max_value != max_value_))
-		owner_.min_max_changed(min_value_, max_value_);
+uint64_t AnalogSegment::evict_old_samples()
+{
+	const uint64_t evicted = evict_old_chunks();
+	if (!evicted)
+		return 0;
+
+	// The evicted samples fill entire first level blocks, so the first
+	// level only loses its oldest blocks. The block boundaries of the
+	// higher levels move, so they are rebuilt from the first level when
+	// they're needed again. Samples still used by sections are left alone.
+	Envelope &e0 = envelope_levels_[0];
+	const uint64_t dropped = min(evicted / EnvelopeScaleFactor, e0.length);
+
+	if ((dropped > 0) && (e0.samples.use_count() > 1)) {
+		shared_ptr<EnvelopeSample> samples =
+			allocate_envelope_samples(e0.data_length);
+		memcpy(samples.get(), e0.samples.get() + dropped,
+			(e0.length - dropped) * sizeof(EnvelopeSample));
+		e0.samples = samples;
+	} else if (dropped > 0)
+		memmove(e0.samples.get(), e0.samples.get() + dropped,
+			(e0.length - dropped) * sizeof(EnvelopeSample));
+	e0.length -= dropped;
+
+	for (unsigned int level = 1; level < ScaleStepCount; level++) {
+		Envelope &e = envelope_levels_[level];
+		if (e.samples.use_count() > 1)
+			release_envelope(e);
+		e.length = 0;
+	}
+
+	// The same goes for the statistics, unless the blocks of the first
+	// level are split by the eviction
+	StatsLevel &l0 = stats_levels_[0];
+	if (evicted % StatsBlockLength == 0) {
+		const uint64_t stats_dropped = min(evicted / StatsBlockLength,
+			l0.length);
+		if (stats_dropped > 0)
+			memmove(l0.samples, l0.samples + stats_dropped,
+				(l0.length - stats_dropped) * sizeof(StatsSample));
+		l0.length -= stats_dropped;
+	} else
+		l0.length = 0;
+
+	for (unsigned int level = 1; level < StatsLevelCount; level++)
+		stats_levels_[level].length = 0;
+
+	return evicted;
+}
+
+void AnalogSegment::update_deferred_summary_size()
+{
+	uint64_t deferred = 0;
+
+	// Count the samples that would be built if the levels were complete
+	uint64_t length = get_sample_count();
+	for (const Envelope &e : envelope_levels_) {
+		length /= EnvelopeScaleFactor;
+		deferred += (length - min(e.length, length)) * sizeof(EnvelopeSample);
+	}
+
+	memory_account_.set_deferred(MemoryAccount::SummaryData, deferred);
 }
 
 } // namespace data
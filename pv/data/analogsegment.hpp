@@ -22,12 +22,14 @@
 
 #include "segment.hpp"
 
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include <QObject>
 
 using std::pair;
+using std::shared_ptr;
 
 namespace AnalogSegmentTest {
 struct Basic;
@@ -49,20 +51,78 @@ public:
 		float max;
 	};
 
+	/**
+	 * A part of an envelope level. The samples aren't copied, the pin keeps
+	 * them valid for as long as the section exists, even if the level is
+	 * extended or rebuilt in the meantime.
+	 */
 	struct EnvelopeSection
 	{
 		uint64_t start;
 		unsigned int scale;
 		uint64_t length;
-		EnvelopeSample *samples;
+		const EnvelopeSample *samples;
+		shared_ptr<const EnvelopeSample> pin;
+	};
+
+	/**
+	 * Describes the integer samples of ADCs, which stand for the values
+	 * sample * scale + offset.
+	 */
+	struct Quantization
+	{
+		unsigned int unit_size;  ///< 1 or 2 bytes
+		bool is_signed;
+		float scale;
+		float offset;
+
+		bool operator==(const Quantization &other) const {
+			return (unit_size == other.unit_size) &&
+				(is_signed == other.is_signed) &&
+				(scale == other.scale) && (offset == other.offset);
+		}
+
+		bool operator!=(const Quantization &other) const {
+			return !(*this == other);
+		}
+	};
+
+	/**
+	 * The sums over a range of samples, e.g. to measure the mean as
+	 * sum / count or the RMS value as sqrt(sum_of_squares / count).
+	 * Both sums are NaN if the range holds NaN samples.
+	 */
+	struct RangeStats
+	{
+		uint64_t count;
+		double sum;
+		double sum_of_squares;
 	};
 
 private:
+	/**
+	 * The samples of a level that are handed out in sections are never
+	 * changed. They're copied to a new buffer instead if the level needs
+	 * to grow or change them.
+	 */
 	struct Envelope
 	{
 		uint64_t length;
 		uint64_t data_length;
-		EnvelopeSample *samples;
+		shared_ptr<EnvelopeSample> samples;
+	};
+
+	struct StatsSample
+	{
+		double sum;
+		double sum_of_squares;
+	};
+
+	struct StatsLevel
+	{
+		uint64_t length;
+		uint64_t data_length;
+		StatsSample *samples;
 	};
 
 private:
@@ -71,36 +131,161 @@ private:
 	static const int EnvelopeScaleFactor;
 	static const float LogEnvelopeScaleFactor;
 	static const uint64_t EnvelopeDataUnit;
+	static const unsigned int StatsLevelCount = ScaleStepCount - 1;
+	static const uint64_t StatsBlockLength;
+	static const uint64_t ConversionBlockLength;
 
 public:
 	AnalogSegment(Analog& owner, uint32_t segment_id, uint64_t samplerate);
 
+	/**
+	 * Creates a segment that keeps the integer samples of an ADC as they
+	 * are, which takes a half or a quarter of the memory of floats. The
+	 * samples are converted to floats when they're read.
+	 */
+	AnalogSegment(Analog& owner, uint32_t segment_id, uint64_t samplerate,
+		const Quantization &quantization);
+
 	virtual ~AnalogSegment();
 
+	/// Enables quantized segments for data sources that allow them.
+	static void set_quantization_enabled(bool enabled);
+	static bool quantization_enabled();
+
+	/// Enables the compression of float samples in the background.
+	static void set_compression_enabled(bool enabled);
+
+	bool is_quantized() const;
+	const Quantization& quantization() const;
+
+	/**
+	 * Appends float samples. Quantized segments round them to the
+	 * nearest step they can represent.
+	 */
 	void append_interleaved_samples(const float *data,
 		size_t sample_count, size_t stride);
 
+	/**
+	 * Appends the interleaved float samples of several channels, one
+	 * segment per channel. The samples of these channels are split up in
+	 * one pass into a buffer that the calling thread reuses for the next
+	 * packets.
+	 * @param segments The segments of the channels, null for channels
+	 *        whose samples aren't appended.
+	 */
+	static void append_interleaved_channels(
+		const vector<AnalogSegment*> &segments, const float *data,
+		size_t sample_count);
+
+	/**
+	 * Appends integer samples of the segment's quantization.
+	 * @param stride The distance of the samples, in samples.
+	 */
+	void append_interleaved_quantized_samples(const void *data,
+		size_t sample_count, size_t stride);
+
 	void get_samples(int64_t start_sample, int64_t end_sample, float* dest) const;
 
+	/**
+	 * Provides read access to a range of samples as floats, like
+	 * get_sample_spans() does. Quantized samples are converted into
+	 * buffers that are held by the spans, so the range should be kept
+	 * short, e.g. by reading long ranges piece by piece.
+	 */
+	void get_float_spans(uint64_t start, uint64_t count,
+		vector<SegmentSpan> &spans) const;
+
 	const pair<float, float> get_min_max() const;
 
+	/// Only valid for segments that aren't quantized.
 	float* get_iterator_value_ptr(SegmentDataIterator* it);
 
+	/**
+	 * Returns the envelope of the samples [start, end) at the level of
+	 * detail given by min_length, without copying it. The envelope levels
+	 * are built up to the end sample if they aren't yet.
+	 */
 	void get_envelope_section(EnvelopeSection &s,
-		uint64_t start, uint64_t end, float min_length) const;
+		uint64_t start, uint64_t end, float min_length);
+
+	/**
+	 * Returns the sums over the samples [start, end). They're combined
+	 * from whole blocks of the statistics levels and the samples at the
+	 * edges of the range. The levels are only built once statistics are
+	 * asked for, up to the end sample.
+	 */
+	RangeStats get_range_stats(uint64_t start, uint64_t end);
 
 private:
+	AnalogSegment(Analog& owner, uint32_t segment_id, uint64_t samplerate,
+		bool quantized, const Quantization &quantization);
+
+	/**
+	 * Appends samples of the storage format and updates the overall
+	 * minimum and maximum by the ones of the samples.
+	 */
+	void append_deinterleaved_samples(void *data, size_t sample_count,
+		float min_value, float max_value);
+
+	/// Converts quantized samples to floats.
+	void convert_samples(const uint8_t* in, float* out, uint64_t count) const;
+
+	/**
+	 * Calls f(samples, count) for consecutive pieces of the samples
+	 * [start, start + count), converted to floats where needed. The
+	 * pieces hold whole blocks of the envelope scale factor if the
+	 * range starts at a block boundary.
+	 */
+	template <class F>
+	void process_float_samples(uint64_t start, uint64_t count, F f) const;
+
 	void reallocate_envelope(Envelope &e);
 
-	void append_payload_to_envelope_levels();
+	/// Drops the samples of a level, e.g. before it's rebuilt.
+	void release_envelope(Envelope &e);
+	void reallocate_stats_level(StatsLevel &l);
+
+	/**
+	 * Extends the envelope levels by the blocks that end at or before
+	 * sample end. The lengths of the levels are the watermarks up to
+	 * which they're valid.
+	 */
+	void update_envelope_levels(uint64_t end);
+	void append_payload_to_higher_envelope_levels();
+
+	/**
+	 * Extends the statistics levels by the blocks that end at or before
+	 * sample end, like update_envelope_levels() does for the envelope.
+	 */
+	void update_stats_levels(uint64_t end);
+
+	/**
+	 * Accounts the envelope bytes that haven't been built yet as
+	 * deferred.
+	 */
+	void update_deferred_summary_size();
+
+	/**
+	 * Evicts the oldest samples of rolling captures and trims the
+	 * envelope levels accordingly.
+	 * @return The number of samples evicted.
+	 */
+	uint64_t evict_old_samples();
 
 private:
 	Analog& owner_;
 
 	struct Envelope envelope_levels_[ScaleStepCount];
+	struct StatsLevel stats_levels_[StatsLevelCount];
+
+	const bool quantized_;
+	const Quantization quantization_;
 
 	float min_value_, max_value_;
 
+	static bool quantization_enabled_;
+	static bool compression_enabled_;
+
 	friend struct AnalogSegmentTest::Basic;
 };
 
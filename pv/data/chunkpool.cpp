@@ -0,0 +1,202 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2026 The PulseView developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+
+#include "chunkpool.hpp"
+
+using std::bad_alloc;
+using std::ifstream;
+using std::lock_guard;
+using std::mutex;
+using std::nothrow;
+using std::stoull;
+using std::string;
+
+namespace pv {
+namespace data {
+
+const uint64_t ChunkPool::DefaultPoolLimit = 256 * 1024 * 1024;  /* 256MiB */
+const uint64_t ChunkPool::DefaultHeadroom = 20 * 1024 * 1024;  /* 20MiB */
+
+mutex ChunkPool::mutex_;
+map< uint64_t, vector<uint8_t*> > ChunkPool::pool_;
+uint64_t ChunkPool::pool_limit_ = ChunkPool::DefaultPoolLimit;
+uint64_t ChunkPool::pooled_size_ = 0;
+uint8_t* ChunkPool::headroom_ = nullptr;
+uint64_t ChunkPool::headroom_size_ = 0;
+uint64_t ChunkPool::allocation_count_ = 0;
+uint64_t ChunkPool::heap_allocation_count_ = 0;
+
+uint8_t* ChunkPool::allocate_chunk(uint64_t size)
+{
+	lock_guard<mutex> lock(mutex_);
+
+	allocation_count_++;
+
+	const auto it = pool_.find(size);
+	if ((it != pool_.end()) && !it->second.empty()) {
+		uint8_t* chunk = it->second.back();
+		it->second.pop_back();
+		pooled_size_ -= size;
+		return chunk;
+	}
+
+	heap_allocation_count_++;
+
+	uint8_t* chunk = allocate_from_heap(size);
+
+	if (!chunk && (pooled_size_ > 0)) {
+		// Pooled chunks of other sizes are of no use to us right now
+		const uint64_t pool_limit = pool_limit_;
+		pool_limit_ = 0;
+		trim_pool();
+		pool_limit_ = pool_limit;
+
+		chunk = allocate_from_heap(size);
+	}
+
+	if (!chunk) {
+		// Leave the reserve to the rest of the application so that it can
+		// stay alive while the acquisition is being stopped
+		delete[] headroom_;
+		headroom_ = nullptr;
+		headroom_size_ = 0;
+
+		throw bad_alloc();
+	}
+
+	return chunk;
+}
+
+void ChunkPool::release_chunk(uint8_t* chunk, uint64_t size)
+{
+	lock_guard<mutex> lock(mutex_);
+
+	if (pooled_size_ + size > pool_limit_) {
+		delete[] chunk;
+		return;
+	}
+
+	pool_[size].push_back(chunk);
+	pooled_size_ += size;
+}
+
+void ChunkPool::free_chunk(uint8_t* chunk)
+{
+	delete[] chunk;
+}
+
+void ChunkPool::set_pool_limit(uint64_t limit)
+{
+	lock_guard<mutex> lock(mutex_);
+
+	pool_limit_ = limit;
+	trim_pool();
+}
+
+bool ChunkPool::reserve_headroom(uint64_t size)
+{
+	lock_guard<mutex> lock(mutex_);
+
+	if (headroom_size_ == size)
+		return true;
+
+	delete[] headroom_;
+	headroom_ = nullptr;
+	headroom_size_ = 0;
+
+	if (size == 0)
+		return true;
+
+	headroom_ = new (nothrow) uint8_t[size];
+	if (!headroom_)
+		return false;
+
+	// Touch the reserve so that the memory is actually committed
+	memset(headroom_, 0xFF, size);
+	headroom_size_ = size;
+
+	return true;
+}
+
+uint64_t ChunkPool::allocation_count()
+{
+	lock_guard<mutex> lock(mutex_);
+	return allocation_count_;
+}
+
+uint64_t ChunkPool::heap_allocation_count()
+{
+	lock_guard<mutex> lock(mutex_);
+	return heap_allocation_count_;
+}
+
+uint64_t ChunkPool::pooled_size()
+{
+	lock_guard<mutex> lock(mutex_);
+	return pooled_size_;
+}
+
+uint8_t* ChunkPool::allocate_from_heap(uint64_t size)
+{
+	// As the system overcommits memory, the allocation itself hardly ever
+	// fails. The process would be killed later on when the pages are used.
+	const uint64_t available = available_memory();
+	if ((available < size) || (available - size < DefaultHeadroom))
+		return nullptr;
+
+	return new (nothrow) uint8_t[size];
+}
+
+uint64_t ChunkPool::available_memory()
+{
+	// Only Linux tells, in kB
+	ifstream meminfo("/proc/meminfo");
+	string line;
+
+	while (getline(meminfo, line))
+		if (line.compare(0, 13, "MemAvailable:") == 0)
+			return stoull(line.substr(13)) * 1024;
+
+	return UINT64_MAX;
+}
+
+void ChunkPool::trim_pool()
+{
+	auto it = pool_.begin();
+	while ((pooled_size_ > pool_limit_) && (it != pool_.end())) {
+		while ((pooled_size_ > pool_limit_) && !it->second.empty()) {
+			delete[] it->second.back();
+			it->second.pop_back();
+			pooled_size_ -= it->first;
+		}
+
+		if (it->second.empty())
+			it = pool_.erase(it);
+		else
+			it++;
+	}
+}
+
+} // namespace data
+} // namespace pv
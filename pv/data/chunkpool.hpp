@@ -0,0 +1,122 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2026 The PulseView developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULSEVIEW_PV_DATA_CHUNKPOOL_HPP
+#define PULSEVIEW_PV_DATA_CHUNKPOOL_HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+using std::map;
+using std::mutex;
+using std::vector;
+
+namespace pv {
+namespace data {
+
+/**
+ * Process-wide pool of heap-allocated segment data chunks.
+ *
+ * Released chunks are kept for reuse by later segments up to a configurable
+ * limit, so that repeated acquisitions don't need to go through the heap for
+ * every chunk they fill.
+ *
+ * The pool also holds a memory reserve. If a chunk can't be allocated, the
+ * reserve is given back to the system before std::bad_alloc is thrown, so
+ * that the rest of the application has some memory left to work with while
+ * the acquisition is being stopped. As systems that overcommit memory
+ * hardly ever fail an allocation, chunks are also refused if the system
+ * would have less than DefaultHeadroom of memory available afterwards.
+ */
+class ChunkPool
+{
+public:
+	/// Default number of bytes of released chunks kept for reuse.
+	static const uint64_t DefaultPoolLimit;
+
+	/// Default size of the memory reserve.
+	static const uint64_t DefaultHeadroom;
+
+public:
+	/**
+	 * Returns a chunk of the given size, reusing a pooled one if possible.
+	 * @throws std::bad_alloc if the chunk could not be allocated.
+	 */
+	static uint8_t* allocate_chunk(uint64_t size);
+
+	/// Returns a chunk to the pool or frees it if the pool is full.
+	static void release_chunk(uint8_t* chunk, uint64_t size);
+
+	/// Frees a chunk whose size is unlikely to be requested again.
+	static void free_chunk(uint8_t* chunk);
+
+	/// Sets the number of bytes of released chunks to keep for reuse.
+	static void set_pool_limit(uint64_t limit);
+
+	/**
+	 * Makes sure the memory reserve of the given size is allocated. This
+	 * re-arms the reserve after it was used up by a failed allocation.
+	 * @return false if the reserve could not be allocated.
+	 */
+	static bool reserve_headroom(uint64_t size);
+
+	/// Returns the number of chunks requested so far.
+	static uint64_t allocation_count();
+
+	/// Returns the number of chunk requests that had to use the heap.
+	static uint64_t heap_allocation_count();
+
+	/// Returns the number of bytes held by pooled chunks.
+	static uint64_t pooled_size();
+
+private:
+	/**
+	 * Allocates a chunk on the heap unless that would leave the system
+	 * with less than the headroom of memory available.
+	 * @return nullptr if the chunk could not be allocated.
+	 */
+	static uint8_t* allocate_from_heap(uint64_t size);
+
+	/**
+	 * Returns the number of bytes the system can hand out without
+	 * swapping, or UINT64_MAX if it doesn't tell.
+	 */
+	static uint64_t available_memory();
+
+	static void trim_pool();
+
+private:
+	static mutex mutex_;
+
+	/// Released chunks by size
+	static map< uint64_t, vector<uint8_t*> > pool_;
+	static uint64_t pool_limit_, pooled_size_;
+
+	static uint8_t* headroom_;
+	static uint64_t headroom_size_;
+
+	static uint64_t allocation_count_, heap_allocation_count_;
+};
+
+} // namespace data
+} // namespace pv
+
+#endif // PULSEVIEW_PV_DATA_CHUNKPOOL_HPP
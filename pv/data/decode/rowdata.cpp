@@ -29,9 +29,10 @@ namespace pv {
 namespace data {
 namespace decode {
 
-RowData::RowData(Row* row) :
+RowData::RowData(Row* row, const void* memory_owner) :
 	row_(row),
-	prev_ann_start_sample_(0)
+	prev_ann_start_sample_(0),
+	memory_account_(memory_owner)
 {
 	assert(row);
 }
@@ -96,6 +97,8 @@ void RowData::emplace_annotation(srd_proto_data *pdata)
 	// is sorted by start sample. Otherwise, we'd have to sort when
 	// painting, which is expensive
 
+	deque<Annotation>::iterator annotation;
+
 	if (pdata->start_sample < prev_ann_start_sample_) {
 		// Find location to insert the annotation at
 
@@ -108,11 +111,34 @@ void RowData::emplace_annotation(srd_proto_data *pdata)
 		if (it != annotations_.begin())
 			it++;
 
-		annotations_.emplace(it, pdata, row_);
+		annotation = annotations_.emplace(it, pdata, row_);
 	} else {
 		annotations_.emplace_back(pdata, row_);
+		annotation = annotations_.end() - 1;
 		prev_ann_start_sample_ = pdata->start_sample;
 	}
+
+	memory_account_.add(MemoryAccount::AnnotationData,
+		estimate_size(*annotation));
+}
+
+void RowData::discard_annotations_before(uint64_t sample)
+{
+	while (!annotations_.empty() && (annotations_.front().end_sample() < sample)) {
+		memory_account_.add(MemoryAccount::AnnotationData,
+			-(int64_t)estimate_size(annotations_.front()));
+		annotations_.pop_front();
+	}
+}
+
+uint64_t RowData::estimate_size(const Annotation &annotation)
+{
+	// Include the heap allocated strings
+	uint64_t size = sizeof(Annotation) + sizeof(vector<QString>);
+	for (const QString &s : *annotation.annotations())
+		size += sizeof(QString) + sizeof(QArrayData) + s.size() * sizeof(QChar);
+
+	return size;
 }
 
 }  // namespace decode
@@ -25,6 +25,7 @@
 #include <libsigrokdecode/libsigrokdecode.h>
 
 #include <pv/data/decode/annotation.hpp>
+#include <pv/data/memorybudget.hpp>
 
 using std::deque;
 using std::vector;
@@ -38,7 +39,11 @@ class Row;
 class RowData
 {
 public:
-	RowData(Row* row);
+	/**
+	 * @param memory_owner The owner to account the memory used by the
+	 *        annotations to, see MemoryBudget.
+	 */
+	RowData(Row* row, const void* memory_owner);
 
 	uint64_t get_max_sample() const;
 
@@ -54,10 +59,21 @@ public:
 
 	void emplace_annotation(srd_proto_data *pdata);
 
+	/**
+	 * Discards the oldest annotations that end before the given sample,
+	 * e.g. because the sample data they were decoded from was evicted.
+	 */
+	void discard_annotations_before(uint64_t sample);
+
+private:
+	/// Estimates the memory used by an annotation, including its strings.
+	static uint64_t estimate_size(const Annotation &annotation);
+
 private:
 	deque<Annotation> annotations_;
 	Row* row_;
 	uint64_t prev_ann_start_sample_;
+	MemoryAccount memory_account_;
 };
 
 }  // namespace decode
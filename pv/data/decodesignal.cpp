@@ -36,10 +36,12 @@
 using std::forward_list;
 using std::lock_guard;
 using std::make_shared;
+using std::max;
 using std::min;
 using std::out_of_range;
 using std::shared_ptr;
 using std::unique_lock;
+using std::vector;
 using pv::data::decode::AnnotationClass;
 using pv::data::decode::DecodeChannel;
 
@@ -57,10 +59,15 @@ DecodeSignal::DecodeSignal(pv::Session &session) :
 	srd_session_(nullptr),
 	logic_mux_data_invalid_(false),
 	stack_config_changed_(true),
-	current_segment_id_(0)
+	current_segment_id_(0),
+	memory_account_(this)
 {
 	connect(&session_, SIGNAL(capture_state_changed(int)),
 		this, SLOT(on_capture_state_changed(int)));
+
+	// The worker threads can't restart themselves
+	connect(this, SIGNAL(input_evicted()),
+		this, SLOT(on_input_evicted()), Qt::QueuedConnection);
 }
 
 DecodeSignal::~DecodeSignal()
@@ -162,6 +169,7 @@ void DecodeSignal::reset_decode(bool shutting_down)
 
 	current_segment_id_ = 0;
 	segments_.clear();
+	memory_account_.set(MemoryAccount::BinaryData, 0);
 
 	logic_mux_data_.reset();
 	logic_mux_data_invalid_ = true;
@@ -191,6 +199,11 @@ void DecodeSignal::begin_decode()
 
 	reset_decode();
 
+	if (MemoryBudget::exceeded()) {
+		set_error_message(tr("Memory budget exceeded, decoding not started"));
+		return;
+	}
+
 	if (stack_.size() == 0) {
 		set_error_message(tr("No decoders"));
 		return;
@@ -270,6 +283,17 @@ QString DecodeSignal::error_message() const
 	return error_message_;
 }
 
+uint64_t DecodeSignal::get_memory_usage(MemoryAccount::Category category) const
+{
+	uint64_t usage = MemoryBudget::usage(this, category);
+
+	// The multiplexed logic data is a copy of the input data
+	if (logic_mux_data_)
+		usage += MemoryBudget::usage(logic_mux_data_.get(), category);
+
+	return usage;
+}
+
 const vector<decode::DecodeChannel> DecodeSignal::get_channels() const
 {
 	return channels_;
@@ -385,7 +409,7 @@ int64_t DecodeSignal::get_working_sample_count(uint32_t segment_id) const
 {
 	// The working sample count is the highest sample number for
 	// which all used signals have data available, so go through all
-	// channels and use the lowest overall sample count of the segment
+	// channels and use the lowest overall sample number of the segment
 
 	int64_t count = std::numeric_limits<int64_t>::max();
 	bool no_signals_assigned = true;
@@ -400,7 +424,7 @@ int64_t DecodeSignal::get_working_sample_count(uint32_t segment_id) const
 
 			try {
 				const shared_ptr<LogicSegment> segment = logic_data->logic_segments().at(segment_id);
-				count = min(count, (int64_t)segment->get_sample_count());
+				count = min(count, (int64_t)segment->end_sample_number());
 			} catch (out_of_range&) {
 				return 0;
 			}
@@ -979,17 +1003,45 @@ void DecodeSignal::commit_decoder_channels()
 			ch.bit_id = id++;
 }
 
-void DecodeSignal::mux_logic_samples(uint32_t segment_id, const int64_t start, const int64_t end)
+shared_ptr<LogicSegment> DecodeSignal::create_mux_segment(uint32_t segment_id)
+{
+	uint64_t first_sample = 0, max_sample_count = 0;
+
+	for (const decode::DecodeChannel& ch : channels_)
+		if (ch.assigned_signal) {
+			const shared_ptr<Logic> logic_data = ch.assigned_signal->logic_data();
+			if (!logic_data)
+				continue;
+
+			try {
+				const shared_ptr<LogicSegment> segment = logic_data->logic_segments().at(segment_id);
+				first_sample = max(first_sample, segment->first_sample_number());
+				max_sample_count = max(max_sample_count, segment->max_sample_count());
+			} catch (out_of_range&) {
+				// Do nothing
+			}
+		}
+
+	const shared_ptr<LogicSegment> segment =
+		make_shared<LogicSegment>(*logic_mux_data_, segment_id,
+			logic_mux_unit_size_, 0);
+	segment->set_first_sample_number(first_sample);
+	segment->set_max_sample_count(max_sample_count);
+	segment->set_samplerate(get_input_samplerate(segment_id));
+	logic_mux_data_->push_segment(segment);
+
+	return segment;
+}
+
+bool DecodeSignal::mux_logic_samples(uint32_t segment_id, const int64_t start, const int64_t end)
 {
 	// Enforce end to be greater than start
 	if (end <= start)
-		return;
+		return true;
 
-	// Fetch the channel segments and their data
+	// Fetch the channel segments and the bits of the assigned channels
 	vector<shared_ptr<LogicSegment> > segments;
-	vector<const uint8_t*> signal_data;
-	vector<uint8_t> signal_in_bytepos;
-	vector<uint8_t> signal_in_bitpos;
+	vector<const uint64_t*> signal_data;
 
 	for (decode::DecodeChannel& ch : channels_)
 		if (ch.assigned_signal) {
@@ -1001,17 +1053,18 @@ void DecodeSignal::mux_logic_samples(uint32_t segment_id, const int64_t start, c
 			} catch (out_of_range&) {
 				qDebug() << "Muxer error for" << name() << ":" << ch.assigned_signal->name() \
 					<< "has no logic segment" << segment_id;
-				return;
+				return true;
 			}
 			segments.push_back(segment);
 
-			uint8_t* data = new uint8_t[(end - start) * segment->unit_size()];
-			segment->get_samples(start, end, data);
+			uint64_t* data = new uint64_t[(end - start + 63) / 64];
 			signal_data.push_back(data);
-
-			const int bitpos = ch.assigned_signal->logic_bit_index();
-			signal_in_bytepos.push_back(bitpos / 8);
-			signal_in_bitpos.push_back(bitpos % 8);
+			if (!segment->get_channel_bits_by_number(ch.assigned_signal->logic_bit_index(),
+					start, end - start, data)) {
+				for (const uint64_t* d : signal_data)
+					delete[] d;
+				return false;
+			}
 		}
 
 
@@ -1022,11 +1075,14 @@ void DecodeSignal::mux_logic_samples(uint32_t segment_id, const int64_t start, c
 		qDebug() << "Muxer error for" << name() << ": no logic mux segment" \
 			<< segment_id << "in mux_logic_samples(), mux segments size is" \
 			<< logic_mux_data_->logic_segments().size();
-		return;
+		return true;
 	}
 
-	// Perform the muxing of signal data into the output data
-	uint8_t* output = new uint8_t[(end - start) * output_segment->unit_size()];
+	// Perform the muxing of signal data into the output data, preferably
+	// right into the output segment's chunk
+	const uint64_t output_size = (end - start) * output_segment->unit_size();
+	uint8_t* const payload_buffer = output_segment->get_payload_buffer(end - start);
+	uint8_t* const output = payload_buffer ? payload_buffer : new uint8_t[output_size];
 	unsigned int signal_count = signal_data.size();
 
 	for (int64_t sample_cnt = 0; !logic_mux_interrupt_ && (sample_cnt < (end - start));
@@ -1040,9 +1096,8 @@ void DecodeSignal::mux_logic_samples(uint32_t segment_id, const int64_t start, c
 			output[out_sample_pos + i] = 0;
 
 		for (unsigned int i = 0; i < signal_count; i++) {
-			const int in_sample_pos = sample_cnt * segments[i]->unit_size();
 			const uint8_t in_sample = 1 &
-				((signal_data[i][in_sample_pos + signal_in_bytepos[i]]) >> (signal_in_bitpos[i]));
+				(signal_data[i][sample_cnt / 64] >> (sample_cnt % 64));
 
 			const uint8_t out_sample = output[out_sample_pos + bytepos];
 
@@ -1056,11 +1111,17 @@ void DecodeSignal::mux_logic_samples(uint32_t segment_id, const int64_t start, c
 		}
 	}
 
-	output_segment->append_payload(output, (end - start) * output_segment->unit_size());
-	delete[] output;
+	if (payload_buffer)
+		output_segment->commit_payload_buffer(end - start);
+	else {
+		output_segment->append_payload(output, output_size);
+		delete[] output;
+	}
 
-	for (const uint8_t* data : signal_data)
+	for (const uint64_t* data : signal_data)
 		delete[] data;
+
+	return true;
 }
 
 void DecodeSignal::logic_mux_proc()
@@ -1070,16 +1131,11 @@ void DecodeSignal::logic_mux_proc()
 	assert(logic_mux_data_);
 
 	// Create initial logic mux segment
-	shared_ptr<LogicSegment> output_segment =
-		make_shared<LogicSegment>(*logic_mux_data_, segment_id,
-			logic_mux_unit_size_, 0);
-	logic_mux_data_->push_segment(output_segment);
-
-	output_segment->set_samplerate(get_input_samplerate(0));
+	shared_ptr<LogicSegment> output_segment = create_mux_segment(segment_id);
 
 	do {
 		const uint64_t input_sample_count = get_working_sample_count(segment_id);
-		const uint64_t output_sample_count = output_segment->get_sample_count();
+		const uint64_t output_sample_count = output_segment->end_sample_number();
 
 		const uint64_t samples_to_process =
 			(input_sample_count > output_sample_count) ?
@@ -1096,7 +1152,12 @@ void DecodeSignal::logic_mux_proc()
 				const uint64_t sample_count =
 					min(samples_to_process - processed_samples,	chunk_sample_count);
 
-				mux_logic_samples(segment_id, start_sample, start_sample + sample_count);
+				if (!mux_logic_samples(segment_id, start_sample, start_sample + sample_count)) {
+					// The rolling capture left us behind, start over with
+					// the samples that are still held
+					input_evicted();
+					return;
+				}
 				processed_samples += sample_count;
 
 				// ...and process the newly muxed logic data
@@ -1111,13 +1172,7 @@ void DecodeSignal::logic_mux_proc()
 				// Process next segment
 				segment_id++;
 
-				output_segment =
-					make_shared<LogicSegment>(*logic_mux_data_, segment_id,
-						logic_mux_unit_size_, 0);
-				logic_mux_data_->push_segment(output_segment);
-
-				output_segment->set_samplerate(get_input_samplerate(segment_id));
-
+				output_segment = create_mux_segment(segment_id);
 			} else {
 				// All segments have been processed
 				logic_mux_data_invalid_ = false;
@@ -1131,13 +1186,15 @@ void DecodeSignal::logic_mux_proc()
 	} while (!logic_mux_interrupt_);
 }
 
-void DecodeSignal::decode_data(
+bool DecodeSignal::decode_data(
 	const int64_t abs_start_samplenum, const int64_t sample_count,
 	const shared_ptr<LogicSegment> input_segment)
 {
 	const int64_t unit_size = input_segment->unit_size();
 	const int64_t chunk_sample_count = DecodeChunkLength / unit_size;
 
+	vector<SegmentSpan> spans;
+
 	for (int64_t i = abs_start_samplenum;
 		error_message_.isEmpty() && !decode_interrupt_ &&
 			(i < (abs_start_samplenum + sample_count));
@@ -1152,15 +1209,22 @@ void DecodeSignal::decode_data(
 			segments_.at(current_segment_id_).samples_decoded_incl = chunk_end;
 		}
 
-		int64_t data_size = (chunk_end - i) * unit_size;
-		uint8_t* chunk = new uint8_t[data_size];
-		input_segment->get_samples(i, chunk_end, chunk);
+		// Hand the samples to the decoder right from the segment's chunks
+		if (!input_segment->get_sample_spans_by_number(i, chunk_end - i, spans))
+			return false;
 
-		if (srd_session_send(srd_session_, i, chunk_end, chunk,
-				data_size, unit_size) != SRD_OK)
-			set_error_message(tr("Decoder reported an error"));
+		int64_t span_start = i;
+		for (const SegmentSpan &span : spans) {
+			const int64_t span_end = span_start + span.sample_count;
 
-		delete[] chunk;
+			if (srd_session_send(srd_session_, span_start, span_end, span.data,
+					span.sample_count * unit_size, unit_size) != SRD_OK) {
+				set_error_message(tr("Decoder reported an error"));
+				break;
+			}
+
+			span_start = span_end;
+		}
 
 		{
 			lock_guard<mutex> lock(output_mutex_);
@@ -1177,6 +1241,8 @@ void DecodeSignal::decode_data(
 			decode_pause_cond_.wait(pause_wait_lock);
 		}
 	}
+
+	return true;
 }
 
 void DecodeSignal::decode_proc()
@@ -1195,24 +1261,37 @@ void DecodeSignal::decode_proc()
 	shared_ptr<LogicSegment> input_segment = logic_mux_data_->logic_segments().front();
 	assert(input_segment);
 
+	// Sample numbers include the samples evicted from rolling captures,
+	// so that they keep referring to the same samples
+	uint64_t sample_count = 0;
+	uint64_t abs_start_samplenum = input_segment->first_sample_number();
+
 	// Create the initial segment and set its sample rate so that we can pass it to SRD
 	create_decode_segment();
 	segments_.at(current_segment_id_).samplerate = input_segment->samplerate();
-	segments_.at(current_segment_id_).start_time = input_segment->start_time();
+	segments_.at(current_segment_id_).start_time = input_segment->origin_time();
+	segments_.at(current_segment_id_).samples_decoded_incl = abs_start_samplenum;
+	segments_.at(current_segment_id_).samples_decoded_excl = abs_start_samplenum;
 
 	start_srd_session();
 
-	uint64_t sample_count = 0;
-	uint64_t abs_start_samplenum = 0;
 	do {
 		// Keep processing new samples until we exhaust the input data
 		do {
 			lock_guard<mutex> input_lock(input_mutex_);
-			sample_count = input_segment->get_sample_count() - abs_start_samplenum;
+			sample_count = input_segment->end_sample_number() - abs_start_samplenum;
 
 			if (sample_count > 0) {
-				decode_data(abs_start_samplenum, sample_count, input_segment);
+				if (!decode_data(abs_start_samplenum, sample_count, input_segment)) {
+					// The rolling capture left us behind, start over with
+					// the samples that are still held
+					input_evicted();
+					return;
+				}
 				abs_start_samplenum += sample_count;
+
+				// Only keep what belongs to the samples still held
+				discard_decoded_data_before(input_segment->first_sample_number());
 			}
 		} while (error_message_.isEmpty() && (sample_count > 0) && !decode_interrupt_);
 
@@ -1229,12 +1308,14 @@ void DecodeSignal::decode_proc()
 						<< logic_mux_data_->logic_segments().size();
 					return;
 				}
-				abs_start_samplenum = 0;
+				abs_start_samplenum = input_segment->first_sample_number();
 
 				// Create the next segment and set its metadata
 				create_decode_segment();
 				segments_.at(current_segment_id_).samplerate = input_segment->samplerate();
-				segments_.at(current_segment_id_).start_time = input_segment->start_time();
+				segments_.at(current_segment_id_).start_time = input_segment->origin_time();
+				segments_.at(current_segment_id_).samples_decoded_incl = abs_start_samplenum;
+				segments_.at(current_segment_id_).samples_decoded_excl = abs_start_samplenum;
 
 				// Reset decoder state but keep the decoder stack intact
 				terminate_srd_session();
@@ -1255,6 +1336,23 @@ void DecodeSignal::decode_proc()
 		terminate_srd_session();
 }
 
+void DecodeSignal::discard_decoded_data_before(uint64_t sample)
+{
+	lock_guard<mutex> lock(output_mutex_);
+
+	DecodeSegment& segment = segments_.at(current_segment_id_);
+
+	for (auto& row : segment.annotation_rows)
+		row.second.discard_annotations_before(sample);
+
+	for (DecodeBinaryClass& bc : segment.binary_classes)
+		while (!bc.chunks.empty() && (bc.chunks.front().sample < sample)) {
+			memory_account_.add(MemoryAccount::BinaryData,
+				-(int64_t)(sizeof(DecodeBinaryDataChunk) + bc.chunks.front().data.size()));
+			bc.chunks.pop_front();
+		}
+}
+
 void DecodeSignal::start_srd_session()
 {
 	// If there were stack changes, the session has been destroyed by now, so if
@@ -1385,7 +1483,7 @@ void DecodeSignal::create_decode_segment()
 	// Add annotation classes
 	for (const shared_ptr<Decoder>& dec : stack_)
 		for (Row* row : dec->get_rows())
-			segments_.back().annotation_rows.emplace(row, RowData(row));
+			segments_.back().annotation_rows.emplace(row, RowData(row, this));
 
 	// Prepare our binary output classes
 	for (const shared_ptr<Decoder>& dec : stack_) {
@@ -1484,6 +1582,9 @@ void DecodeSignal::binary_callback(srd_proto_data *pdata, void *decode_signal)
 	chunk->data.resize(pdb->size);
 	memcpy(chunk->data.data(), pdb->data, pdb->size);
 
+	ds->memory_account_.add(MemoryAccount::BinaryData,
+		sizeof(DecodeBinaryDataChunk) + pdb->size);
+
 	Decoder* dec = ds->get_decoder_by_instance(srd_dec);
 
 	ds->new_binary_data(ds->current_segment_id_, (void*)dec, pdb->bin_class);
@@ -1517,5 +1618,14 @@ void DecodeSignal::on_data_received()
 		logic_mux_cond_.notify_one();
 }
 
+void DecodeSignal::on_input_evicted()
+{
+	// TODO Emulate noquote()
+	qDebug().nospace() << name() << ": Input samples were evicted before "
+		"they could be decoded, restarting";
+
+	begin_decode();
+}
+
 } // namespace data
 } // namespace pv
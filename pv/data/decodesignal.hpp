@@ -111,6 +111,8 @@ public:
 	bool is_paused() const;
 	QString error_message() const;
 
+	virtual uint64_t get_memory_usage(MemoryAccount::Category category) const;
+
 	const vector<decode::DecodeChannel> get_channels() const;
 	void auto_assign_signals(const shared_ptr<Decoder> dec);
 	void assign_signal(const uint16_t channel_id, const SignalBase *signal);
@@ -124,7 +126,9 @@ public:
 	/**
 	 * Returns the number of samples that can be worked on,
 	 * i.e. the number of samples where samples are available
-	 * for all connected channels.
+	 * for all connected channels. Like the sample numbers of the
+	 * annotations, this includes the samples evicted from rolling
+	 * captures.
 	 */
 	int64_t get_working_sample_count(uint32_t segment_id) const;
 
@@ -192,13 +196,27 @@ private:
 
 	void commit_decoder_channels();
 
-	void mux_logic_samples(uint32_t segment_id, const int64_t start, const int64_t end);
+	/**
+	 * Creates a mux segment whose samples are numbered like those of the
+	 * input segments and that evicts its oldest samples along with them.
+	 */
+	shared_ptr<LogicSegment> create_mux_segment(uint32_t segment_id);
+
+	/**
+	 * Muxes the input samples with the given numbers into the output.
+	 * @return false if some of them were evicted from the input already.
+	 */
+	bool mux_logic_samples(uint32_t segment_id, const int64_t start, const int64_t end);
 	void logic_mux_proc();
 
-	void decode_data(const int64_t abs_start_samplenum, const int64_t sample_count,
+	/// @return false if some of the samples were evicted already.
+	bool decode_data(const int64_t abs_start_samplenum, const int64_t sample_count,
 		const shared_ptr<LogicSegment> input_segment);
 	void decode_proc();
 
+	/// Discards the decoder output for samples before the given one.
+	void discard_decoded_data_before(uint64_t sample);
+
 	void start_srd_session();
 	void terminate_srd_session();
 	void stop_srd_session();
@@ -219,10 +237,14 @@ Q_SIGNALS:
 	void decode_finished();
 	void channels_updated();
 
+	/// Emitted by the worker threads if they fell behind a rolling capture
+	void input_evicted();
+
 private Q_SLOTS:
 	void on_capture_state_changed(int state);
 	void on_data_cleared();
 	void on_data_received();
+	void on_input_evicted();
 
 private:
 	pv::Session &session_;
@@ -251,6 +273,8 @@ private:
 	bool decode_paused_;
 
 	QString error_message_;
+
+	MemoryAccount memory_account_;  ///< Binary decoder output
 };
 
 } // namespace data
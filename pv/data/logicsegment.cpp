@@ -21,22 +21,37 @@
 
 #include <extdef.h>
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 #include "logic.hpp"
 #include "logicsegment.hpp"
+#include "mipmapkernels.hpp"
 
 #include <libsigrokcxx/libsigrokcxx.hpp>
 
+using std::atomic;
+using std::chrono::milliseconds;
+using std::condition_variable;
+using std::deque;
 using std::lock_guard;
+using std::make_shared;
+using std::mutex;
 using std::recursive_mutex;
 using std::max;
 using std::min;
 using std::shared_ptr;
+using std::thread;
+using std::unique_lock;
 using std::vector;
 
 using sigrok::Logic;
@@ -48,16 +63,246 @@ const int LogicSegment::MipMapScalePower = 4;
 const int LogicSegment::MipMapScaleFactor = 1 << MipMapScalePower;
 const float LogicSegment::LogMipMapScaleFactor = logf(MipMapScaleFactor);
 const uint64_t LogicSegment::MipMapDataUnit = 64 * 1024; // bytes
+const uint64_t LogicSegment::EdgeIndexBlockLength = 4 * 1024; // samples
+const uint64_t LogicSegment::ScanWindowLength = 64 * 1024; // samples
+const uint64_t LogicSegment::MinParallelMipMapBlocks = 64 * 1024;
+const int LogicSegment::MipMapThreadIdleTime = 1000; // ms
+
+/// The loops over the samples of a segment, specialized for a unit size
+struct LogicSegment::SampleKernels
+{
+	/**
+	 * Adds the bits that changed since the respective previous samples to
+	 * bit-sliced counters, see count_block_bits().
+	 * @param prev The sample preceding the first one, receives the last.
+	 */
+	void (*count_edges)(const uint8_t* in, uint64_t count, uint64_t &prev,
+		uint64_t* counter);
+
+	/// Adds the set bits of the samples to bit-sliced counters.
+	void (*count_high)(const uint8_t* in, uint64_t count, uint64_t &prev,
+		uint64_t* counter);
+
+	/**
+	 * Returns the index of the first sample that differs from the given
+	 * one in the masked bits, or count if there is none.
+	 */
+	uint64_t (*find_change)(const uint8_t* in, uint64_t count,
+		uint64_t value, uint64_t mask);
+
+	/// Searches backwards like find_change() does forwards.
+	uint64_t (*find_last_change)(const uint8_t* in, uint64_t count,
+		uint64_t value, uint64_t mask);
+};
+
+namespace {
+
+/// Loads a sample of U bytes, clearing the bits beyond it
+template <unsigned int U>
+inline uint64_t load_sample(const uint8_t* ptr)
+{
+#ifdef HAVE_UNALIGNED_LITTLE_ENDIAN_ACCESS
+	// Chunks are padded so that whole words can be read
+	uint64_t value;
+	memcpy(&value, ptr, sizeof(value));
+	return (U < 8) ? (value & ((UINT64_C(1) << (U * 8 % 64)) - 1)) : value;
+#else
+	uint64_t value = 0;
+	for (unsigned int i = 0; i < U; i++)
+		value |= (uint64_t)ptr[i] << (i * 8);
+	return value;
+#endif
+}
+
+template <unsigned int U, bool High>
+void count_bits(const uint8_t* in, uint64_t count, uint64_t &prev,
+	uint64_t* counter)
+{
+	for (uint64_t i = 0; i < count; i++, in += U) {
+		const uint64_t sample = load_sample<U>(in);
+		uint64_t carry = High ? sample : (prev ^ sample);
+		prev = sample;
+
+		// Add the set bits to the counters
+		for (unsigned int k = 0; carry; k++) {
+			const uint64_t next_carry = counter[k] & carry;
+			counter[k] ^= carry;
+			carry = next_carry;
+		}
+	}
+}
+
+/// Repeats a sample of U bytes across a word
+template <unsigned int U>
+inline uint64_t broadcast_sample(uint64_t value)
+{
+	for (unsigned int shift = U * 8; shift < 64; shift *= 2)
+		value |= value << shift;
+	return value;
+}
+
+// Up to a change, all samples equal the given one in the masked bits, so
+// they're compared to that instead of their neighbours. Samples that evenly
+// divide a word are compared a word at a time, the position of the change
+// within the word is then found by counting the zeros below it.
+template <unsigned int U>
+uint64_t find_change(const uint8_t* in, uint64_t count, uint64_t value,
+	uint64_t mask)
+{
+	uint64_t i = 0;
+
+#ifdef HAVE_UNALIGNED_LITTLE_ENDIAN_ACCESS
+	if ((8 % U) == 0) {
+		const unsigned int per_word = 8 / U;
+		const uint64_t value_word = broadcast_sample<U>(value & mask);
+		const uint64_t mask_word = broadcast_sample<U>(mask);
+		uint64_t w[4];
+
+		// Skip over unchanged runs four words at a time
+		for (; i + 4 * per_word <= count; i += 4 * per_word) {
+			memcpy(w, in + i * U, sizeof(w));
+			if (((w[0] ^ value_word) | (w[1] ^ value_word) |
+				(w[2] ^ value_word) | (w[3] ^ value_word)) & mask_word)
+				break;
+		}
+
+		for (; i + per_word <= count; i += per_word) {
+			memcpy(w, in + i * U, sizeof(w[0]));
+			const uint64_t diff = (w[0] ^ value_word) & mask_word;
+			if (diff)
+				return i + __builtin_ctzll(diff) / (U * 8);
+		}
+	}
+#endif
+
+	for (in += i * U; i < count; i++, in += U)
+		if ((load_sample<U>(in) ^ value) & mask)
+			return i;
+
+	return count;
+}
+
+template <unsigned int U>
+uint64_t find_last_change(const uint8_t* in, uint64_t count, uint64_t value,
+	uint64_t mask)
+{
+	uint64_t i = count;
+
+#ifdef HAVE_UNALIGNED_LITTLE_ENDIAN_ACCESS
+	if ((8 % U) == 0) {
+		const unsigned int per_word = 8 / U;
+		const uint64_t value_word = broadcast_sample<U>(value & mask);
+		const uint64_t mask_word = broadcast_sample<U>(mask);
+		uint64_t w[4];
+
+		for (; i >= 4 * per_word; i -= 4 * per_word) {
+			memcpy(w, in + (i - 4 * per_word) * U, sizeof(w));
+			if (((w[0] ^ value_word) | (w[1] ^ value_word) |
+				(w[2] ^ value_word) | (w[3] ^ value_word)) & mask_word)
+				break;
+		}
+
+		for (; i >= per_word; i -= per_word) {
+			memcpy(w, in + (i - per_word) * U, sizeof(w[0]));
+			const uint64_t diff = (w[0] ^ value_word) & mask_word;
+			if (diff)
+				return i - per_word + (63 - __builtin_clzll(diff)) / (U * 8);
+		}
+	}
+#endif
+
+	while (i-- > 0)
+		if ((load_sample<U>(in + i * U) ^ value) & mask)
+			return i;
+
+	return count;
+}
+
+} // namespace
+
+const LogicSegment::SampleKernels LogicSegment::SampleKernelTable[8] = {
+	{count_bits<1, false>, count_bits<1, true>, find_change<1>,
+		find_last_change<1>},
+	{count_bits<2, false>, count_bits<2, true>, find_change<2>,
+		find_last_change<2>},
+	{count_bits<3, false>, count_bits<3, true>, find_change<3>,
+		find_last_change<3>},
+	{count_bits<4, false>, count_bits<4, true>, find_change<4>,
+		find_last_change<4>},
+	{count_bits<5, false>, count_bits<5, true>, find_change<5>,
+		find_last_change<5>},
+	{count_bits<6, false>, count_bits<6, true>, find_change<6>,
+		find_last_change<6>},
+	{count_bits<7, false>, count_bits<7, true>, find_change<7>,
+		find_last_change<7>},
+	{count_bits<8, false>, count_bits<8, true>, find_change<8>,
+		find_last_change<8>}
+};
+
+/// The pieces of a parallel mip-map update, taken by the threads in turns
+struct LogicSegment::MipMapJob
+{
+	struct Piece
+	{
+		const uint8_t* in;
+		const uint8_t* prev_sample;
+		uint8_t* out;
+		uint64_t block_count;
+	};
+
+	vector<Piece> pieces;
+	unsigned int unit_size;
+
+	atomic<size_t> next_piece;
+	size_t done_count;  ///< Protected by done_mutex
+	mutex done_mutex;
+	condition_variable done_cond;
+
+	void run()
+	{
+		for (size_t i = next_piece++; i < pieces.size(); i = next_piece++) {
+			MipMapKernels::xor_accumulate(pieces[i].in, pieces[i].out,
+				pieces[i].block_count, unit_size, pieces[i].prev_sample);
+
+			lock_guard<mutex> lock(done_mutex);
+			if (++done_count == pieces.size())
+				done_cond.notify_all();
+		}
+	}
+};
+
+bool LogicSegment::compression_enabled_ = false;
+bool LogicSegment::bit_planes_enabled_ = false;
+
+mutex LogicSegment::mipmap_mutex_;
+condition_variable LogicSegment::mipmap_cond_;
+deque< shared_ptr<LogicSegment::MipMapJob> > LogicSegment::mipmap_queue_;
+unsigned int LogicSegment::mipmap_thread_count_ = 0;
 
 LogicSegment::LogicSegment(pv::data::Logic& owner, uint32_t segment_id,
 	unsigned int unit_size,	uint64_t samplerate) :
 	Segment(segment_id, samplerate, unit_size),
 	owner_(owner),
+	index_first_block_(0),
+	sample_kernels_(&SampleKernelTable[unit_size - 1]),
+	parallel_mipmap_(false),
 	last_append_sample_(0),
 	last_append_accumulator_(0),
 	last_append_extra_(0)
 {
+	assert(MipMapScaleFactor == MipMapKernels::BlockLength);
+	assert((unit_size >= 1) && (unit_size <= 8));
+
 	memset(mip_map_, 0, sizeof(mip_map_));
+
+	memory_account_.set_owner(&owner);
+
+	// Logic data mostly consists of long runs of identical samples
+	if (compression_enabled_)
+		set_chunk_compression(RunLengthCompression);
+
+	if (bit_planes_enabled_)
+		bit_planes_.resize(unit_size * 8, BitPlane{0, vector<uint64_t>()});
 }
 
 LogicSegment::~LogicSegment()
@@ -67,81 +312,26 @@ LogicSegment::~LogicSegment()
 		free(l.data);
 }
 
-template <class T>
-void LogicSegment::downsampleTmain(const T*&in, T &acc, T &prev)
+void LogicSegment::set_compression_enabled(bool enabled)
 {
-	// Accumulate one sample at a time
-	for (uint64_t i = 0; i < MipMapScaleFactor; i++) {
-		T sample = *in++;
-		acc |= prev ^ sample;
-		prev = sample;
-	}
+	compression_enabled_ = enabled;
 }
 
-template <>
-void LogicSegment::downsampleTmain<uint8_t>(const uint8_t*&in, uint8_t &acc, uint8_t &prev)
+void LogicSegment::set_bit_planes_enabled(bool enabled)
 {
-	// Handle 8 bit samples in 32 bit steps
-	uint32_t prev32 = prev | prev << 8 | prev << 16 | prev << 24;
-	uint32_t acc32 = acc;
-	const uint32_t *in32 = (const uint32_t*)in;
-	for (uint64_t i = 0; i < MipMapScaleFactor; i += 4) {
-		uint32_t sample32 = *in32++;
-		acc32 |= prev32 ^ sample32;
-		prev32 = sample32;
-	}
-	// Reduce result back to uint8_t
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-	prev = (prev32 >> 24) & 0xff; // MSB is last
-#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-	prev = prev32 & 0xff; // LSB is last
-#else
-#error Endianness unknown
-#endif
-	acc |= acc32 & 0xff;
-	acc |= (acc32 >> 8) & 0xff;
-	acc |= (acc32 >> 16) & 0xff;
-	acc |= (acc32 >> 24) & 0xff;
-	in = (const uint8_t*)in32;
-}
-
-template <>
-void LogicSegment::downsampleTmain<uint16_t>(const uint16_t*&in, uint16_t &acc, uint16_t &prev)
-{
-	// Handle 16 bit samples in 32 bit steps
-	uint32_t prev32 = prev | prev << 16;
-	uint32_t acc32 = acc;
-	const uint32_t *in32 = (const uint32_t*)in;
-	for (uint64_t i = 0; i < MipMapScaleFactor; i += 2) {
-		uint32_t sample32 = *in32++;
-		acc32 |= prev32 ^ sample32;
-		prev32 = sample32;
-	}
-	// Reduce result back to uint16_t
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-	prev = (prev32 >> 16) & 0xffff; // MSB is last
-#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-	prev = prev32 & 0xffff; // LSB is last
-#else
-#error Endian unknown
-#endif
-	acc |= acc32 & 0xffff;
-	acc |= (acc32 >> 16) & 0xffff;
-	in = (const uint16_t*)in32;
+	bit_planes_enabled_ = enabled;
 }
 
-template <class T>
-void LogicSegment::downsampleT(const uint8_t *in_, uint8_t *&out_, uint64_t len)
+void LogicSegment::downsample(const uint8_t *in, uint8_t *&out, uint64_t len)
 {
-	const T *in = (const T*)in_;
-	T *out = (T*)out_;
-	T prev = last_append_sample_;
-	T acc = last_append_accumulator_;
+	uint64_t prev = last_append_sample_;
+	uint64_t acc = last_append_accumulator_;
 
 	// Try to complete the previous downsample
 	if (last_append_extra_) {
 		while (last_append_extra_ < MipMapScaleFactor && len > 0) {
-			T sample = *in++;
+			const uint64_t sample = unpack_sample(in);
+			in += unit_size_;
 			acc |= prev ^ sample;
 			prev = sample;
 			last_append_extra_++;
@@ -154,23 +344,31 @@ void LogicSegment::downsampleT(const uint8_t *in_, uint8_t *&out_, uint64_t len)
 			return;
 		}
 		// We have a complete downsample
-		*out++ = acc;
+		pack_sample(out, acc);
+		out += unit_size_;
 		acc = 0;
 		last_append_extra_ = 0;
 	}
 
-	// Handle complete blocks of MipMapScaleFactor samples
-	while (len >= MipMapScaleFactor) {
-		downsampleTmain<T>(in, acc, prev);
-		len -= MipMapScaleFactor;
-		// Output downsample
-		*out++ = acc;
-		acc = 0;
+	// Handle complete blocks of MipMapScaleFactor samples in bulk
+	const uint64_t block_count = len / MipMapScaleFactor;
+	if (block_count > 0) {
+		uint8_t prev_sample[sizeof(uint64_t)];
+		pack_sample(prev_sample, prev);
+
+		MipMapKernels::xor_accumulate(in, out, block_count, unit_size_,
+			prev_sample);
+
+		in += block_count * MipMapScaleFactor * unit_size_;
+		out += block_count * unit_size_;
+		len -= block_count * MipMapScaleFactor;
+		prev = unpack_sample(in - unit_size_);
 	}
 
 	// Process remainder, not enough for a complete sample
 	while (len > 0) {
-		T sample = *in++;
+		const uint64_t sample = unpack_sample(in);
+		in += unit_size_;
 		acc |= prev ^ sample;
 		prev = sample;
 		last_append_extra_++;
@@ -180,68 +378,187 @@ void LogicSegment::downsampleT(const uint8_t *in_, uint8_t *&out_, uint64_t len)
 	// Update context
 	last_append_sample_ = prev;
 	last_append_accumulator_ = acc;
-	out_ = (uint8_t *)out;
 }
 
-void LogicSegment::downsampleGeneric(const uint8_t *in, uint8_t *&out, uint64_t len)
+uint64_t LogicSegment::edge_index_block_start(uint64_t block) const
 {
-	// Downsample using the generic unpack_sample()
-	// which can handle any width between 1 and 8 bytes
-	uint64_t prev = last_append_sample_;
-	uint64_t acc = last_append_accumulator_;
+	const uint64_t start = block * EdgeIndexBlockLength;
+	const uint64_t evicted = evicted_sample_count();
 
-	// Try to complete the previous downsample
-	if (last_append_extra_) {
-		while (last_append_extra_ < MipMapScaleFactor && len > 0) {
-			const uint64_t sample = unpack_sample(in);
-			in += unit_size_;
-			acc |= prev ^ sample;
-			prev = sample;
-			last_append_extra_++;
-			len--;
+	return (start > evicted) ? (start - evicted) : 0;
+}
+
+void LogicSegment::count_block_bits(uint64_t block, bool high,
+	uint64_t* counts)
+{
+	const unsigned int signal_count = unit_size_ * 8;
+	const uint64_t start = max(edge_index_block_start(block),
+		(uint64_t)(high ? 0 : 1));
+	const uint64_t end = edge_index_block_start(block + 1);
+
+	// The counts are bit-sliced so that all signals are counted at once:
+	// bit k of the count of signal i is bit i of counter[k]. The counters
+	// must be able to hold the block length.
+	const unsigned int counter_bits = 64 - __builtin_clzll(EdgeIndexBlockLength);
+	uint64_t counter[64] = {0};
+
+	if (start < end) {
+		// Edges are found by comparing each sample to its predecessor
+		const uint64_t skip = high ? 0 : 1;
+
+		vector<SegmentSpan> spans;
+		get_sample_spans(start - skip, end - start + skip, spans);
+
+		const auto count = high ? sample_kernels_->count_high :
+			sample_kernels_->count_edges;
+		uint64_t prev = high ? 0 : unpack_sample(spans.front().data);
+
+		for (uint64_t i = 0; i < spans.size(); i++) {
+			const uint64_t offs = (i == 0) ? skip : 0;
+			count(spans[i].data + offs * unit_size_,
+				spans[i].sample_count - offs, prev, counter);
 		}
-		if (!len) {
-			// Not enough samples available to complete downsample
-			last_append_sample_ = prev;
-			last_append_accumulator_ = acc;
-			return;
+	}
+
+	for (unsigned int i = 0; i < signal_count; i++) {
+		counts[i] = 0;
+		for (unsigned int k = 0; k < counter_bits; k++)
+			counts[i] |= ((counter[k] >> i) & 1) << k;
+	}
+}
+
+void LogicSegment::update_block_index(vector<uint64_t> &index, bool high,
+	uint64_t end_sample)
+{
+	const unsigned int signal_count = unit_size_ * 8;
+	const uint64_t prev_capacity = index.capacity();
+	vector<uint64_t> counts(signal_count);
+
+	while (true) {
+		const uint64_t block = index_first_block_ + index.size() / signal_count;
+
+		if (edge_index_block_start(block + 1) > min(end_sample, get_sample_count()))
+			break;
+
+		count_block_bits(block, high, counts.data());
+
+		const uint64_t prev_offs = index.size() - signal_count;
+		for (unsigned int i = 0; i < signal_count; i++)
+			index.push_back(counts[i] + ((block > index_first_block_) ?
+				index[prev_offs + i] : 0));
+	}
+
+	memory_account_.add(MemoryAccount::SummaryData,
+		(index.capacity() - prev_capacity) * sizeof(uint64_t));
+
+	update_deferred_summary_size();
+}
+
+void LogicSegment::trim_block_indexes()
+{
+	const unsigned int signal_count = unit_size_ * 8;
+	const uint64_t first_block = evicted_sample_count() / EdgeIndexBlockLength;
+	vector<uint64_t> counts(signal_count);
+
+	for (const bool high : {false, true}) {
+		vector<uint64_t> &index = high ? high_index_ : edge_index_;
+		const uint64_t dropped = min(first_block - index_first_block_,
+			(uint64_t)index.size() / signal_count);
+
+		if (dropped > 0) {
+			// Make the counts relative to the end of the last block dropped
+			const uint64_t base_offs = (dropped - 1) * signal_count;
+			for (uint64_t i = dropped * signal_count; i < index.size(); i++)
+				index[i] -= index[base_offs + i % signal_count];
+
+			index.erase(index.begin(), index.begin() + dropped * signal_count);
 		}
-		// We have a complete downsample
-		pack_sample(out, acc);
-		out += unit_size_;
-		acc = 0;
-		last_append_extra_ = 0;
 	}
 
-	// Handle complete blocks of MipMapScaleFactor samples
-	while (len >= MipMapScaleFactor) {
-		// Accumulate one sample at a time
-		for (uint64_t i = 0; i < MipMapScaleFactor; i++) {
-			const uint64_t sample = unpack_sample(in);
-			in += unit_size_;
-			acc |= prev ^ sample;
-			prev = sample;
+	index_first_block_ = first_block;
+
+	// Samples of the first block may have been evicted, so count it again
+	for (const bool high : {false, true}) {
+		vector<uint64_t> &index = high ? high_index_ : edge_index_;
+		if (index.empty())
+			continue;
+
+		count_block_bits(first_block, high, counts.data());
+
+		for (unsigned int i = 0; i < signal_count; i++) {
+			const uint64_t prev_count = index[i];
+			for (uint64_t j = i; j < index.size(); j += signal_count)
+				index[j] = index[j] - prev_count + counts[i];
 		}
-		len -= MipMapScaleFactor;
-		// Output downsample
-		pack_sample(out, acc);
-		out += unit_size_;
-		acc = 0;
 	}
+}
 
-	// Process remainder, not enough for a complete sample
-	while (len > 0) {
-		const uint64_t sample = unpack_sample(in);
-		in += unit_size_;
-		acc |= prev ^ sample;
-		prev = sample;
-		last_append_extra_++;
-		len--;
+uint64_t LogicSegment::count_bits_before(bool high, int sig_index,
+	uint64_t sample)
+{
+	vector<uint64_t> &index = high ? high_index_ : edge_index_;
+	update_block_index(index, high, sample);
+
+	const uint64_t signal_count = unit_size_ * 8;
+	const uint64_t end_block = index_first_block_ + index.size() / signal_count;
+
+	// Take the count of the block holding the sample from the index, or
+	// of the last complete block if it isn't indexed yet
+	const uint64_t block = min(max((sample + evicted_sample_count()) /
+		EdgeIndexBlockLength, index_first_block_), end_block);
+
+	uint64_t count = indexed_count(index, sig_index, block);
+
+	// Count the remaining edges or samples one by one
+	const uint64_t start = max(edge_index_block_start(block),
+		(uint64_t)(high ? 0 : 1));
+	if (sample > start) {
+		vector<uint64_t> bits;
+		if (high) {
+			bits.resize((sample - start + 63) / 64);
+			get_channel_bits(sig_index, start, sample - start, bits.data());
+		} else
+			get_edge_bits(sig_index, start, sample, bits);
+
+		for (const uint64_t word : bits)
+			count += __builtin_popcountll(word);
 	}
 
-	// Update context
-	last_append_sample_ = prev;
-	last_append_accumulator_ = acc;
+	return count;
+}
+
+uint64_t LogicSegment::indexed_count(const vector<uint64_t> &index,
+	int sig_index, uint64_t block) const
+{
+	assert(block >= index_first_block_);
+
+	if (block == index_first_block_)
+		return 0;
+
+	return index[(block - index_first_block_ - 1) * unit_size_ * 8 + sig_index];
+}
+
+void LogicSegment::get_edge_bits(int sig_index, uint64_t start, uint64_t end,
+	vector<uint64_t> &dest)
+{
+	assert(start >= 1);
+	assert(start < end);
+
+	const uint64_t count = end - start;
+
+	// Sample start - 1 + i ends up in bit i, so each edge is found as a
+	// difference between a bit and the following one
+	vector<uint64_t> samples((count + 1 + 63) / 64);
+	get_channel_bits(sig_index, start - 1, count + 1, samples.data());
+
+	dest.resize((count + 63) / 64);
+	for (uint64_t i = 0; i < dest.size(); i++) {
+		const uint64_t next = (i + 1 < samples.size()) ? samples[i + 1] : 0;
+		dest[i] = samples[i] ^ ((samples[i] >> 1) | (next << 63));
+	}
+
+	if (count % 64)
+		dest.back() &= (UINT64_C(1) << (count % 64)) - 1;
 }
 
 inline uint64_t LogicSegment::unpack_sample(const uint8_t *ptr) const
@@ -318,6 +635,13 @@ inline void LogicSegment::pack_sample(uint8_t *ptr, uint64_t value)
 #endif
 }
 
+void LogicSegment::set_parallel_mipmap(bool enabled)
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	parallel_mipmap_ = enabled;
+}
+
 void LogicSegment::append_payload(shared_ptr<sigrok::Logic> logic)
 {
 	assert(unit_size_ == logic->unit_size());
@@ -332,13 +656,42 @@ void LogicSegment::append_payload(void *data, uint64_t data_size)
 
 	lock_guard<recursive_mutex> lock(mutex_);
 
-	const uint64_t prev_sample_count = sample_count_;
+	uint64_t prev_sample_count = get_sample_count();
 	const uint64_t sample_count = data_size / unit_size_;
 
 	append_samples(data, sample_count);
 
-	// Generate the first mip-map from the data
-	append_payload_to_mipmap();
+	// The mip-map and the edge index are built when they're needed
+	prev_sample_count -= min(evict_old_samples(), prev_sample_count);
+	update_deferred_summary_size();
+
+	if (sample_count > 1)
+		owner_.notify_samples_added(this, prev_sample_count + 1,
+			prev_sample_count + 1 + sample_count);
+	else
+		owner_.notify_samples_added(this, prev_sample_count + 1,
+			prev_sample_count + 1);
+}
+
+uint8_t* LogicSegment::get_payload_buffer(uint64_t sample_count)
+{
+	uint64_t max_count;
+	uint8_t* const buffer = get_append_buffer(max_count);
+
+	return (sample_count <= max_count) ? buffer : nullptr;
+}
+
+void LogicSegment::commit_payload_buffer(uint64_t sample_count)
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	uint64_t prev_sample_count = get_sample_count();
+
+	commit_appended_samples(sample_count);
+
+	// The mip-map and the edge index are built when they're needed
+	prev_sample_count -= min(evict_old_samples(), prev_sample_count);
+	update_deferred_summary_size();
 
 	if (sample_count > 1)
 		owner_.notify_samples_added(this, prev_sample_count + 1,
@@ -352,15 +705,67 @@ void LogicSegment::get_samples(int64_t start_sample,
 	int64_t end_sample, uint8_t* dest) const
 {
 	assert(start_sample >= 0);
-	assert(start_sample <= (int64_t)sample_count_);
+	assert(start_sample <= (int64_t)sample_count_bound());
 	assert(end_sample >= 0);
-	assert(end_sample <= (int64_t)sample_count_);
+	assert(end_sample <= (int64_t)sample_count_bound());
 	assert(start_sample <= end_sample);
 	assert(dest != nullptr);
 
+	get_raw_samples(start_sample, (end_sample - start_sample), dest);
+}
+
+void LogicSegment::get_channel_bits(int sig_index, uint64_t start,
+	uint64_t count, uint64_t* dest)
+{
+	assert(sig_index >= 0);
+	assert(sig_index < (int)unit_size_ * 8);
+	assert(dest != nullptr);
+
 	lock_guard<recursive_mutex> lock(mutex_);
 
-	get_raw_samples(start_sample, (end_sample - start_sample), dest);
+	assert(start + count <= get_sample_count());
+
+	const uint64_t word_count = (count + 63) / 64;
+	if (!word_count)
+		return;
+
+	if (bit_planes_.empty()) {
+		memset(dest, 0, word_count * sizeof(uint64_t));
+		extract_channel_bits(sig_index, start, count, dest, 0);
+		return;
+	}
+
+	// Shift the words of the plane into place
+	const BitPlane &plane = update_bit_plane(sig_index);
+	const uint64_t* src = plane.words.data() + start / 64;
+	const unsigned int shift = start % 64;
+	const uint64_t src_word_count = plane.words.size() - start / 64;
+
+	for (uint64_t i = 0; i < word_count; i++) {
+		uint64_t word = src[i] >> shift;
+		if (shift && (i + 1 < src_word_count))
+			word |= src[i + 1] << (64 - shift);
+		dest[i] = word;
+	}
+
+	if (count % 64)
+		dest[word_count - 1] &= (UINT64_C(1) << (count % 64)) - 1;
+}
+
+bool LogicSegment::get_channel_bits_by_number(int sig_index, uint64_t number,
+	uint64_t count, uint64_t* dest)
+{
+	// Samples are only evicted while mutex_ is held
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	const uint64_t first = first_sample_number();
+	if (number < first)
+		return false;
+
+	assert(number + count <= end_sample_number());
+
+	get_channel_bits(sig_index, number - first, count, dest);
+	return true;
 }
 
 void LogicSegment::get_subsampled_edges(
@@ -380,17 +785,30 @@ void LogicSegment::get_subsampled_edges(
 
 	lock_guard<recursive_mutex> lock(mutex_);
 
-	// Make sure we only process as many samples as we have
-	if (end > get_sample_count())
-		end = get_sample_count();
+	// The range may have been determined before samples were evicted
+	const uint64_t sample_count = get_sample_count();
+	if (start >= sample_count)
+		return;
+
+	// Make sure we only process as many samples as we have, including
+	// the end sample that determines the final state
+	if (end >= sample_count)
+		end = sample_count - 1;
+
+	update_mipmap(end + 1);
 
 	const uint64_t block_length = (uint64_t)max(min_length, 1.0f);
 	const unsigned int min_level = max((int)floorf(logf(min_length) /
 		LogMipMapScaleFactor) - 1, 0);
 	const uint64_t sig_mask = 1ULL << sig_index;
 
+	// Individual samples are read from the bit plane if there is one
+	const BitPlane* const plane = bit_planes_.empty() ? nullptr :
+		&update_bit_plane(sig_index);
+	SampleWindow window = {0, 0, SegmentSpan()};
+
 	// Store the initial state
-	last_sample = (get_unpacked_sample(start) & sig_mask) != 0;
+	last_sample = get_sample_bit(plane, window, start, sig_mask);
 	if (!first_change_only)
 		edges.emplace_back(index++, last_sample);
 
@@ -407,18 +825,12 @@ void LogicSegment::get_subsampled_edges(
 			// the next first level mip map block
 			const uint64_t final_index = min(end, pow2_ceil(index, MipMapScalePower));
 
-			for (; index < final_index &&
-					(index & ~((uint64_t)(~0) << MipMapScalePower)) != 0;
-					index++) {
+			index = find_sample_change(plane, window, sig_mask, index,
+				final_index, last_sample);
 
-				const bool sample = (get_unpacked_sample(index) & sig_mask) != 0;
-
-				// If there was a change we cannot fast forward
-				if (sample != last_sample) {
-					fast_forward = false;
-					break;
-				}
-			}
+			// If there was a change we cannot fast forward
+			if (index < final_index)
+				fast_forward = false;
 		} else {
 			// If resolution is less than a mip map block,
 			// round up to the beginning of the mip-map block
@@ -429,7 +841,7 @@ void LogicSegment::get_subsampled_edges(
 				break;
 
 			// We can fast forward only if there was no change
-			const bool sample = (get_unpacked_sample(index) & sig_mask) != 0;
+			const bool sample = get_sample_bit(plane, window, index, sig_mask);
 			if (last_sample != sample)
 				fast_forward = false;
 		}
@@ -441,68 +853,14 @@ void LogicSegment::get_subsampled_edges(
 			// zooming in on them to find the point where the edge
 			// begins.
 
-			// Slide right and zoom out at the beginnings of mip-map
-			// blocks until we encounter a change
-			while (true) {
-				const int level_scale_power = (level + 1) * MipMapScalePower;
-				const uint64_t offset = index >> level_scale_power;
-
-				// Check if we reached the last block at this
-				// level, or if there was a change in this block
-				if (offset >= mip_map_[level].length ||
-					(get_subsample(level, offset) &	sig_mask))
-					break;
-
-				if ((offset & ~((uint64_t)(~0) << MipMapScalePower)) == 0) {
-					// If we are now at the beginning of a
-					// higher level mip-map block ascend one
-					// level
-					if ((level + 1 >= ScaleStepCount) || (!mip_map_[level + 1].data))
-						break;
-
-					level++;
-				} else {
-					// Slide right to the beginning of the
-					// next mip map block
-					index = pow2_ceil(index + 1, level_scale_power);
-				}
-			}
-
-			// Zoom in, and slide right until we encounter a change,
-			// and repeat until we reach min_level
-			while (true) {
-				assert(mip_map_[level].data);
-
-				const int level_scale_power = (level + 1) * MipMapScalePower;
-				const uint64_t offset = index >> level_scale_power;
-
-				// Check if we reached the last block at this
-				// level, or if there was a change in this block
-				if (offset >= mip_map_[level].length ||
-						(get_subsample(level, offset) & sig_mask)) {
-					// Zoom in unless we reached the minimum
-					// zoom
-					if (level == min_level)
-						break;
-
-					level--;
-				} else {
-					// Slide right to the beginning of the
-					// next mip map block
-					index = pow2_ceil(index + 1, level_scale_power);
-				}
-			}
+			index = find_changed_block(min_level, index, sig_mask);
 
 			// If individual samples within the limit of resolution,
 			// do a linear search for the next transition within the
 			// block
-			if (min_length < MipMapScaleFactor) {
-				for (; index < end; index++) {
-					const bool sample = (get_unpacked_sample(index) & sig_mask) != 0;
-					if (sample != last_sample)
-						break;
-				}
-			}
+			if (min_length < MipMapScaleFactor)
+				index = find_sample_change(plane, window, sig_mask, index, end,
+					last_sample);
 		}
 
 		//----- Store the edge -----//
@@ -513,7 +871,8 @@ void LogicSegment::get_subsampled_edges(
 			break;
 
 		// Store the final state
-		const bool final_sample = (get_unpacked_sample(final_index - 1) & sig_mask) != 0;
+		const bool final_sample = get_sample_bit(plane, window,
+			final_index - 1, sig_mask);
 		edges.emplace_back(index, final_sample);
 
 		index = final_index;
@@ -525,51 +884,433 @@ void LogicSegment::get_subsampled_edges(
 
 	// Add the final state
 	if (!first_change_only) {
-		const bool end_sample = get_unpacked_sample(end) & sig_mask;
+		const bool end_sample = get_sample_bit(plane, window, end, sig_mask);
 		if (last_sample != end_sample)
 			edges.emplace_back(end, end_sample);
 		edges.emplace_back(end + 1, end_sample);
 	}
 }
 
-void LogicSegment::get_surrounding_edges(vector<EdgePair> &dest,
-	uint64_t origin_sample, float min_length, int sig_index)
+void LogicSegment::get_subsampled_edges(vector< vector<EdgePair> > &edges,
+	uint64_t start, uint64_t end, float min_length, uint64_t sig_mask)
 {
-	if (origin_sample >= sample_count_)
+	assert(start <= end);
+	assert(min_length > 0);
+
+	const unsigned int signal_count = unit_size_ * 8;
+	if (signal_count < 64)
+		sig_mask &= (UINT64_C(1) << signal_count) - 1;
+
+	edges.clear();
+	edges.resize(signal_count);
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	// The range may have been determined before samples were evicted
+	const uint64_t sample_count = get_sample_count();
+	if (start >= sample_count)
 		return;
 
-	// Put the edges vector on the heap, it can become quite big until we can
-	// use a get_subsampled_edges() implementation that searches backwards
-	vector<EdgePair>* edges = new vector<EdgePair>;
+	// Make sure we only process as many samples as we have, including
+	// the end sample that determines the final state
+	if (end >= sample_count)
+		end = sample_count - 1;
 
-	// Get all edges to the left of origin_sample
-	get_subsampled_edges(*edges, 0, origin_sample, min_length, sig_index, false);
+	update_mipmap(end + 1);
 
-	// If we don't specify "first only", the first and last edge are the states
-	// at samples 0 and origin_sample. If only those exist, there are no edges
-	if (edges->size() == 2) {
-		delete edges;
+	const uint64_t block_length = (uint64_t)max(min_length, 1.0f);
+	const unsigned int min_level = max((int)floorf(logf(min_length) /
+		LogMipMapScaleFactor) - 1, 0);
+
+	// Bit planes are searched one signal at a time, and without a mip-map
+	// the search of single signals quantizes differently
+	if (!bit_planes_.empty() || !mip_map_[min_level].data) {
+		for (uint64_t m = sig_mask; m; m &= m - 1) {
+			const int sig_index = __builtin_ctzll(m);
+			get_subsampled_edges(edges[sig_index], start, end, min_length,
+				sig_index);
+		}
 		return;
 	}
 
-	// Dismiss the entry for origin_sample so that back() gives us the
-	// real last entry
-	edges->pop_back();
-	dest.push_back(edges->back());
-	edges->clear();
+	// The search follows the one of single signals, see above. Each signal
+	// keeps its own position and level, while the mip-map and the samples
+	// are traversed once for all signals that are still searched.
+	uint64_t next_index[64], block_index[64];
+	uint64_t active = sig_mask;
+
+	SampleWindow window = {0, 0, SegmentSpan()};
+	SampleWindow final_window = {0, 0, SegmentSpan()};
+
+	// Bit i holds the level of signal i before its position
+	uint64_t last = get_window_sample(window, start);
+
+	// Take the last sample of the quantization block, or stop searching
+	// the signal once the block doesn't fit into the range anymore
+	const auto store_edge = [&](unsigned int sig_index, uint64_t index) {
+		const uint64_t bit = UINT64_C(1) << sig_index;
+		if (index + block_length > end) {
+			active &= ~bit;
+			return;
+		}
+
+		const uint64_t final_sample = get_window_sample(final_window,
+			index + block_length - 1) & bit;
+		edges[sig_index].emplace_back(index, final_sample != 0);
+
+		next_index[sig_index] = index + block_length;
+		last = (last & ~bit) | final_sample;
+
+		if (next_index[sig_index] + block_length > end)
+			active &= ~bit;
+	};
+
+	// Store the initial state
+	for (uint64_t m = sig_mask; m; m &= m - 1) {
+		const unsigned int sig_index = __builtin_ctzll(m);
+		edges[sig_index].emplace_back(start, (last >> sig_index) & 1);
+		next_index[sig_index] = start + 1;
+		if (start + 1 + block_length > end)
+			active &= ~(UINT64_C(1) << sig_index);
+	}
+
+	if (min_length < MipMapScaleFactor) {
+		// Find the samples in which any of the signals change
+		uint64_t index = start + 1;
+		while (active && (index < end)) {
+			const uint64_t prev = get_window_sample(window, index - 1);
+
+			// Only search the first changing block sample by sample, the
+			// mip-map is consulted again after it
+			index = find_changed_block(0, index, active);
+			const uint64_t block_end = min(end,
+				pow2_ceil(index + 1, MipMapScalePower));
+
+			index = find_masked_change(window, index, block_end, prev, active);
+			if (index >= block_end)
+				continue;
+
+			// Changes within the quantization block of a signal's last
+			// edge are skipped
+			const uint64_t changed =
+				(get_window_sample(window, index) ^ prev) & active;
+			for (uint64_t m = changed; m; m &= m - 1) {
+				const unsigned int sig_index = __builtin_ctzll(m);
+				if (next_index[sig_index] <= index)
+					store_edge(sig_index, index);
+			}
+
+			index++;
+		}
+	} else {
+		const int level_scale_power = (min_level + 1) * MipMapScalePower;
+
+		// Moves a signal to the beginning of the next block at the
+		// minimum level, storing an edge right away if the signal
+		// changed since its last edge
+		const auto align_signal = [&](unsigned int sig_index) {
+			const uint64_t bit = UINT64_C(1) << sig_index;
+			while (active & bit) {
+				const uint64_t index = pow2_ceil(next_index[sig_index],
+					level_scale_power);
+				if (index >= end) {
+					active &= ~bit;
+					return;
+				}
+
+				if (!((get_window_sample(window, index) ^ last) & bit)) {
+					block_index[sig_index] = index;
+					return;
+				}
+
+				store_edge(sig_index, index);
+			}
+		};
+
+		for (uint64_t m = active; m; m &= m - 1)
+			align_signal(__builtin_ctzll(m));
+
+		// Find the blocks in which any of the signals change. The blocks
+		// before the search position don't change for the signals that
+		// are still searched.
+		uint64_t search_index = 0;
+		while (active) {
+			uint64_t index = UINT64_MAX;
+			for (uint64_t m = active; m; m &= m - 1)
+				index = min(index, block_index[__builtin_ctzll(m)]);
+
+			index = find_changed_block(min_level,
+				max(index, search_index), active);
+
+			const uint64_t offset = index >> level_scale_power;
+			const uint64_t changed = (offset >= mip_map_[min_level].length) ?
+				active : (get_subsample(min_level, offset) & active);
+
+			for (uint64_t m = changed; m; m &= m - 1) {
+				const unsigned int sig_index = __builtin_ctzll(m);
+				if (block_index[sig_index] <= index) {
+					store_edge(sig_index, index);
+					align_signal(sig_index);
+				}
+			}
+
+			search_index = index + (UINT64_C(1) << level_scale_power);
+		}
+	}
+
+	// Add the final states
+	const uint64_t end_sample = get_window_sample(window, end);
+	for (uint64_t m = sig_mask; m; m &= m - 1) {
+		const unsigned int sig_index = __builtin_ctzll(m);
+		const bool level = (end_sample >> sig_index) & 1;
+		if (((last >> sig_index) & 1) != level)
+			edges[sig_index].emplace_back(end, level);
+		edges[sig_index].emplace_back(end + 1, level);
+	}
+}
 
-	// Get first edge to the right of origin_sample
-	get_subsampled_edges(*edges, origin_sample, sample_count_, min_length, sig_index, true);
+void LogicSegment::get_surrounding_edges(vector<EdgePair> &dest,
+	uint64_t origin_sample, int sig_index)
+{
+	assert(sig_index >= 0);
+	assert(sig_index < (int)unit_size_ * 8);
 
-	// "first only" is specified, so nothing needs to be dismissed
-	if (edges->size() == 0) {
-		delete edges;
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	if (origin_sample >= get_sample_count())
 		return;
+
+	const uint64_t sig_mask = 1ULL << sig_index;
+	uint64_t edge;
+
+	if (find_previous_edge(sig_index, origin_sample, edge))
+		dest.emplace_back(edge, get_unpacked_sample(edge) & sig_mask);
+
+	if (find_next_edge(sig_index, origin_sample, edge))
+		dest.emplace_back(edge, get_unpacked_sample(edge) & sig_mask);
+}
+
+bool LogicSegment::find_previous_edge(int sig_index, uint64_t origin_sample,
+	uint64_t &edge)
+{
+	assert(sig_index >= 0);
+	assert(sig_index < (int)unit_size_ * 8);
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	const uint64_t sample_count = get_sample_count();
+	if (sample_count == 0)
+		return false;
+
+	origin_sample = min(origin_sample, sample_count - 1);
+	update_mipmap(origin_sample + 1);
+
+	const uint64_t sig_mask = 1ULL << sig_index;
+	const uint64_t block_mask = MipMapScaleFactor - 1;
+
+	// Search the samples of the first level block holding the origin,
+	// along with those before it that aren't summarized yet
+	uint64_t offset = min(origin_sample >> MipMapScalePower,
+		mip_map_[0].length);
+	edge = find_edge_in_range(sig_mask, offset << MipMapScalePower,
+		origin_sample + 1, true);
+	if (edge <= origin_sample)
+		return true;
+
+	// Slide left and zoom out at the beginnings of mip-map blocks until
+	// we encounter a change. The blocks before the origin are complete.
+	unsigned int level = 0;
+	while (true) {
+		const bool top_level = (level + 1 >= ScaleStepCount) ||
+			(mip_map_[level + 1].length == 0);
+		const uint64_t first = top_level ? 0 : (offset & ~block_mask);
+
+		while ((offset > first) &&
+			!block_may_change(level, offset - 1, sig_mask))
+			offset--;
+
+		if (offset > first) {
+			offset--;
+			break;
+		}
+
+		if (top_level)
+			return false;
+
+		offset >>= MipMapScalePower;
+		level++;
+	}
+
+	// Zoom in, and slide left until we encounter a change, and repeat
+	// until we reach the first level
+	while (level > 0) {
+		level--;
+		offset = (offset << MipMapScalePower) + block_mask;
+		while (!block_may_change(level, offset, sig_mask)) {
+			assert(offset & block_mask);
+			offset--;
+		}
+	}
+
+	// The first level block may only hold a change of the first sample,
+	// which has no predecessor to be an edge against
+	const uint64_t start = offset << MipMapScalePower;
+	edge = find_edge_in_range(sig_mask, start, start + MipMapScaleFactor, true);
+	return edge < start + MipMapScaleFactor;
+}
+
+bool LogicSegment::find_next_edge(int sig_index, uint64_t origin_sample,
+	uint64_t &edge)
+{
+	assert(sig_index >= 0);
+	assert(sig_index < (int)unit_size_ * 8);
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	const uint64_t sample_count = get_sample_count();
+	if (origin_sample >= sample_count)
+		return false;
+
+	update_mipmap(sample_count);
+
+	const uint64_t sig_mask = 1ULL << sig_index;
+	const uint64_t block_mask = MipMapScaleFactor - 1;
+
+	// Search the samples of the first level block holding the origin
+	uint64_t offset = (origin_sample >> MipMapScalePower) + 1;
+	const uint64_t block_end = min(offset << MipMapScalePower, sample_count);
+	edge = find_edge_in_range(sig_mask, origin_sample + 1, block_end, false);
+	if (edge < block_end)
+		return true;
+
+	// Slide right and zoom out at the beginnings of mip-map blocks until
+	// we encounter a change, or a block that isn't summarized yet
+	unsigned int level = 0;
+	while (true) {
+		const bool top_level = (level + 1 >= ScaleStepCount);
+		const uint64_t end = top_level ? UINT64_MAX :
+			((offset | block_mask) + 1);
+		const int level_scale_power = (level + 1) * MipMapScalePower;
+
+		while ((offset < end) &&
+			((offset << level_scale_power) < sample_count) &&
+			!block_may_change(level, offset, sig_mask))
+			offset++;
+
+		if ((offset << level_scale_power) >= sample_count)
+			return false;
+
+		if (offset < end)
+			break;
+
+		offset >>= MipMapScalePower;
+		level++;
 	}
 
-	dest.push_back(edges->front());
+	// Zoom in, and slide right until we encounter a change, and repeat
+	// until we reach the first level
+	while (level > 0) {
+		level--;
+		offset <<= MipMapScalePower;
+		while (!block_may_change(level, offset, sig_mask)) {
+			offset++;
+			assert(offset & block_mask);
+		}
+	}
 
-	delete edges;
+	// Blocks that aren't summarized yet are only found after the last
+	// summarized one, so the samples from there on are searched one by one
+	const uint64_t start = offset << MipMapScalePower;
+	const uint64_t end = (offset < mip_map_[0].length) ?
+		(start + MipMapScaleFactor) : sample_count;
+	edge = find_edge_in_range(sig_mask, start, end, false);
+	return edge < end;
+}
+
+uint64_t LogicSegment::get_edge_count(int sig_index, uint64_t start,
+	uint64_t end)
+{
+	assert(sig_index >= 0);
+	assert(sig_index < (int)unit_size_ * 8);
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	end = min(end, get_sample_count());
+	if (start >= end)
+		return 0;
+
+	return count_bits_before(false, sig_index, end) -
+		count_bits_before(false, sig_index, start);
+}
+
+uint64_t LogicSegment::get_high_sample_count(int sig_index, uint64_t start,
+	uint64_t end)
+{
+	assert(sig_index >= 0);
+	assert(sig_index < (int)unit_size_ * 8);
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	end = min(end, get_sample_count());
+	if (start >= end)
+		return 0;
+
+	return count_bits_before(true, sig_index, end) -
+		count_bits_before(true, sig_index, start);
+}
+
+bool LogicSegment::find_nth_edge(int sig_index, uint64_t n, uint64_t &edge)
+{
+	assert(sig_index >= 0);
+	assert(sig_index < (int)unit_size_ * 8);
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	update_block_index(edge_index_, false, get_sample_count());
+
+	const uint64_t signal_count = unit_size_ * 8;
+	const uint64_t end_block =
+		index_first_block_ + edge_index_.size() / signal_count;
+
+	// Find the block holding the edge, which is the last one with no more
+	// than n edges before it. The samples after the last complete block
+	// are treated as one more block.
+	uint64_t block = index_first_block_, last = end_block;
+	while (block < last) {
+		const uint64_t mid = block + (last - block + 1) / 2;
+		if (indexed_count(edge_index_, sig_index, mid) <= n)
+			block = mid;
+		else
+			last = mid - 1;
+	}
+
+	n -= indexed_count(edge_index_, sig_index, block);
+
+	const uint64_t start = max(edge_index_block_start(block), (uint64_t)1);
+	const uint64_t end = (block < end_block) ?
+		edge_index_block_start(block + 1) : get_sample_count();
+	if (start >= end)
+		return false;
+
+	vector<uint64_t> edge_bits;
+	get_edge_bits(sig_index, start, end, edge_bits);
+
+	for (uint64_t i = 0; i < edge_bits.size(); i++) {
+		uint64_t word = edge_bits[i];
+		const uint64_t word_count = __builtin_popcountll(word);
+
+		if (n < word_count) {
+			// Clear the lower edges
+			for (; n > 0; n--)
+				word &= word - 1;
+			edge = start + i * 64 + __builtin_ctzll(word);
+			return true;
+		}
+
+		n -= word_count;
+	}
+
+	return false;
 }
 
 void LogicSegment::reallocate_mipmap_level(MipMapLevel &m)
@@ -580,6 +1321,10 @@ void LogicSegment::reallocate_mipmap_level(MipMapLevel &m)
 		MipMapDataUnit) * MipMapDataUnit;
 
 	if (new_data_length > m.data_length) {
+		memory_account_.add(MemoryAccount::SummaryData,
+			(new_data_length - m.data_length) * unit_size_ +
+			(m.data ? 0 : sizeof(uint64_t)));
+
 		m.data_length = new_data_length;
 
 		// Padding is added to allow for the uint64_t write word
@@ -588,25 +1333,34 @@ void LogicSegment::reallocate_mipmap_level(MipMapLevel &m)
 	}
 }
 
-void LogicSegment::append_payload_to_mipmap()
+void LogicSegment::update_mipmap(uint64_t end)
 {
 	MipMapLevel &m0 = mip_map_[0];
 	uint64_t prev_length;
 	uint8_t *dest_ptr;
 	SegmentDataIterator* it;
-	uint64_t accumulator;
-	unsigned int diff_counter;
 
-	// Expand the data buffer to fit the new samples
+	// Expand the data buffer to fit the blocks up to the end sample
 	prev_length = m0.length;
-	m0.length = sample_count_ / MipMapScaleFactor;
+	const uint64_t length = min(end, get_sample_count()) / MipMapScaleFactor;
 
-	// Break off if there are no new samples to compute
-	if (m0.length == prev_length)
+	// Only build the higher levels if the first one is far enough
+	if (length <= prev_length) {
+		append_payload_to_higher_mipmap_levels();
+		update_deferred_summary_size();
 		return;
+	}
 
+	m0.length = length;
 	reallocate_mipmap_level(m0);
 
+	if (parallel_mipmap_) {
+		downsample_parallel(prev_length, m0.length);
+		append_payload_to_higher_mipmap_levels();
+		update_deferred_summary_size();
+		return;
+	}
+
 	dest_ptr = (uint8_t*)m0.data + prev_length * unit_size_;
 
 	// Iterate through the samples to populate the first level mipmap
@@ -621,22 +1375,96 @@ void LogicSegment::append_payload_to_mipmap()
 		count = std::min(count, len_sample);
 		uint8_t *src_ptr = get_iterator_value(it);
 		// Submit these contiguous samples to downsampling in bulk
-		if (unit_size_ == 1)
-			downsampleT<uint8_t>(src_ptr, dest_ptr, count);
-		else if (unit_size_ == 2)
-			downsampleT<uint16_t>(src_ptr, dest_ptr, count);
-		else if (unit_size_ == 4)
-			downsampleT<uint32_t>(src_ptr, dest_ptr, count);
-		else if (unit_size_ == 8)
-			downsampleT<uint8_t>(src_ptr, dest_ptr, count);
-		else
-			downsampleGeneric(src_ptr, dest_ptr, count);
+		downsample(src_ptr, dest_ptr, count);
 		len_sample -= count;
 		// Advance iterator, should move to start of next chunk
 		continue_sample_iteration(it, count);
 	}
 	end_sample_iteration(it);
 
+	append_payload_to_higher_mipmap_levels();
+	update_deferred_summary_size();
+}
+
+void LogicSegment::downsample_parallel(uint64_t start_block,
+	uint64_t end_block)
+{
+	// Blocks are only ever summarized as a whole here
+	assert(last_append_extra_ == 0);
+
+	const uint64_t block_count = end_block - start_block;
+
+	// Handing few blocks to other threads takes longer than summarizing them
+	const unsigned int thread_count = (block_count < MinParallelMipMapBlocks) ?
+		1 : max(thread::hardware_concurrency(), 1u);
+	const uint64_t piece_length = (block_count + thread_count - 1) / thread_count;
+
+	// The chunks are pinned until the threads are done with them
+	vector<SegmentSpan> spans;
+	get_sample_spans(start_block * MipMapScaleFactor,
+		block_count * MipMapScaleFactor, spans);
+
+	// The threads may still hold the job after we're done with it
+	const shared_ptr<MipMapJob> job = make_shared<MipMapJob>();
+	job->unit_size = unit_size_;
+	job->next_piece = 0;
+	job->done_count = 0;
+
+	// Cut the chunks into pieces of about equal length. Each piece is
+	// summarized from the last sample of the one before it, and the
+	// first from the sample preceding the new blocks.
+	uint8_t first_prev_sample[sizeof(uint64_t)];
+	pack_sample(first_prev_sample, last_append_sample_);
+
+	const uint8_t* prev_sample = first_prev_sample;
+	uint8_t* out = (uint8_t*)mip_map_[0].data + start_block * unit_size_;
+
+	for (const SegmentSpan &span : spans) {
+		// The chunks are aligned to the first level blocks
+		assert((span.sample_count % MipMapScaleFactor) == 0);
+
+		const uint8_t* in = span.data;
+		uint64_t remaining = span.sample_count / MipMapScaleFactor;
+		while (remaining > 0) {
+			const uint64_t count = min(remaining, piece_length);
+			job->pieces.push_back(MipMapJob::Piece{in, prev_sample, out, count});
+
+			in += count * MipMapScaleFactor * unit_size_;
+			out += count * unit_size_;
+			prev_sample = in - unit_size_;
+			remaining -= count;
+		}
+	}
+
+	last_append_sample_ = unpack_sample(prev_sample);
+	last_append_accumulator_ = 0;
+
+	// Ask the mip-map threads for help, starting more if needed
+	const unsigned int helper_count =
+		min((size_t)thread_count, job->pieces.size()) - 1;
+	if (helper_count > 0) {
+		lock_guard<mutex> lock(mipmap_mutex_);
+
+		for (unsigned int i = 0; i < helper_count; i++)
+			mipmap_queue_.push_back(job);
+
+		for (; mipmap_thread_count_ < helper_count; mipmap_thread_count_++)
+			thread(&LogicSegment::mipmap_thread_proc).detach();
+
+		mipmap_cond_.notify_all();
+	}
+
+	// This thread takes pieces as well
+	job->run();
+
+	unique_lock<mutex> lock(job->done_mutex);
+	job->done_cond.wait(lock, [&] { return job->done_count == job->pieces.size(); });
+}
+
+void LogicSegment::append_payload_to_higher_mipmap_levels()
+{
+	uint64_t prev_length;
+
 	// Compute higher level mipmaps
 	for (unsigned int level = 1; level < ScaleStepCount; level++) {
 		MipMapLevel &m = mip_map_[level];
@@ -655,28 +1483,46 @@ void LogicSegment::append_payload_to_mipmap()
 		// Subsample the lower level
 		const uint8_t* src_ptr = (uint8_t*)ml.data +
 			unit_size_ * prev_length * MipMapScaleFactor;
-		const uint8_t *const end_dest_ptr =
-			(uint8_t*)m.data + unit_size_ * m.length;
-
-		for (dest_ptr = (uint8_t*)m.data +
-				unit_size_ * prev_length;
-				dest_ptr < end_dest_ptr;
-				dest_ptr += unit_size_) {
-			accumulator = 0;
-			diff_counter = MipMapScaleFactor;
-			while (diff_counter-- > 0) {
-				accumulator |= unpack_sample(src_ptr);
-				src_ptr += unit_size_;
-			}
+		uint8_t* dest_ptr = (uint8_t*)m.data + unit_size_ * prev_length;
 
-			pack_sample(dest_ptr, accumulator);
-		}
+		MipMapKernels::or_reduce(src_ptr, dest_ptr, m.length - prev_length,
+			unit_size_);
 	}
 }
 
+uint64_t LogicSegment::evict_old_samples()
+{
+	const uint64_t evicted = evict_old_chunks();
+	if (!evicted)
+		return 0;
+
+	// The evicted samples fill entire first level blocks, so the first
+	// level only loses its oldest blocks. The block boundaries of the
+	// higher levels move, so they are rebuilt from the first level when
+	// they're needed again.
+	MipMapLevel &m0 = mip_map_[0];
+	const uint64_t dropped = min(evicted / MipMapScaleFactor, m0.length);
+
+	if (dropped > 0)
+		memmove(m0.data, (uint8_t*)m0.data + dropped * unit_size_,
+			(m0.length - dropped) * unit_size_);
+	m0.length -= dropped;
+
+	for (unsigned int level = 1; level < ScaleStepCount; level++)
+		mip_map_[level].length = 0;
+
+	// The bit planes would have to be shifted bit by bit, so they're
+	// rebuilt when they're used the next time instead
+	clear_bit_planes();
+
+	trim_block_indexes();
+
+	return evicted;
+}
+
 uint64_t LogicSegment::get_unpacked_sample(uint64_t index) const
 {
-	assert(index < sample_count_);
+	assert(index < get_sample_count());
 
 	assert(unit_size_ <= 8);  // 8 * 8 = 64 channels
 	uint8_t data[8];
@@ -686,6 +1532,290 @@ uint64_t LogicSegment::get_unpacked_sample(uint64_t index) const
 	return unpack_sample(data);
 }
 
+void LogicSegment::move_sample_window(SampleWindow &window,
+	uint64_t index) const
+{
+	if ((index >= window.start) && (index < window.end))
+		return;
+
+	const uint64_t end = get_sample_count();
+	assert(index < end);
+
+	// Only pin a part of the chunk, the samples are usually read close
+	// to each other
+	vector<SegmentSpan> spans;
+	get_sample_spans(index, min(end - index, ScanWindowLength), spans);
+
+	window.start = index;
+	window.end = index + spans.front().sample_count;
+	window.span = spans.front();
+}
+
+bool LogicSegment::get_sample_bit(const BitPlane* plane, SampleWindow &window,
+	uint64_t index, uint64_t sig_mask) const
+{
+	if (plane && (index < plane->length))
+		return (plane->words[index / 64] >> (index % 64)) & 1;
+
+	return (get_window_sample(window, index) & sig_mask) != 0;
+}
+
+uint64_t LogicSegment::get_window_sample(SampleWindow &window,
+	uint64_t index) const
+{
+	move_sample_window(window, index);
+
+	return unpack_sample(window.span.data +
+		(index - window.start) * unit_size_);
+}
+
+void LogicSegment::extract_channel_bits(int sig_index, uint64_t start,
+	uint64_t count, uint64_t* dest, uint64_t dest_offs)
+{
+	const unsigned int byte_offs = sig_index / 8, shift = sig_index % 8;
+
+	uint64_t pos = dest_offs;
+	uint64_t word = dest[pos / 64];
+
+	vector<SegmentSpan> spans;
+	get_sample_spans(start, count, spans);
+
+	for (const SegmentSpan &span : spans) {
+		const uint8_t* src = span.data + byte_offs;
+
+		for (uint64_t i = 0; i < span.sample_count; i++, src += unit_size_) {
+			word |= (uint64_t)((*src >> shift) & 1) << (pos % 64);
+
+			if ((++pos % 64) == 0) {
+				dest[pos / 64 - 1] = word;
+				word = 0;
+			}
+		}
+	}
+
+	if (pos % 64)
+		dest[pos / 64] = word;
+}
+
+const LogicSegment::BitPlane& LogicSegment::update_bit_plane(int sig_index)
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	BitPlane &plane = bit_planes_.at(sig_index);
+	const uint64_t sample_count = get_sample_count();
+
+	if (plane.length < sample_count) {
+		const uint64_t prev_capacity = plane.words.capacity();
+
+		plane.words.resize((sample_count + 63) / 64, 0);
+		extract_channel_bits(sig_index, plane.length,
+			sample_count - plane.length, plane.words.data(), plane.length);
+		plane.length = sample_count;
+
+		memory_account_.add(MemoryAccount::BitPlaneData,
+			(plane.words.capacity() - prev_capacity) * sizeof(uint64_t));
+	}
+
+	return plane;
+}
+
+void LogicSegment::clear_bit_planes()
+{
+	for (BitPlane &plane : bit_planes_) {
+		memory_account_.add(MemoryAccount::BitPlaneData,
+			-(int64_t)(plane.words.capacity() * sizeof(uint64_t)));
+
+		plane.length = 0;
+		vector<uint64_t>().swap(plane.words);
+	}
+}
+
+uint64_t LogicSegment::find_bit_change(const BitPlane &plane, uint64_t start,
+	uint64_t end, bool value)
+{
+	// Invert the words so that a change shows up as set bit
+	const uint64_t invert = value ? ~UINT64_C(0) : 0;
+
+	uint64_t index = start;
+	while (index < end) {
+		const uint64_t word = (plane.words[index / 64] ^ invert) >> (index % 64);
+		if (word)
+			return min(index + __builtin_ctzll(word), end);
+
+		index = (index / 64 + 1) * 64;
+	}
+
+	return end;
+}
+
+uint64_t LogicSegment::find_changed_block(unsigned int min_level,
+	uint64_t index, uint64_t sig_mask) const
+{
+	unsigned int level = min_level;
+
+	assert(mip_map_[level].data);
+
+	// Slide right and zoom out at the beginnings of mip-map
+	// blocks until we encounter a change
+	while (true) {
+		const int level_scale_power = (level + 1) * MipMapScalePower;
+		const uint64_t offset = index >> level_scale_power;
+
+		// Check if we reached the last block at this
+		// level, or if there was a change in this block
+		if (offset >= mip_map_[level].length ||
+			(get_subsample(level, offset) &	sig_mask))
+			break;
+
+		if ((offset & ~((uint64_t)(~0) << MipMapScalePower)) == 0) {
+			// If we are now at the beginning of a
+			// higher level mip-map block ascend one
+			// level
+			if ((level + 1 >= ScaleStepCount) || (!mip_map_[level + 1].data))
+				break;
+
+			level++;
+		} else {
+			// Slide right to the beginning of the
+			// next mip map block
+			index = pow2_ceil(index + 1, level_scale_power);
+		}
+	}
+
+	// Zoom in, and slide right until we encounter a change,
+	// and repeat until we reach min_level
+	while (true) {
+		assert(mip_map_[level].data);
+
+		const int level_scale_power = (level + 1) * MipMapScalePower;
+		const uint64_t offset = index >> level_scale_power;
+
+		// Check if we reached the last block at this
+		// level, or if there was a change in this block
+		if (offset >= mip_map_[level].length ||
+				(get_subsample(level, offset) & sig_mask)) {
+			// Zoom in unless we reached the minimum
+			// zoom
+			if (level == min_level)
+				break;
+
+			level--;
+		} else {
+			// Slide right to the beginning of the
+			// next mip map block
+			index = pow2_ceil(index + 1, level_scale_power);
+		}
+	}
+
+	return index;
+}
+
+uint64_t LogicSegment::find_sample_change(const BitPlane* plane,
+	SampleWindow &window, uint64_t sig_mask, uint64_t start, uint64_t end,
+	bool value) const
+{
+	if (plane)
+		return find_bit_change(*plane, start, end, value);
+
+	return find_masked_change(window, start, end, value ? sig_mask : 0,
+		sig_mask);
+}
+
+uint64_t LogicSegment::find_masked_change(SampleWindow &window,
+	uint64_t start, uint64_t end, uint64_t value, uint64_t sig_mask) const
+{
+	while (start < end) {
+		move_sample_window(window, start);
+
+		const uint64_t count = min(end, window.end) - start;
+		const uint64_t i = sample_kernels_->find_change(window.span.data +
+			(start - window.start) * unit_size_, count, value, sig_mask);
+		if (i < count)
+			return start + i;
+
+		start += count;
+	}
+
+	return end;
+}
+
+bool LogicSegment::block_may_change(unsigned int level, uint64_t offset,
+	uint64_t sig_mask) const
+{
+	return (offset >= mip_map_[level].length) ||
+		(get_subsample(level, offset) & sig_mask);
+}
+
+uint64_t LogicSegment::find_edge_in_range(uint64_t sig_mask, uint64_t start,
+	uint64_t end, bool backward) const
+{
+	start = max(start, (uint64_t)1);
+	if (start >= end)
+		return end;
+
+	assert(end <= get_sample_count());
+
+	// Read the samples along with the predecessor of the first one
+	vector<SegmentSpan> spans;
+	get_sample_spans(start - 1, end - start + 1, spans);
+
+	if (!backward) {
+		uint64_t index = start - 1;
+		uint64_t prev = unpack_sample(spans.front().data);
+
+		for (const SegmentSpan &span : spans) {
+			const uint64_t i = sample_kernels_->find_change(span.data,
+				span.sample_count, prev, sig_mask);
+			if (i < span.sample_count)
+				return index + i;
+
+			index += span.sample_count;
+			prev = unpack_sample(span.data +
+				(span.sample_count - 1) * unit_size_);
+		}
+	} else {
+		uint64_t index = end;
+		uint64_t next = unpack_sample(spans.back().data +
+			(spans.back().sample_count - 1) * unit_size_);
+
+		for (auto span = spans.rbegin(); span != spans.rend(); span++) {
+			index -= span->sample_count;
+
+			const uint64_t i = sample_kernels_->find_last_change(span->data,
+				span->sample_count, next, sig_mask);
+			if (i < span->sample_count)
+				return index + i + 1;
+
+			next = unpack_sample(span->data);
+		}
+	}
+
+	return end;
+}
+
+void LogicSegment::update_deferred_summary_size()
+{
+	const uint64_t sample_count = get_sample_count();
+	uint64_t deferred = 0;
+
+	// Count the blocks that would be built if the levels were complete
+	uint64_t length = sample_count;
+	for (const MipMapLevel &m : mip_map_) {
+		length /= MipMapScaleFactor;
+		deferred += (length - min(m.length, length)) * unit_size_;
+	}
+
+	const uint64_t signal_count = unit_size_ * 8;
+	const uint64_t end_block = (sample_count + evicted_sample_count()) /
+		EdgeIndexBlockLength;
+	const uint64_t indexed_blocks = edge_index_.size() / signal_count;
+	const uint64_t block_count = end_block - min(index_first_block_, end_block);
+	deferred += (block_count - min(indexed_blocks, block_count)) *
+		signal_count * sizeof(uint64_t);
+
+	memory_account_.set_deferred(MemoryAccount::SummaryData, deferred);
+}
+
 uint64_t LogicSegment::get_subsample(int level, uint64_t offset) const
 {
 	assert(level >= 0);
@@ -700,5 +1830,26 @@ uint64_t LogicSegment::pow2_ceil(uint64_t x, unsigned int power)
 	return (x + p - 1) / p * p;
 }
 
+void LogicSegment::mipmap_thread_proc()
+{
+	unique_lock<mutex> lock(mipmap_mutex_);
+
+	while (true) {
+		if (mipmap_queue_.empty() &&
+			!mipmap_cond_.wait_for(lock, milliseconds(MipMapThreadIdleTime),
+				[] { return !mipmap_queue_.empty(); }))
+			break;
+
+		const shared_ptr<MipMapJob> job = mipmap_queue_.front();
+		mipmap_queue_.pop_front();
+
+		lock.unlock();
+		job->run();
+		lock.lock();
+	}
+
+	mipmap_thread_count_--;
+}
+
 } // namespace data
 } // namespace pv
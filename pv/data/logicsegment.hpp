@@ -60,8 +60,19 @@ public:
 	static const int MipMapScaleFactor;
 	static const float LogMipMapScaleFactor;
 	static const uint64_t MipMapDataUnit;
+	static const uint64_t EdgeIndexBlockLength;
+	static const uint64_t ScanWindowLength;
 
 private:
+	struct SampleKernels;
+	struct MipMapJob;
+
+	/// Minimum number of first level blocks worth summarizing in parallel
+	static const uint64_t MinParallelMipMapBlocks;
+
+	/// Time after which idle mip-map threads exit, in milliseconds
+	static const int MipMapThreadIdleTime;
+
 	struct MipMapLevel
 	{
 		uint64_t length;
@@ -69,17 +80,83 @@ private:
 		void *data;
 	};
 
+	/// The samples of a single channel, sample i being bit i % 64 of
+	/// word i / 64
+	struct BitPlane
+	{
+		uint64_t length;
+		vector<uint64_t> words;
+	};
+
+	/// Samples [start, end) of a chunk, pinned while they're read in place
+	struct SampleWindow
+	{
+		uint64_t start;
+		uint64_t end;
+		SegmentSpan span;
+	};
+
 public:
 	LogicSegment(pv::data::Logic& owner, uint32_t segment_id,
 		unsigned int unit_size, uint64_t samplerate);
 
 	virtual ~LogicSegment();
 
+	/**
+	 * Selects whether logic segments created from now on compress their
+	 * chunks once they're filled.
+	 */
+	static void set_compression_enabled(bool enabled);
+
+	/**
+	 * Selects whether logic segments created from now on keep a bit-planar
+	 * copy of every channel that is searched for edges or extracted using
+	 * get_channel_bits(). The copy of a channel is built when it is first
+	 * used and extended as samples are added.
+	 */
+	static void set_bit_planes_enabled(bool enabled);
+
+	/**
+	 * Selects whether the mip-map is built on several threads. It's built
+	 * when it's first needed, so the samples of a whole file are usually
+	 * summarized at once.
+	 */
+	void set_parallel_mipmap(bool enabled);
+
 	void append_payload(shared_ptr<sigrok::Logic> logic);
 	void append_payload(void *data, uint64_t data_size);
 
+	/**
+	 * Returns a buffer that the given number of samples can be written to
+	 * directly, saving the copy made by append_payload(). The samples are
+	 * then appended using commit_payload_buffer().
+	 * @return The buffer or nullptr if the current chunk can't hold that
+	 *         many samples, in which case append_payload() must be used.
+	 */
+	uint8_t* get_payload_buffer(uint64_t sample_count);
+	void commit_payload_buffer(uint64_t sample_count);
+
 	void get_samples(int64_t start_sample, int64_t end_sample, uint8_t* dest) const;
 
+	/**
+	 * Extracts the samples of a single channel as bitstream.
+	 * @param sig_index The index of the signal.
+	 * @param start The first sample to extract.
+	 * @param count The number of samples to extract.
+	 * @param[out] dest Receives sample start + i in bit i % 64 of
+	 *        dest[i / 64]. Unused bits of the last word are cleared.
+	 */
+	void get_channel_bits(int sig_index, uint64_t start, uint64_t count,
+		uint64_t* dest);
+
+	/**
+	 * Like get_channel_bits(), but addresses the samples by number, see
+	 * Segment::first_sample_number().
+	 * @return false if some of the samples were evicted already.
+	 */
+	bool get_channel_bits_by_number(int sig_index, uint64_t number,
+		uint64_t count, uint64_t* dest);
+
 	/**
 	 * Parses a logic data segment to generate a list of transitions
 	 * in a time interval to a given level of detail.
@@ -94,8 +171,57 @@ public:
 		uint64_t start, uint64_t end,
 		float min_length, int sig_index, bool first_change_only = false);
 
+	/**
+	 * Finds the edges of several signals in a single pass over the data,
+	 * as get_subsampled_edges() does for each signal on its own.
+	 * @param[out] edges Receives the edges of signal i in edges[i]. The
+	 * lists of the signals that aren't selected are left empty.
+	 * @param[in] sig_mask The signals to search, bit i selecting signal i.
+	 */
+	void get_subsampled_edges(vector< vector<EdgePair> > &edges,
+		uint64_t start, uint64_t end, float min_length, uint64_t sig_mask);
+
+	/**
+	 * Finds the edges of a signal closest to a sample.
+	 * @param[out] dest Receives the last edge at or before origin_sample
+	 *        and the first edge after it, as far as they exist.
+	 */
 	void get_surrounding_edges(vector<EdgePair> &dest,
-		uint64_t origin_sample, float min_length, int sig_index);
+		uint64_t origin_sample, int sig_index);
+
+	/**
+	 * Finds the last edge of a signal at or before a sample, zooming out
+	 * and in through the mip-map from there towards the first sample.
+	 * @return false if there is no edge before the sample.
+	 */
+	bool find_previous_edge(int sig_index, uint64_t origin_sample,
+		uint64_t &edge);
+
+	/**
+	 * Finds the first edge of a signal after a sample.
+	 * @return false if there is no edge after the sample.
+	 */
+	bool find_next_edge(int sig_index, uint64_t origin_sample,
+		uint64_t &edge);
+
+	/**
+	 * Returns the number of edges of a signal in the samples [start, end).
+	 * There is an edge at sample i if it differs from sample i - 1.
+	 */
+	uint64_t get_edge_count(int sig_index, uint64_t start, uint64_t end);
+
+	/**
+	 * Returns the number of samples in [start, end) in which a signal is
+	 * high, e.g. to measure its duty cycle.
+	 */
+	uint64_t get_high_sample_count(int sig_index, uint64_t start,
+		uint64_t end);
+
+	/**
+	 * Finds the n-th edge of a signal, counting from 0.
+	 * @return false if the signal doesn't have that many edges.
+	 */
+	bool find_nth_edge(int sig_index, uint64_t n, uint64_t &edge);
 
 private:
 	uint64_t unpack_sample(const uint8_t *ptr) const;
@@ -103,23 +229,196 @@ private:
 
 	void reallocate_mipmap_level(MipMapLevel &m);
 
-	void append_payload_to_mipmap();
+	/**
+	 * Extends the mip-map levels by the blocks that end at or before
+	 * sample end. The levels are only built when they're needed, their
+	 * lengths are the watermarks up to which they're valid.
+	 */
+	void update_mipmap(uint64_t end);
+
+	/**
+	 * Builds the first level mip-map blocks [start_block, end_block) on
+	 * several threads, each of them summarizing a range of chunks. The
+	 * threads are shared by all segments and kept until they're idle for
+	 * MipMapThreadIdleTime.
+	 */
+	void downsample_parallel(uint64_t start_block, uint64_t end_block);
+	void append_payload_to_higher_mipmap_levels();
+
+	/**
+	 * Evicts the oldest samples of rolling captures and trims the
+	 * mip-map accordingly.
+	 * @return The number of samples evicted.
+	 */
+	uint64_t evict_old_samples();
 
 	uint64_t get_unpacked_sample(uint64_t index) const;
 
-	template <class T> void downsampleTmain(const T*&in, T &acc, T &prev);
-	template <class T> void downsampleT(const uint8_t *in, uint8_t *&out, uint64_t len);
-	void downsampleGeneric(const uint8_t *in, uint8_t *&out, uint64_t len);
+	/**
+	 * Makes the window hold sample index, along with some of the samples
+	 * that follow it in the same chunk.
+	 */
+	void move_sample_window(SampleWindow &window, uint64_t index) const;
+
+	/// Reads a sample through the window.
+	uint64_t get_window_sample(SampleWindow &window, uint64_t index) const;
+
+	/**
+	 * Reads a single bit of a sample, using the bit plane of the signal
+	 * if there is one and the window otherwise.
+	 */
+	bool get_sample_bit(const BitPlane* plane, SampleWindow &window,
+		uint64_t index, uint64_t sig_mask) const;
+
+	/**
+	 * ORs count bits of a channel into dest, starting at bit dest_offs.
+	 */
+	void extract_channel_bits(int sig_index, uint64_t start, uint64_t count,
+		uint64_t* dest, uint64_t dest_offs);
+
+	/// Builds or extends the bit plane of a signal up to the sample count.
+	const BitPlane& update_bit_plane(int sig_index);
+	void clear_bit_planes();
+
+	/**
+	 * Returns the index of the first sample in [start, end) whose value
+	 * differs from the given one, or end if there is none.
+	 */
+	static uint64_t find_bit_change(const BitPlane &plane, uint64_t start,
+		uint64_t end, bool value);
+
+	/**
+	 * Searches the mip-map for the first block at min_level, starting with
+	 * the one holding sample index, in which a signal of the mask changes.
+	 * Blocks that aren't summarized yet count as changing.
+	 * @return The first sample of the block, or index if it's in that block.
+	 */
+	uint64_t find_changed_block(unsigned int min_level, uint64_t index,
+		uint64_t sig_mask) const;
+
+	/**
+	 * Returns the index of the first sample in [start, end) in which the
+	 * signal differs from value, or end if there is none. The samples are
+	 * scanned in place through the window, many at once, or in the bit
+	 * plane if there is one.
+	 */
+	uint64_t find_sample_change(const BitPlane* plane, SampleWindow &window,
+		uint64_t sig_mask, uint64_t start, uint64_t end, bool value) const;
+
+	/**
+	 * Returns the index of the first sample in [start, end) that differs
+	 * from value in any of the masked signals, or end if there is none.
+	 */
+	uint64_t find_masked_change(SampleWindow &window, uint64_t start,
+		uint64_t end, uint64_t value, uint64_t sig_mask) const;
+
+	void downsample(const uint8_t *in, uint8_t *&out, uint64_t len);
+
+	/**
+	 * Returns whether a signal may change within a mip-map block, which
+	 * is the case for blocks that aren't summarized yet.
+	 */
+	bool block_may_change(unsigned int level, uint64_t offset,
+		uint64_t sig_mask) const;
+
+	/**
+	 * Searches the samples [start, end) one by one for the first edge of
+	 * a signal, or the last one if backward is set.
+	 * @return The edge or end if there is none.
+	 */
+	uint64_t find_edge_in_range(uint64_t sig_mask, uint64_t start,
+		uint64_t end, bool backward) const;
+
+	/// Returns the first sample of an edge index block that is still held.
+	uint64_t edge_index_block_start(uint64_t block) const;
+
+	/**
+	 * Counts the edges of every signal in an edge index block, leaving out
+	 * the first sample held as its predecessor is unknown. If high is set,
+	 * the samples in which the signals are high are counted instead.
+	 * @param[out] counts Receives one count per signal.
+	 */
+	void count_block_bits(uint64_t block, bool high, uint64_t* counts);
+
+	/// Indexes the blocks that end at or before the end sample.
+	void update_block_index(vector<uint64_t> &index, bool high,
+		uint64_t end_sample);
+
+	/**
+	 * Accounts the mip-map and edge index bytes that haven't been built
+	 * yet as deferred.
+	 */
+	void update_deferred_summary_size();
+
+	/// Drops the blocks of evicted samples from the indexes.
+	void trim_block_indexes();
+
+	/**
+	 * Returns the number of edges of a signal before the given sample, or
+	 * of the samples in which it's high if high is set.
+	 */
+	uint64_t count_bits_before(bool high, int sig_index, uint64_t sample);
+
+	/// Returns the count of an index before one of its blocks.
+	uint64_t indexed_count(const vector<uint64_t> &index, int sig_index,
+		uint64_t block) const;
+
+	/**
+	 * Marks the edges of a signal in [start, end) in a bitstream, as
+	 * get_channel_bits() does for the samples. start must be at least 1.
+	 */
+	void get_edge_bits(int sig_index, uint64_t start, uint64_t end,
+		vector<uint64_t> &dest);
 
 private:
 	uint64_t get_subsample(int level, uint64_t offset) const;
 
 	static uint64_t pow2_ceil(uint64_t x, unsigned int power);
 
+	/// Helps with the queued mip-map jobs until idle for too long
+	static void mipmap_thread_proc();
+
 private:
+	static const SampleKernels SampleKernelTable[8];
+
+	static bool compression_enabled_;
+	static bool bit_planes_enabled_;
+
+	static mutex mipmap_mutex_;
+	static condition_variable mipmap_cond_;
+	/// Holds a job once for every thread asked to help with it
+	static deque< shared_ptr<MipMapJob> > mipmap_queue_;
+	static unsigned int mipmap_thread_count_;
+
 	Logic& owner_;
 
 	struct MipMapLevel mip_map_[ScaleStepCount];
+
+	/// One plane per channel if bit planes are enabled, empty otherwise
+	vector<BitPlane> bit_planes_;
+
+	/**
+	 * Cumulative edge counts of all signals, entry block * signal count +
+	 * sig_index holding the edges up to the end of the block with the
+	 * number index_first_block_ + block. Blocks are aligned to the
+	 * samples received, including the evicted ones, and only complete
+	 * blocks are indexed.
+	 */
+	vector<uint64_t> edge_index_;
+
+	/**
+	 * Cumulative counts of the samples in which the signals are high,
+	 * laid out like the edge index. It's only built if it's used.
+	 */
+	vector<uint64_t> high_index_;
+
+	uint64_t index_first_block_;
+
+	/// The sample loops specialized for the unit size
+	const SampleKernels* sample_kernels_;
+
+	bool parallel_mipmap_;
+
 	uint64_t last_append_sample_;
 	uint64_t last_append_accumulator_;
 	uint64_t last_append_extra_;
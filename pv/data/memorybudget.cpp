@@ -0,0 +1,206 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2026 The PulseView developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>
+
+#include "memorybudget.hpp"
+
+using std::lock_guard;
+
+namespace pv {
+namespace data {
+
+mutex MemoryBudget::mutex_;
+unordered_set<MemoryAccount*> MemoryBudget::accounts_;
+atomic<uint64_t> MemoryBudget::budget_(0);
+atomic<int64_t> MemoryBudget::total_usage_(0);
+
+MemoryAccount::MemoryAccount(const void* owner) :
+	owner_(owner)
+{
+	for (atomic<int64_t> &u : usage_)
+		u = 0;
+	for (atomic<uint64_t> &d : deferred_)
+		d = 0;
+
+	MemoryBudget::register_account(this);
+}
+
+MemoryAccount::MemoryAccount(const MemoryAccount &other) :
+	owner_(other.owner_)
+{
+	for (int c = 0; c < CategoryCount; c++) {
+		usage_[c] = other.usage_[c].load();
+		deferred_[c] = other.deferred_[c].load();
+		MemoryBudget::total_usage_ += usage_[c];
+	}
+
+	MemoryBudget::register_account(this);
+}
+
+MemoryAccount::MemoryAccount(MemoryAccount &&other) :
+	owner_(other.owner_)
+{
+	// The total doesn't change as the usage is only handed over
+	for (int c = 0; c < CategoryCount; c++) {
+		usage_[c] = other.usage_[c].exchange(0);
+		deferred_[c] = other.deferred_[c].exchange(0);
+	}
+
+	MemoryBudget::register_account(this);
+}
+
+MemoryAccount::~MemoryAccount()
+{
+	MemoryBudget::unregister_account(this);
+
+	MemoryBudget::total_usage_ -= (int64_t)total_usage();
+}
+
+const void* MemoryAccount::owner() const
+{
+	return owner_;
+}
+
+void MemoryAccount::set_owner(const void* owner)
+{
+	lock_guard<mutex> lock(MemoryBudget::mutex_);
+	owner_ = owner;
+}
+
+void MemoryAccount::add(Category category, int64_t bytes)
+{
+	assert(category < CategoryCount);
+
+	usage_[category] += bytes;
+	MemoryBudget::total_usage_ += bytes;
+}
+
+void MemoryAccount::set(Category category, uint64_t bytes)
+{
+	assert(category < CategoryCount);
+
+	const int64_t prev = usage_[category].exchange(bytes);
+	MemoryBudget::total_usage_ += (int64_t)bytes - prev;
+}
+
+uint64_t MemoryAccount::usage(Category category) const
+{
+	assert(category < CategoryCount);
+
+	// Concurrent updates may briefly make the usage appear negative
+	const int64_t u = usage_[category];
+	return (u > 0) ? u : 0;
+}
+
+uint64_t MemoryAccount::total_usage() const
+{
+	uint64_t total = 0;
+	for (int c = 0; c < CategoryCount; c++)
+		total += usage((Category)c);
+
+	return total;
+}
+
+void MemoryAccount::set_deferred(Category category, uint64_t bytes)
+{
+	assert(category < CategoryCount);
+
+	deferred_[category] = bytes;
+}
+
+uint64_t MemoryAccount::deferred(Category category) const
+{
+	assert(category < CategoryCount);
+
+	return deferred_[category];
+}
+
+void MemoryBudget::set_budget(uint64_t budget)
+{
+	budget_ = budget;
+}
+
+uint64_t MemoryBudget::budget()
+{
+	return budget_;
+}
+
+uint64_t MemoryBudget::total_usage()
+{
+	const int64_t u = total_usage_;
+	return (u > 0) ? u : 0;
+}
+
+bool MemoryBudget::exceeded()
+{
+	const uint64_t budget = budget_;
+	return (budget > 0) && (total_usage() > budget);
+}
+
+uint64_t MemoryBudget::usage(const void* owner)
+{
+	lock_guard<mutex> lock(mutex_);
+
+	uint64_t total = 0;
+	for (const MemoryAccount* account : accounts_)
+		if (account->owner() == owner)
+			total += account->total_usage();
+
+	return total;
+}
+
+uint64_t MemoryBudget::usage(const void* owner, MemoryAccount::Category category)
+{
+	lock_guard<mutex> lock(mutex_);
+
+	uint64_t total = 0;
+	for (const MemoryAccount* account : accounts_)
+		if (account->owner() == owner)
+			total += account->usage(category);
+
+	return total;
+}
+
+uint64_t MemoryBudget::deferred(const void* owner, MemoryAccount::Category category)
+{
+	lock_guard<mutex> lock(mutex_);
+
+	uint64_t total = 0;
+	for (const MemoryAccount* account : accounts_)
+		if (account->owner() == owner)
+			total += account->deferred(category);
+
+	return total;
+}
+
+void MemoryBudget::register_account(MemoryAccount* account)
+{
+	lock_guard<mutex> lock(mutex_);
+	accounts_.insert(account);
+}
+
+void MemoryBudget::unregister_account(MemoryAccount* account)
+{
+	lock_guard<mutex> lock(mutex_);
+	accounts_.erase(account);
+}
+
+} // namespace data
+} // namespace pv
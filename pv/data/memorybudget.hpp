@@ -0,0 +1,136 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2026 The PulseView developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULSEVIEW_PV_DATA_MEMORYBUDGET_HPP
+#define PULSEVIEW_PV_DATA_MEMORYBUDGET_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_set>
+
+using std::atomic;
+using std::mutex;
+using std::unordered_set;
+
+namespace pv {
+namespace data {
+
+/**
+ * Keeps track of the memory used by one data structure, e.g. a segment.
+ *
+ * Accounts register with the MemoryBudget for as long as they exist. They
+ * are attributed to an owner, usually the signal data object they belong
+ * to, so that the usage can be summed up per signal.
+ */
+class MemoryAccount
+{
+public:
+	enum Category {
+		SampleData,       ///< Uncompressed sample chunks
+		CompressedData,   ///< Compressed sample chunks
+		SummaryData,      ///< Logic mip-maps and analog envelopes
+		BitPlaneData,     ///< Per-channel copies of logic data
+		AnnotationData,   ///< Decoder annotations
+		BinaryData,       ///< Binary decoder output
+		CategoryCount
+	};
+
+public:
+	explicit MemoryAccount(const void* owner = nullptr);
+
+	/// Copies account for the data that was copied along with them.
+	MemoryAccount(const MemoryAccount &other);
+
+	/// Moves the usage to the new account, leaving the other one empty.
+	MemoryAccount(MemoryAccount &&other);
+
+	~MemoryAccount();
+
+	MemoryAccount& operator=(const MemoryAccount &other) = delete;
+
+	const void* owner() const;
+	void set_owner(const void* owner);
+
+	/// Adds the given number of bytes, which may be negative.
+	void add(Category category, int64_t bytes);
+
+	void set(Category category, uint64_t bytes);
+
+	uint64_t usage(Category category) const;
+	uint64_t total_usage() const;
+
+	/**
+	 * Sets the number of bytes of data that is only built once it's
+	 * needed and hasn't been built yet. These bytes don't count as usage.
+	 */
+	void set_deferred(Category category, uint64_t bytes);
+	uint64_t deferred(Category category) const;
+
+private:
+	const void* owner_;
+	atomic<int64_t> usage_[CategoryCount];
+	atomic<uint64_t> deferred_[CategoryCount];
+};
+
+/**
+ * Process-wide accounting of the memory used for sample data and the data
+ * derived from it.
+ *
+ * The budget isn't enforced on allocation. Instead, producers of data check
+ * exceeded() at points where they can stop gracefully, e.g. an acquisition
+ * is stopped early and decoders refuse to start.
+ */
+class MemoryBudget
+{
+public:
+	/// Sets the number of bytes that may be used, 0 means unlimited.
+	static void set_budget(uint64_t budget);
+	static uint64_t budget();
+
+	/// Returns the number of bytes used by all accounts.
+	static uint64_t total_usage();
+
+	static bool exceeded();
+
+	/// Returns the number of bytes used by all accounts of the given owner.
+	static uint64_t usage(const void* owner);
+	static uint64_t usage(const void* owner, MemoryAccount::Category category);
+
+	/// Returns the number of bytes of the given owner that weren't built.
+	static uint64_t deferred(const void* owner, MemoryAccount::Category category);
+
+private:
+	static void register_account(MemoryAccount* account);
+	static void unregister_account(MemoryAccount* account);
+
+private:
+	static mutex mutex_;
+	static unordered_set<MemoryAccount*> accounts_;
+
+	static atomic<uint64_t> budget_;
+	static atomic<int64_t> total_usage_;
+
+	friend class MemoryAccount;
+};
+
+} // namespace data
+} // namespace pv
+
+#endif // PULSEVIEW_PV_DATA_MEMORYBUDGET_HPP
@@ -0,0 +1,564 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2026 The PulseView developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+// The vector kernels are selected at runtime, so they're compiled using
+// function attributes instead of compiler flags
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+#include "mipmapkernels.hpp"
+
+using std::min;
+
+namespace pv {
+namespace data {
+
+MipMapKernels::InstructionSet MipMapKernels::instruction_set_ =
+	MipMapKernels::detect_instruction_set();
+
+namespace {
+
+/// Summarizes block_count blocks of samples, see MipMapKernels
+typedef void (*BlockKernel)(const uint8_t* in, uint8_t* out,
+	uint64_t block_count);
+
+const unsigned int BlockLength = MipMapKernels::BlockLength;
+
+template <unsigned int Size>
+inline uint64_t load_bytes(const uint8_t* ptr)
+{
+	uint64_t value = 0;
+	memcpy(&value, ptr, Size);
+	return value;
+}
+
+/**
+ * Loads Size bytes of samples that are U bytes wide. If Xor is set, the
+ * bits that changed since the respective previous samples are returned.
+ */
+template <unsigned int U, unsigned int Size, bool Xor>
+inline uint64_t load_value(const uint8_t* ptr)
+{
+	const uint64_t value = load_bytes<Size>(ptr);
+	return Xor ? (value ^ load_bytes<Size>(ptr - U)) : value;
+}
+
+/// ORs the 8 / U samples held in a word into the one stored first.
+template <unsigned int U>
+inline uint64_t fold_word(uint64_t word)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (U <= 4)
+		word |= word >> 32;
+	if (U <= 2)
+		word |= word >> 16;
+	if (U <= 1)
+		word |= word >> 8;
+#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	if (U <= 4)
+		word |= word << 32;
+	if (U <= 2)
+		word |= word << 16;
+	if (U <= 1)
+		word |= word << 8;
+#else
+#error Endianness unknown
+#endif
+	return word;
+}
+
+template <unsigned int U, bool Xor>
+void reduce_blocks_scalar(const uint8_t* in, uint8_t* out,
+	uint64_t block_count)
+{
+	for (uint64_t b = 0; b < block_count; b++) {
+		uint64_t acc = 0;
+
+		if ((8 % U) == 0) {
+			// Process whole words of 8 / U samples each
+			for (unsigned int i = 0; i < BlockLength * U; i += 8)
+				acc |= load_value<U, 8, Xor>(in + i);
+			acc = fold_word<U>(acc);
+		} else if (b + 1 < block_count) {
+			// Load whole words, the bytes following the sample don't
+			// make it into the result
+			for (unsigned int i = 0; i < BlockLength * U; i += U)
+				acc |= load_value<U, 8, Xor>(in + i);
+		} else {
+			// Don't read past the end of the last block
+			for (unsigned int i = 0; i < BlockLength * U; i += U)
+				acc |= load_value<U, U, Xor>(in + i);
+		}
+
+		memcpy(out, &acc, U);
+
+		in += BlockLength * U;
+		out += U;
+	}
+}
+
+/// Summarizes block_count blocks of floats, see MipMapKernels
+typedef void (*EnvelopeKernel)(const float* in, float* out,
+	uint64_t block_count);
+
+// Comparisons with NaN are false, so NaNs leave the accumulators as they are.
+// Blocks that only hold NaNs end up with a minimum above their maximum.
+inline void store_min_max(float* out, float min_value, float max_value)
+{
+	if (min_value > max_value)
+		min_value = max_value = NAN;
+	out[0] = min_value;
+	out[1] = max_value;
+}
+
+/**
+ * Takes the minimum and maximum of blocks of samples, or of the minima and
+ * maxima of the blocks of the level below if Pairs is set.
+ */
+template <bool Pairs>
+void min_max_scalar(const float* in, float* out, uint64_t block_count)
+{
+	for (uint64_t b = 0; b < block_count; b++) {
+		float min_value = INFINITY, max_value = -INFINITY;
+
+		for (unsigned int i = 0; i < BlockLength; i++) {
+			const float lo = Pairs ? in[2 * i] : in[i];
+			const float hi = Pairs ? in[2 * i + 1] : in[i];
+			if (lo < min_value)
+				min_value = lo;
+			if (hi > max_value)
+				max_value = hi;
+		}
+
+		store_min_max(out, min_value, max_value);
+
+		in += Pairs ? (2 * BlockLength) : BlockLength;
+		out += 2;
+	}
+}
+
+typedef void (*DeinterleaveKernel)(const float* in, float* out,
+	uint64_t sample_count, unsigned int channel_count,
+	const uint8_t* channel_mask);
+
+/// Moves the samples of the selected channels in [first_channel, channel_count)
+void deinterleave_scalar(const float* in, float* out, uint64_t sample_count,
+	unsigned int channel_count, const uint8_t* channel_mask,
+	unsigned int first_channel)
+{
+	// Go through the samples in rows of a few at a time, so that the
+	// destinations of all channels stay in the cache
+	const uint64_t RowCount = 64;
+
+	for (uint64_t row = 0; row < sample_count; row += RowCount) {
+		const uint64_t rows = min(sample_count - row, RowCount);
+		for (unsigned int c = first_channel; c < channel_count; c++) {
+			if (channel_mask && !channel_mask[c])
+				continue;
+
+			const float* src = in + row * channel_count + c;
+			float* const dest = out + c * sample_count + row;
+			for (uint64_t i = 0; i < rows; i++, src += channel_count)
+				dest[i] = *src;
+		}
+	}
+}
+
+void deinterleave_scalar(const float* in, float* out, uint64_t sample_count,
+	unsigned int channel_count, const uint8_t* channel_mask)
+{
+	deinterleave_scalar(in, out, sample_count, channel_count, channel_mask, 0);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+template <unsigned int U, bool Xor>
+inline __m128i load_value_sse2(const uint8_t* ptr)
+{
+	const __m128i value = _mm_loadu_si128((const __m128i*)ptr);
+	return Xor ? _mm_xor_si128(value,
+		_mm_loadu_si128((const __m128i*)(ptr - U))) : value;
+}
+
+/// ORs the 16 / U samples held in a vector into the first one.
+template <unsigned int U>
+inline __m128i fold_sse2(__m128i v)
+{
+	if (U <= 8)
+		v = _mm_or_si128(v, _mm_srli_si128(v, 8));
+	if (U <= 4)
+		v = _mm_or_si128(v, _mm_srli_si128(v, 4));
+	if (U <= 2)
+		v = _mm_or_si128(v, _mm_srli_si128(v, 2));
+	if (U <= 1)
+		v = _mm_or_si128(v, _mm_srli_si128(v, 1));
+	return v;
+}
+
+template <unsigned int U>
+inline void store_sample_sse2(uint8_t* ptr, __m128i v)
+{
+	const uint64_t value = _mm_cvtsi128_si64(v);
+	memcpy(ptr, &value, U);
+}
+
+template <unsigned int U, bool Xor>
+void reduce_blocks_sse2(const uint8_t* in, uint8_t* out,
+	uint64_t block_count)
+{
+	// Each block fills U vectors
+	for (uint64_t b = 0; b < block_count; b++) {
+		__m128i acc = load_value_sse2<U, Xor>(in);
+		for (unsigned int i = 1; i < U; i++)
+			acc = _mm_or_si128(acc, load_value_sse2<U, Xor>(in + 16 * i));
+
+		store_sample_sse2<U>(out, fold_sse2<U>(acc));
+
+		in += BlockLength * U;
+		out += U;
+	}
+}
+
+template <unsigned int U, bool Xor>
+AVX2_TARGET inline __m256i load_value_avx2(const uint8_t* ptr)
+{
+	const __m256i value = _mm256_loadu_si256((const __m256i*)ptr);
+	return Xor ? _mm256_xor_si256(value,
+		_mm256_loadu_si256((const __m256i*)(ptr - U))) : value;
+}
+
+template <unsigned int U, bool Xor>
+AVX2_TARGET void reduce_blocks_avx2(const uint8_t* in, uint8_t* out,
+	uint64_t block_count)
+{
+	// Two blocks fill U vectors. They're combined so that each 128 bit
+	// lane holds one of the blocks, which is then folded within its lane.
+	for (; block_count >= 2; block_count -= 2) {
+		__m256i v;
+
+		if (U == 1)
+			v = load_value_avx2<U, Xor>(in);
+		else {
+			const uint8_t* const in1 = in + BlockLength * U;
+			__m256i b0 = load_value_avx2<U, Xor>(in);
+			__m256i b1 = load_value_avx2<U, Xor>(in1);
+			for (unsigned int i = 1; i < U / 2; i++) {
+				b0 = _mm256_or_si256(b0, load_value_avx2<U, Xor>(in + 32 * i));
+				b1 = _mm256_or_si256(b1, load_value_avx2<U, Xor>(in1 + 32 * i));
+			}
+
+			v = _mm256_or_si256(_mm256_permute2x128_si256(b0, b1, 0x20),
+				_mm256_permute2x128_si256(b0, b1, 0x31));
+		}
+
+		if (U <= 8)
+			v = _mm256_or_si256(v, _mm256_srli_si256(v, 8));
+		if (U <= 4)
+			v = _mm256_or_si256(v, _mm256_srli_si256(v, 4));
+		if (U <= 2)
+			v = _mm256_or_si256(v, _mm256_srli_si256(v, 2));
+		if (U <= 1)
+			v = _mm256_or_si256(v, _mm256_srli_si256(v, 1));
+
+		const uint64_t lo = _mm_cvtsi128_si64(_mm256_castsi256_si128(v));
+		const uint64_t hi = _mm_cvtsi128_si64(_mm256_extracti128_si256(v, 1));
+		memcpy(out, &lo, U);
+		memcpy(out + U, &hi, U);
+
+		in += 2 * BlockLength * U;
+		out += 2 * U;
+	}
+
+	if (block_count > 0)
+		reduce_blocks_sse2<U, Xor>(in, out, block_count);
+}
+
+// The minimum and maximum instructions return their second operand if
+// either is NaN, which keeps the accumulators free of NaNs
+
+template <bool Pairs>
+void min_max_sse2(const float* in, float* out, uint64_t block_count)
+{
+	const unsigned int vector_count = (Pairs ? 2 : 1) * BlockLength / 4;
+
+	for (uint64_t b = 0; b < block_count; b++) {
+		__m128 vmin = _mm_set1_ps(INFINITY), vmax = _mm_set1_ps(-INFINITY);
+		for (unsigned int i = 0; i < vector_count; i++) {
+			const __m128 v = _mm_loadu_ps(in + 4 * i);
+			vmin = _mm_min_ps(v, vmin);
+			vmax = _mm_max_ps(v, vmax);
+		}
+
+		// With pairs, the minima are held in the even lanes and the
+		// maxima in the odd ones
+		vmin = _mm_min_ps(vmin, _mm_movehl_ps(vmin, vmin));
+		vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+		if (!Pairs) {
+			vmin = _mm_min_ps(vmin, _mm_shuffle_ps(vmin, vmin, 0x11));
+			vmax = _mm_max_ps(vmax, _mm_shuffle_ps(vmax, vmax, 0x11));
+		}
+
+		store_min_max(out, _mm_cvtss_f32(vmin),
+			_mm_cvtss_f32(_mm_shuffle_ps(vmax, vmax, 1)));
+
+		in += vector_count * 4;
+		out += 2;
+	}
+}
+
+template <bool Pairs>
+AVX2_TARGET void min_max_avx2(const float* in, float* out,
+	uint64_t block_count)
+{
+	const unsigned int vector_count = (Pairs ? 2 : 1) * BlockLength / 8;
+
+	for (uint64_t b = 0; b < block_count; b++) {
+		__m256 vmin = _mm256_set1_ps(INFINITY);
+		__m256 vmax = _mm256_set1_ps(-INFINITY);
+		for (unsigned int i = 0; i < vector_count; i++) {
+			const __m256 v = _mm256_loadu_ps(in + 8 * i);
+			vmin = _mm256_min_ps(v, vmin);
+			vmax = _mm256_max_ps(v, vmax);
+		}
+
+		__m128 min4 = _mm_min_ps(_mm256_castps256_ps128(vmin),
+			_mm256_extractf128_ps(vmin, 1));
+		__m128 max4 = _mm_max_ps(_mm256_castps256_ps128(vmax),
+			_mm256_extractf128_ps(vmax, 1));
+
+		min4 = _mm_min_ps(min4, _mm_movehl_ps(min4, min4));
+		max4 = _mm_max_ps(max4, _mm_movehl_ps(max4, max4));
+		if (!Pairs) {
+			min4 = _mm_min_ps(min4, _mm_shuffle_ps(min4, min4, 0x11));
+			max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, 0x11));
+		}
+
+		store_min_max(out, _mm_cvtss_f32(min4),
+			_mm_cvtss_f32(_mm_shuffle_ps(max4, max4, 1)));
+
+		in += vector_count * 8;
+		out += 2;
+	}
+}
+
+/// Transposes blocks of 4 samples of 4 channels
+void deinterleave_sse2(const float* in, float* out, uint64_t sample_count,
+	unsigned int channel_count, const uint8_t* channel_mask)
+{
+	const unsigned int vector_channels = channel_count & ~3;
+	const uint64_t vector_rows = sample_count & ~3;
+
+	for (unsigned int c = 0; c < vector_channels; c += 4) {
+		// Channels that aren't selected are moved along with the others
+		// of their vector, unless none of them is selected
+		if (channel_mask && !(channel_mask[c] || channel_mask[c + 1] ||
+				channel_mask[c + 2] || channel_mask[c + 3]))
+			continue;
+
+		const float* src = in + c;
+		float* const dest = out + c * sample_count;
+		for (uint64_t i = 0; i < vector_rows; i += 4) {
+			__m128 r0 = _mm_loadu_ps(src);
+			__m128 r1 = _mm_loadu_ps(src + channel_count);
+			__m128 r2 = _mm_loadu_ps(src + 2 * channel_count);
+			__m128 r3 = _mm_loadu_ps(src + 3 * channel_count);
+			src += 4 * channel_count;
+
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(dest + i, r0);
+			_mm_storeu_ps(dest + sample_count + i, r1);
+			_mm_storeu_ps(dest + 2 * sample_count + i, r2);
+			_mm_storeu_ps(dest + 3 * sample_count + i, r3);
+		}
+
+		for (uint64_t i = vector_rows; i < sample_count; i++)
+			for (unsigned int j = 0; j < 4; j++)
+				dest[j * sample_count + i] = in[i * channel_count + c + j];
+	}
+
+	// The channels left over don't fill a vector
+	deinterleave_scalar(in, out, sample_count, channel_count, channel_mask,
+		vector_channels);
+}
+
+#endif
+
+template <bool Pairs>
+EnvelopeKernel get_envelope_kernel(
+	MipMapKernels::InstructionSet instruction_set)
+{
+	switch (instruction_set) {
+#ifdef HAVE_X86_KERNELS
+	case MipMapKernels::AVX2: return min_max_avx2<Pairs>;
+	case MipMapKernels::SSE2: return min_max_sse2<Pairs>;
+#endif
+	default: return min_max_scalar<Pairs>;
+	}
+}
+
+DeinterleaveKernel get_deinterleave_kernel(
+	MipMapKernels::InstructionSet instruction_set)
+{
+	// The samples are only moved, wider vectors don't help
+#ifdef HAVE_X86_KERNELS
+	if (instruction_set != MipMapKernels::Scalar)
+		return deinterleave_sse2;
+#else
+	(void)instruction_set;
+#endif
+	return deinterleave_scalar;
+}
+
+template <bool Xor>
+BlockKernel get_kernel(MipMapKernels::InstructionSet instruction_set,
+	unsigned int unit_size)
+{
+#ifdef HAVE_X86_KERNELS
+	// Samples of other widths straddle the vector lanes, they're left
+	// to the scalar kernels
+	if (instruction_set == MipMapKernels::AVX2)
+		switch (unit_size) {
+		case 1: return reduce_blocks_avx2<1, Xor>;
+		case 2: return reduce_blocks_avx2<2, Xor>;
+		case 4: return reduce_blocks_avx2<4, Xor>;
+		case 8: return reduce_blocks_avx2<8, Xor>;
+		}
+
+	if (instruction_set != MipMapKernels::Scalar)
+		switch (unit_size) {
+		case 1: return reduce_blocks_sse2<1, Xor>;
+		case 2: return reduce_blocks_sse2<2, Xor>;
+		case 4: return reduce_blocks_sse2<4, Xor>;
+		case 8: return reduce_blocks_sse2<8, Xor>;
+		}
+#else
+	(void)instruction_set;
+#endif
+
+	switch (unit_size) {
+	case 1: return reduce_blocks_scalar<1, Xor>;
+	case 2: return reduce_blocks_scalar<2, Xor>;
+	case 3: return reduce_blocks_scalar<3, Xor>;
+	case 4: return reduce_blocks_scalar<4, Xor>;
+	case 5: return reduce_blocks_scalar<5, Xor>;
+	case 6: return reduce_blocks_scalar<6, Xor>;
+	case 7: return reduce_blocks_scalar<7, Xor>;
+	default: return reduce_blocks_scalar<8, Xor>;
+	}
+}
+
+} // namespace
+
+MipMapKernels::InstructionSet MipMapKernels::supported_instruction_set()
+{
+	return detect_instruction_set();
+}
+
+MipMapKernels::InstructionSet MipMapKernels::instruction_set()
+{
+	return instruction_set_;
+}
+
+void MipMapKernels::set_instruction_set(InstructionSet instruction_set)
+{
+	const InstructionSet supported = supported_instruction_set();
+	instruction_set_ = (instruction_set <= supported) ? instruction_set : supported;
+}
+
+const char* MipMapKernels::instruction_set_name(InstructionSet instruction_set)
+{
+	switch (instruction_set) {
+	case SSE2: return "SSE2";
+	case AVX2: return "AVX2";
+	default: return "Scalar";
+	}
+}
+
+void MipMapKernels::xor_accumulate(const uint8_t* in, uint8_t* out,
+	uint64_t block_count, unsigned int unit_size, const uint8_t* prev_sample)
+{
+	assert((unit_size >= 1) && (unit_size <= 8));
+
+	if (block_count == 0)
+		return;
+
+	const BlockKernel kernel = get_kernel<true>(instruction_set_, unit_size);
+
+	// The kernels read the sample preceding each block from the input, so
+	// the first block is copied behind the given preceding sample
+	uint8_t first_block[(BlockLength + 1) * sizeof(uint64_t)];
+	memcpy(first_block, prev_sample, unit_size);
+	memcpy(first_block + unit_size, in, BlockLength * unit_size);
+
+	kernel(first_block + unit_size, out, 1);
+	kernel(in + BlockLength * unit_size, out + unit_size, block_count - 1);
+}
+
+void MipMapKernels::or_reduce(const uint8_t* in, uint8_t* out,
+	uint64_t block_count, unsigned int unit_size)
+{
+	assert((unit_size >= 1) && (unit_size <= 8));
+
+	get_kernel<false>(instruction_set_, unit_size)(in, out, block_count);
+}
+
+void MipMapKernels::min_max_samples(const float* in, float* out,
+	uint64_t block_count)
+{
+	get_envelope_kernel<false>(instruction_set_)(in, out, block_count);
+}
+
+void MipMapKernels::min_max_reduce(const float* in, float* out,
+	uint64_t block_count)
+{
+	get_envelope_kernel<true>(instruction_set_)(in, out, block_count);
+}
+
+void MipMapKernels::deinterleave(const float* in, float* out,
+	uint64_t sample_count, unsigned int channel_count,
+	const uint8_t* channel_mask)
+{
+	get_deinterleave_kernel(instruction_set_)(in, out, sample_count,
+		channel_count, channel_mask);
+}
+
+MipMapKernels::InstructionSet MipMapKernels::detect_instruction_set()
+{
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return AVX2;
+
+	// SSE2 is part of the x86-64 base instruction set
+	return SSE2;
+#else
+	return Scalar;
+#endif
+}
+
+} // namespace data
+} // namespace pv
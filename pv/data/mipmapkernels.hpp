@@ -0,0 +1,122 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2026 The PulseView developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULSEVIEW_PV_DATA_MIPMAPKERNELS_HPP
+#define PULSEVIEW_PV_DATA_MIPMAPKERNELS_HPP
+
+#include <cstdint>
+
+namespace pv {
+namespace data {
+
+/**
+ * The inner loops used to build the mip-maps of logic segments and the
+ * envelopes of analog segments, and to split up the samples of analog
+ * packets.
+ *
+ * Logic samples are 1 to 8 bytes wide, analog samples are floats. Both are
+ * summarized in blocks of BlockLength samples. The kernels are implemented
+ * for several instruction sets, the fastest one supported by the CPU is
+ * selected at runtime.
+ */
+class MipMapKernels
+{
+public:
+	static const unsigned int BlockLength = 16;
+
+	enum InstructionSet {
+		Scalar,
+		SSE2,
+		AVX2,
+		InstructionSetCount
+	};
+
+public:
+	/// Returns the best instruction set supported by the CPU.
+	static InstructionSet supported_instruction_set();
+
+	static InstructionSet instruction_set();
+
+	/**
+	 * Selects the instruction set used by the kernels, e.g. to compare
+	 * them. Instruction sets the CPU doesn't support are replaced by the
+	 * best supported one.
+	 */
+	static void set_instruction_set(InstructionSet instruction_set);
+
+	static const char* instruction_set_name(InstructionSet instruction_set);
+
+	/**
+	 * Builds the first mip-map level: every output sample has those bits
+	 * set that change within its block of input samples.
+	 * @param in The input samples, block_count * BlockLength of them.
+	 * @param out Receives block_count samples.
+	 * @param prev_sample The sample preceding the first input sample.
+	 */
+	static void xor_accumulate(const uint8_t* in, uint8_t* out,
+		uint64_t block_count, unsigned int unit_size,
+		const uint8_t* prev_sample);
+
+	/**
+	 * Builds the higher mip-map levels: every output sample is the OR of
+	 * its block of input samples.
+	 */
+	static void or_reduce(const uint8_t* in, uint8_t* out,
+		uint64_t block_count, unsigned int unit_size);
+
+	/**
+	 * Builds the first envelope level: every output pair holds the minimum
+	 * and the maximum of its block of input samples. NaN samples are
+	 * ignored, blocks holding nothing but NaNs result in a pair of NaNs.
+	 * @param out Receives 2 * block_count floats.
+	 */
+	static void min_max_samples(const float* in, float* out,
+		uint64_t block_count);
+
+	/**
+	 * Builds the higher envelope levels from the minimum and maximum pairs
+	 * of the level below, treating NaNs like min_max_samples() does.
+	 */
+	static void min_max_reduce(const float* in, float* out,
+		uint64_t block_count);
+
+	/**
+	 * Splits up the interleaved float samples of several channels.
+	 * @param in sample_count rows of channel_count samples each.
+	 * @param out Receives the samples of one channel after the other,
+	 *        sample_count of them each.
+	 * @param channel_mask If not null, only the channels whose entry is
+	 *        nonzero are split off. The others may or may not be written
+	 *        to out.
+	 */
+	static void deinterleave(const float* in, float* out,
+		uint64_t sample_count, unsigned int channel_count,
+		const uint8_t* channel_mask = nullptr);
+
+private:
+	static InstructionSet detect_instruction_set();
+
+private:
+	static InstructionSet instruction_set_;
+};
+
+} // namespace data
+} // namespace pv
+
+#endif // PULSEVIEW_PV_DATA_MIPMAPKERNELS_HPP
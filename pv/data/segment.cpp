@@ -18,65 +18,124 @@
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "chunkpool.hpp"
 #include "segment.hpp"
+#include "swapfile.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
 
 #include <QDebug>
 
+using std::atomic_load;
+using std::atomic_store;
 using std::bad_alloc;
+using std::default_delete;
 using std::lock_guard;
+using std::make_shared;
+using std::max;
+using std::memory_order_acquire;
+using std::memory_order_release;
 using std::min;
+using std::move;
+using std::mutex;
 using std::recursive_mutex;
+using std::thread;
+using std::unique_lock;
 
 namespace pv {
 namespace data {
 
 const uint64_t Segment::MaxChunkSize = 10 * 1024 * 1024;  /* 10MiB */
+const uint64_t Segment::InitialChunkSize = 16 * 1024;  /* 16KiB */
+const uint64_t Segment::ChunkSampleAlignment = 16;
+const unsigned int Segment::MaxCachedChunks = 3;
+
+mutex Segment::compression_mutex_;
+condition_variable Segment::compression_cond_;
+deque< pair<Segment*, uint64_t> > Segment::compression_queue_;
+Segment* Segment::compressing_segment_ = nullptr;
+bool Segment::compression_thread_running_ = false;
+
+atomic<uint64_t> Segment::copied_bytes_(0);
+atomic<uint64_t> Segment::in_place_bytes_(0);
 
 Segment::Segment(uint32_t segment_id, uint64_t samplerate, unsigned int unit_size) :
 	segment_id_(segment_id),
-	sample_count_(0),
+	appended_sample_count_(0),
+	sample_number_base_(0),
 	start_time_(0),
 	samplerate_(samplerate),
+	max_sample_count_(0),
 	unit_size_(unit_size),
-	iterator_count_(0),
-	mem_optimization_requested_(false),
-	is_complete_(false)
+	is_complete_(false),
+	swap_backed_(SwapFile::enabled()),
+	chunk_compression_(NoCompression)
 {
 	lock_guard<recursive_mutex> lock(mutex_);
 	assert(unit_size_ > 0);
 
 	// Determine the number of samples we can fit in one chunk
 	// without exceeding MaxChunkSize
-	chunk_size_ = min(MaxChunkSize, (MaxChunkSize / unit_size_) * unit_size_);
+	max_chunk_samples_ = max(
+		(MaxChunkSize / unit_size_ / ChunkSampleAlignment) * ChunkSampleAlignment,
+		ChunkSampleAlignment);
+
+	// Chunks start small and double in size until they reach the maximum,
+	// so that short segments don't occupy a full chunk each
+	first_chunk_samples_ = min(max(
+		(InitialChunkSize / unit_size_ / ChunkSampleAlignment) * ChunkSampleAlignment,
+		ChunkSampleAlignment), max_chunk_samples_);
+
+	growth_chunk_count_ = 0;
+	while ((first_chunk_samples_ << growth_chunk_count_) < max_chunk_samples_)
+		growth_chunk_count_++;
+	growth_sample_count_ = chunk_start_sample(growth_chunk_count_);
 
 	// Create the initial chunk
-	current_chunk_ = new uint8_t[chunk_size_ + 7];  /* FIXME +7 is workaround for #1284 */
-	data_chunks_.push_back(current_chunk_);
+	const uint64_t size = first_chunk_samples_ * unit_size_ + 7;  /* FIXME +7 is workaround for #1284 */
+	shared_ptr<uint8_t> chunk = allocate_chunk(size);
+	current_chunk_ = chunk.get();
+	publish_chunk_table(make_shared<ChunkTable>(
+		ChunkTable{0, 0, vector<DataChunk>(1, DataChunk{chunk, nullptr, size})}));
+	memory_account_.add(MemoryAccount::SampleData, size);
 	used_samples_ = 0;
-	unused_samples_ = chunk_size_ / unit_size_;
+	unused_samples_ = first_chunk_samples_;
 }
 
 Segment::~Segment()
 {
-	lock_guard<recursive_mutex> lock(mutex_);
+	// Make sure the compression thread is done with us
+	{
+		unique_lock<mutex> lock(compression_mutex_);
 
-	for (uint8_t* chunk : data_chunks_)
-		delete[] chunk;
+		for (auto it = compression_queue_.begin(); it != compression_queue_.end();)
+			if (it->first == this)
+				it = compression_queue_.erase(it);
+			else
+				it++;
+
+		compression_cond_.wait(lock, [&] { return compressing_segment_ != this; });
+	}
 }
 
 uint64_t Segment::get_sample_count() const
 {
-	lock_guard<recursive_mutex> lock(mutex_);
-	return sample_count_;
+	// The count must be relative to the index base of a table. Loading
+	// the table first keeps the base below the count of appended samples.
+	const uint64_t first_sample = chunk_table()->first_sample;
+	return appended_sample_count_.load(memory_order_acquire) - first_sample;
 }
 
-const pv::util::Timestamp& Segment::start_time() const
+pv::util::Timestamp Segment::start_time() const
 {
-	return start_time_;
+	const uint64_t first = first_sample_number();
+	if (!first)
+		return start_time_;
+
+	return start_time_ + pv::util::Timestamp(first) / samplerate_;
 }
 
 double Segment::samplerate() const
@@ -113,23 +172,120 @@ void Segment::free_unused_memory()
 {
 	lock_guard<recursive_mutex> lock(mutex_);
 
-	// Do not mess with the data chunks if we have iterators pointing at them
-	if (iterator_count_ > 0) {
-		mem_optimization_requested_ = true;
+	if (!current_chunk_)
 		return;
+
+	const shared_ptr<const ChunkTable> old_table = chunk_table();
+	const uint64_t last_chunk = old_table->first_chunk + old_table->chunks.size() - 1;
+
+	// Swap file backed chunks only occupy the memory that was written to
+	if (!swap_backed_) {
+		// No more data will come in, so re-create the last chunk accordingly.
+		// Readers still using the old chunk keep it alive until they're done.
+		// Its size is unlikely to be requested again, so it isn't pooled.
+		const uint64_t size = used_samples_ * unit_size_ + 7;  /* FIXME +7 is workaround for #1284 */
+		shared_ptr<uint8_t> resized_chunk = allocate_chunk(size, false);
+		memcpy(resized_chunk.get(), current_chunk_, used_samples_ * unit_size_);
+
+		shared_ptr<ChunkTable> table = make_shared<ChunkTable>(*old_table);
+		DataChunk &c = table->chunks.back();
+		memory_account_.add(MemoryAccount::SampleData, (int64_t)size - (int64_t)c.size);
+		c.data = resized_chunk;
+		c.size = size;
+		publish_chunk_table(table);
 	}
 
-	if (current_chunk_) {
-		// No more data will come in, so re-create the last chunk accordingly
-		uint8_t* resized_chunk = new uint8_t[used_samples_ * unit_size_ + 7];  /* FIXME +7 is workaround for #1284 */
-		memcpy(resized_chunk, current_chunk_, used_samples_ * unit_size_);
+	// The last chunk won't receive any more samples, so it can be
+	// compressed as well
+	if ((chunk_compression_ != NoCompression) && (used_samples_ > 0))
+		queue_chunk_compression(last_chunk);
+
+	// Prevent the last chunk from being touched again
+	current_chunk_ = nullptr;
+}
+
+void Segment::set_max_sample_count(uint64_t max_sample_count)
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+	max_sample_count_ = max_sample_count;
+}
+
+uint64_t Segment::max_sample_count() const
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+	return max_sample_count_;
+}
+
+uint64_t Segment::evicted_sample_count() const
+{
+	return chunk_table()->first_sample;
+}
+
+uint64_t Segment::first_sample_number() const
+{
+	return sample_number_base_ + chunk_table()->first_sample;
+}
+
+uint64_t Segment::end_sample_number() const
+{
+	return sample_number_base_ + appended_sample_count_.load(memory_order_acquire);
+}
+
+void Segment::set_first_sample_number(uint64_t number)
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	assert(appended_sample_count_ == 0);
+	sample_number_base_ = number;
+}
+
+pv::util::Timestamp Segment::origin_time() const
+{
+	return start_time_;
+}
+
+uint64_t Segment::sample_count_bound() const
+{
+	return appended_sample_count_.load(memory_order_acquire);
+}
+
+uint64_t Segment::compressed_size() const
+{
+	const shared_ptr<const ChunkTable> table = chunk_table();
 
-		delete[] current_chunk_;
-		current_chunk_ = resized_chunk;
+	uint64_t size = 0;
+	for (const DataChunk& c : table->chunks)
+		if (c.compressed)
+			size += c.compressed->size();
 
-		data_chunks_.pop_back();
-		data_chunks_.push_back(resized_chunk);
+	return size;
+}
+
+uint64_t Segment::compressed_sample_count() const
+{
+	const shared_ptr<const ChunkTable> table = chunk_table();
+	const uint64_t sample_count =
+		appended_sample_count_.load(memory_order_acquire) - table->first_sample;
+
+	uint64_t count = 0;
+	for (uint64_t i = 0; i < table->chunks.size(); i++) {
+		const uint64_t chunk_num = table->first_chunk + i;
+		const uint64_t start = chunk_start_sample(chunk_num) - table->first_sample;
+
+		if (table->chunks[i].compressed && (start < sample_count))
+			count += min(chunk_capacity(chunk_num), sample_count - start);
 	}
+
+	return count;
+}
+
+void Segment::set_chunk_compression(ChunkCompression compression)
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	assert(chunk_table()->chunks.size() == 1);
+	assert((compression != XorCompression) || (unit_size_ == sizeof(uint32_t)));
+	chunk_compression_ = compression;
 }
 
 void Segment::append_single_sample(void *data)
@@ -143,14 +299,13 @@ void Segment::append_single_sample(void *data)
 	used_samples_++;
 	unused_samples_--;
 
-	if (unused_samples_ == 0) {
-		current_chunk_ = new uint8_t[chunk_size_ + 7];  /* FIXME +7 is workaround for #1284 */
-		data_chunks_.push_back(current_chunk_);
-		used_samples_ = 0;
-		unused_samples_ = chunk_size_ / unit_size_;
-	}
+	if (unused_samples_ == 0)
+		start_new_chunk();
 
-	sample_count_++;
+	copied_bytes_ += unit_size_;
+
+	// Readers may only see the sample once it was written
+	appended_sample_count_.fetch_add(1, memory_order_release);
 }
 
 void Segment::append_samples(void* data, uint64_t samples)
@@ -183,56 +338,156 @@ void Segment::append_samples(void* data, uint64_t samples)
 
 		if (unused_samples_ == 0) {
 			try {
-				// If we're out of memory, allocating a chunk will throw
-				// std::bad_alloc. To give the application some usable memory
-				// to work with in case chunk allocation fails, we allocate
-				// extra memory and throw it away if it all succeeded.
-				// This way, memory allocation will fail early enough to let
-				// PV remain alive. Otherwise, PV will crash in a random
-				// memory-allocating part of the application.
-				current_chunk_ = new uint8_t[chunk_size_ + 7];  /* FIXME +7 is workaround for #1284 */
-
-				const int dummy_size = 2 * chunk_size_;
-				auto dummy_chunk = new uint8_t[dummy_size];
-				memset(dummy_chunk, 0xFF, dummy_size);
-				delete[] dummy_chunk;
+				start_new_chunk();
 			} catch (bad_alloc&) {
-				delete[] current_chunk_;  // The new may have succeeded
-				current_chunk_ = nullptr;
+				// The samples copied so far are valid, publish them
+				appended_sample_count_.fetch_add(samples - remaining_samples,
+					memory_order_release);
 				throw;
 			}
-
-			data_chunks_.push_back(current_chunk_);
-			used_samples_ = 0;
-			unused_samples_ = chunk_size_ / unit_size_;
 		}
 	} while (remaining_samples > 0);
 
-	sample_count_ += samples;
+	copied_bytes_ += samples * unit_size_;
+
+	// Readers may only see the samples once they were written
+	appended_sample_count_.fetch_add(samples, memory_order_release);
+}
+
+uint8_t* Segment::get_append_buffer(uint64_t &max_count)
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	assert(current_chunk_);
+
+	max_count = unused_samples_;
+	return current_chunk_ + (used_samples_ * unit_size_);
+}
+
+void Segment::commit_appended_samples(uint64_t count)
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	assert(count <= unused_samples_);
+
+	used_samples_ += count;
+	unused_samples_ -= count;
+
+	in_place_bytes_ += count * unit_size_;
+
+	// Publish the samples before a new chunk is allocated, they're
+	// already in place and valid even if that fails
+	appended_sample_count_.fetch_add(count, memory_order_release);
+
+	if (unused_samples_ == 0)
+		start_new_chunk();
+}
+
+uint64_t Segment::evict_old_chunks()
+{
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	// Evict in batches so that the derived classes don't have to trim
+	// their data structures for every single chunk
+	const uint64_t sample_count = get_sample_count();
+	if (!max_sample_count_ ||
+		(sample_count <= max_sample_count_ + max_sample_count_ / 8))
+		return 0;
+
+	shared_ptr<ChunkTable> table = make_shared<ChunkTable>(*chunk_table());
+
+	// Keep at least max_sample_count_ samples and never evict the chunk
+	// that is being filled
+	uint64_t evicted = 0, chunk_count = 0;
+	while (chunk_count + 1 < table->chunks.size()) {
+		const uint64_t capacity = chunk_capacity(table->first_chunk + chunk_count);
+		if (sample_count - evicted - capacity < max_sample_count_)
+			break;
+
+		evicted += capacity;
+		chunk_count++;
+	}
+
+	if (!chunk_count)
+		return 0;
+
+	for (uint64_t i = 0; i < chunk_count; i++) {
+		const DataChunk &c = table->chunks[i];
+		if (c.data)
+			memory_account_.add(MemoryAccount::SampleData, -(int64_t)c.size);
+		else
+			memory_account_.add(MemoryAccount::CompressedData,
+				-(int64_t)c.compressed->size());
+	}
+
+	table->chunks.erase(table->chunks.begin(),
+		table->chunks.begin() + chunk_count);
+	table->first_chunk += chunk_count;
+
+	{
+		// Cached copies of evicted chunks won't be asked for anymore
+		lock_guard<mutex> cache_lock(cache_mutex_);
+		for (auto it = chunk_cache_.begin(); it != chunk_cache_.end();)
+			if (it->chunk_num < table->first_chunk) {
+				memory_account_.add(MemoryAccount::SampleData,
+					-(int64_t)it->size);
+				it = chunk_cache_.erase(it);
+			} else
+				it++;
+	}
+	table->first_sample += evicted;
+
+	// The sample count shrinks along with the table being published
+	publish_chunk_table(table);
+
+	return evicted;
+}
+
+uint64_t Segment::copied_byte_count()
+{
+	return copied_bytes_;
+}
+
+uint64_t Segment::in_place_byte_count()
+{
+	return in_place_bytes_;
 }
 
 void Segment::get_raw_samples(uint64_t start, uint64_t count,
 	uint8_t* dest) const
 {
-	assert(start < sample_count_);
-	assert(start + count <= sample_count_);
+	assert(start < sample_count_bound());
+	assert(start + count <= sample_count_bound());
 	assert(count > 0);
 	assert(dest != nullptr);
 
-	lock_guard<recursive_mutex> lock(mutex_);
+	// The table must be loaded after the sample count, so that it
+	// contains all chunks holding the requested samples. Its index base
+	// is the one of the sample count unless samples were evicted since.
+	const shared_ptr<const ChunkTable> table = chunk_table();
+	const uint64_t end_chunk = table->first_chunk + table->chunks.size();
 
 	uint8_t* dest_ptr = dest;
 
-	uint64_t chunk_num = (start * unit_size_) / chunk_size_;
-	uint64_t chunk_offs = (start * unit_size_) % chunk_size_;
+	// Sample indices are relative to the first sample held
+	start += table->first_sample;
+
+	uint64_t chunk_num = chunk_of_sample(start);
+	uint64_t chunk_offs = (start - chunk_start_sample(chunk_num)) * unit_size_;
 
 	while (count > 0) {
-		const uint8_t* chunk = data_chunks_[chunk_num];
+		if (chunk_num >= end_chunk) {
+			// The range was determined before chunks were evicted
+			memset(dest_ptr, 0, count * unit_size_);
+			break;
+		}
+
+		const shared_ptr<uint8_t> chunk = get_chunk(*table, chunk_num);
 
 		uint64_t copy_size = min(count * unit_size_,
-			chunk_size_ - chunk_offs);
+			chunk_capacity(chunk_num) * unit_size_ - chunk_offs);
 
-		memcpy(dest_ptr, chunk + chunk_offs, copy_size);
+		memcpy(dest_ptr, chunk.get() + chunk_offs, copy_size);
 
 		dest_ptr += copy_size;
 		count -= (copy_size / unit_size_);
@@ -242,18 +497,94 @@ void Segment::get_raw_samples(uint64_t start, uint64_t count,
 	}
 }
 
+void Segment::get_sample_spans(uint64_t start, uint64_t count,
+	vector<SegmentSpan> &spans) const
+{
+	assert(start < sample_count_bound());
+	assert(start + count <= sample_count_bound());
+	assert(count > 0);
+
+	// The table must be loaded after the sample count, so that it
+	// contains all chunks holding the requested samples. Its index base
+	// is the one of the sample count unless samples were evicted since.
+	const shared_ptr<const ChunkTable> table = chunk_table();
+
+	spans.clear();
+
+	// Sample indices are relative to the first sample held
+	fill_sample_spans(*table, start + table->first_sample, count, spans);
+}
+
+bool Segment::get_sample_spans_by_number(uint64_t number, uint64_t count,
+	vector<SegmentSpan> &spans) const
+{
+	assert(number >= sample_number_base_);
+	assert(count > 0);
+
+	spans.clear();
+
+	// The spans pin the chunks of the table, so the samples remain
+	// valid even if they're evicted right after the check
+	const shared_ptr<const ChunkTable> table = chunk_table();
+	const uint64_t sample = number - sample_number_base_;
+	if (sample < table->first_sample)
+		return false;
+
+	assert(sample + count <= sample_count_bound());
+
+	fill_sample_spans(*table, sample, count, spans);
+	return true;
+}
+
+void Segment::fill_sample_spans(const ChunkTable &table, uint64_t sample,
+	uint64_t count, vector<SegmentSpan> &spans) const
+{
+	const uint64_t end_chunk = table.first_chunk + table.chunks.size();
+
+	uint64_t chunk_num = chunk_of_sample(sample);
+	uint64_t chunk_offs = sample - chunk_start_sample(chunk_num);
+
+	while (count > 0) {
+		SegmentSpan span;
+
+		if (chunk_num >= end_chunk) {
+			// The range was determined before chunks were evicted
+			const uint64_t size = count * unit_size_ + 7;  /* FIXME +7 is workaround for #1284 */
+			span.pin = shared_ptr<uint8_t>(new uint8_t[size](),
+				default_delete<uint8_t[]>());
+			span.data = span.pin.get();
+			span.sample_count = count;
+			spans.push_back(span);
+			break;
+		}
+
+		span.pin = get_chunk(table, chunk_num);
+		span.data = span.pin.get() + chunk_offs * unit_size_;
+		span.sample_count = min(count, chunk_capacity(chunk_num) - chunk_offs);
+		spans.push_back(span);
+
+		count -= span.sample_count;
+
+		chunk_num++;
+		chunk_offs = 0;
+	}
+}
+
 SegmentDataIterator* Segment::begin_sample_iteration(uint64_t start)
 {
-	SegmentDataIterator* it = new SegmentDataIterator;
+	assert(start < get_sample_count());
 
-	assert(start < sample_count_);
+	SegmentDataIterator* it = new SegmentDataIterator;
 
-	iterator_count_++;
+	const shared_ptr<const ChunkTable> table = chunk_table();
+	const uint64_t first_sample = table->first_sample;
 
 	it->sample_index = start;
-	it->chunk_num = (start * unit_size_) / chunk_size_;
-	it->chunk_offs = (start * unit_size_) % chunk_size_;
-	it->chunk = data_chunks_[it->chunk_num];
+	it->chunk_num = chunk_of_sample(first_sample + start);
+	it->chunk_offs = (first_sample + start -
+		chunk_start_sample(it->chunk_num)) * unit_size_;
+	it->chunk_ref = get_chunk(*table, it->chunk_num);
+	it->chunk = it->chunk_ref.get();
 
 	return it;
 }
@@ -263,37 +594,455 @@ void Segment::continue_sample_iteration(SegmentDataIterator* it, uint64_t increa
 	it->sample_index += increase;
 	it->chunk_offs += (increase * unit_size_);
 
-	if (it->chunk_offs > (chunk_size_ - 1)) {
-		it->chunk_num++;
-		it->chunk_offs -= chunk_size_;
-		it->chunk = data_chunks_[it->chunk_num];
+	if (it->chunk_offs >= chunk_capacity(it->chunk_num) * unit_size_) {
+		// Small chunks may be skipped entirely
+		do {
+			it->chunk_offs -= chunk_capacity(it->chunk_num) * unit_size_;
+			it->chunk_num++;
+		} while (it->chunk_offs >= chunk_capacity(it->chunk_num) * unit_size_);
+
+		// The iterator may run past the last sample, in which case
+		// there's no chunk to reference anymore
+		const shared_ptr<const ChunkTable> table = chunk_table();
+		if ((it->chunk_num >= table->first_chunk) &&
+			(it->chunk_num < table->first_chunk + table->chunks.size()))
+			it->chunk_ref = get_chunk(*table, it->chunk_num);
+		else
+			it->chunk_ref.reset();
+		it->chunk = it->chunk_ref.get();
 	}
 }
 
 void Segment::end_sample_iteration(SegmentDataIterator* it)
 {
 	delete it;
-
-	iterator_count_--;
-
-	if ((iterator_count_ == 0) && mem_optimization_requested_) {
-		mem_optimization_requested_ = false;
-		free_unused_memory();
-	}
 }
 
 uint8_t* Segment::get_iterator_value(SegmentDataIterator* it)
 {
-	assert(it->sample_index <= (sample_count_ - 1));
+	assert(it->sample_index < get_sample_count());
 
 	return (it->chunk + it->chunk_offs);
 }
 
 uint64_t Segment::get_iterator_valid_length(SegmentDataIterator* it)
 {
-	assert(it->sample_index <= (sample_count_ - 1));
+	assert(it->sample_index < get_sample_count());
+
+	return (chunk_capacity(it->chunk_num) - it->chunk_offs / unit_size_);
+}
+
+uint64_t Segment::chunk_capacity(uint64_t chunk_num) const
+{
+	if (chunk_num < growth_chunk_count_)
+		return first_chunk_samples_ << chunk_num;
+
+	return max_chunk_samples_;
+}
+
+uint64_t Segment::chunk_start_sample(uint64_t chunk_num) const
+{
+	if (chunk_num <= growth_chunk_count_)
+		return first_chunk_samples_ * ((1ULL << chunk_num) - 1);
+
+	return growth_sample_count_ +
+		(chunk_num - growth_chunk_count_) * max_chunk_samples_;
+}
+
+uint64_t Segment::chunk_of_sample(uint64_t sample) const
+{
+	if (sample >= growth_sample_count_)
+		return growth_chunk_count_ +
+			(sample - growth_sample_count_) / max_chunk_samples_;
+
+	// There's only a handful of growing chunks
+	uint64_t chunk_num = 0;
+	while (sample >= chunk_start_sample(chunk_num + 1))
+		chunk_num++;
+
+	return chunk_num;
+}
+
+shared_ptr<uint8_t> Segment::allocate_chunk(uint64_t size,
+	bool reusable) const
+{
+	if (swap_backed_)
+		return shared_ptr<uint8_t>(SwapFile::allocate_chunk(size),
+			SwapFile::release_chunk);
+
+	if (!reusable)
+		return shared_ptr<uint8_t>(ChunkPool::allocate_chunk(size),
+			ChunkPool::free_chunk);
+
+	return shared_ptr<uint8_t>(ChunkPool::allocate_chunk(size),
+		[size](uint8_t* chunk) { ChunkPool::release_chunk(chunk, size); });
+}
+
+void Segment::start_new_chunk()
+{
+	shared_ptr<ChunkTable> table = make_shared<ChunkTable>(*chunk_table());
+	const uint64_t chunk_num = table->first_chunk + table->chunks.size();
+
+	if (chunk_compression_ != NoCompression)
+		queue_chunk_compression(chunk_num - 1);
+
+	// If we're out of memory, allocating a chunk will throw std::bad_alloc.
+	// The chunk pool then gives up its memory reserve so that PV remains
+	// alive while the acquisition is stopped.
+	const uint64_t capacity = chunk_capacity(chunk_num);
+
+	const uint64_t size = capacity * unit_size_ + 7;  /* FIXME +7 is workaround for #1284 */
+
+	current_chunk_ = nullptr;
+	shared_ptr<uint8_t> chunk = allocate_chunk(size);
+
+	current_chunk_ = chunk.get();
+	table->chunks.push_back(DataChunk{chunk, nullptr, size});
+	publish_chunk_table(table);
+	memory_account_.add(MemoryAccount::SampleData, size);
+
+	used_samples_ = 0;
+	unused_samples_ = capacity;
+}
+
+shared_ptr<const Segment::ChunkTable> Segment::chunk_table() const
+{
+	return atomic_load(&chunk_table_);
+}
+
+void Segment::publish_chunk_table(shared_ptr<const ChunkTable> table)
+{
+	atomic_store(&chunk_table_, table);
+}
+
+shared_ptr<uint8_t> Segment::get_chunk(const ChunkTable &table,
+	uint64_t chunk_num) const
+{
+	assert(chunk_num >= table.first_chunk);
+	assert(chunk_num < table.first_chunk + table.chunks.size());
+
+	const DataChunk &c = table.chunks[chunk_num - table.first_chunk];
+	shared_ptr<uint8_t> chunk = c.data;
+
+	if (!chunk) {
+		lock_guard<mutex> lock(cache_mutex_);
+
+		// The chunk is compressed, use the decompressed copy if we have one
+		for (auto it = chunk_cache_.begin(); it != chunk_cache_.end(); it++)
+			if (it->chunk_num == chunk_num) {
+				chunk_cache_.splice(chunk_cache_.begin(), chunk_cache_, it);
+				chunk = it->data;
+				break;
+			}
+
+		if (!chunk) {
+			const uint64_t size = chunk_capacity(chunk_num) * unit_size_ + 7;  /* FIXME +7 is workaround for #1284 */
+			chunk = allocate_chunk(size);
+			if (chunk_compression_ == XorCompression)
+				xor_decompress(*c.compressed, chunk.get());
+			else
+				rle_decompress(*c.compressed, chunk.get());
+
+			cache_chunk(chunk_num, chunk, size, true);
+		}
+	}
+
+	if (swap_backed_)
+		SwapFile::mark_hot(chunk.get());
+
+	return chunk;
+}
+
+void Segment::cache_chunk(uint64_t chunk_num, shared_ptr<uint8_t> data,
+	uint64_t size, bool most_recent) const
+{
+	// Called with cache_mutex_ held
+	if (most_recent)
+		chunk_cache_.push_front({chunk_num, data, size});
+	else
+		chunk_cache_.push_back({chunk_num, data, size});
+
+	memory_account_.add(MemoryAccount::SampleData, size);
+	trim_chunk_cache();
+}
+
+void Segment::trim_chunk_cache() const
+{
+	// Chunks that are still in use stay alive through their references
+	while (chunk_cache_.size() > MaxCachedChunks) {
+		memory_account_.add(MemoryAccount::SampleData,
+			-(int64_t)chunk_cache_.back().size);
+		chunk_cache_.pop_back();
+	}
+}
+
+void Segment::queue_chunk_compression(uint64_t chunk_num)
+{
+	lock_guard<mutex> lock(compression_mutex_);
+
+	compression_queue_.emplace_back(this, chunk_num);
+
+	if (!compression_thread_running_) {
+		compression_thread_running_ = true;
+		thread(&Segment::compression_thread_proc).detach();
+	}
+}
+
+void Segment::compress_chunk(uint64_t chunk_num)
+{
+	shared_ptr<uint8_t> chunk;
+	uint64_t size;
+
+	{
+		lock_guard<recursive_mutex> lock(mutex_);
+
+		const shared_ptr<const ChunkTable> table = chunk_table();
+		if (chunk_num < table->first_chunk)
+			return;  // Evicted in the meantime
+
+		chunk = table->chunks[chunk_num - table->first_chunk].data;
+		if (!chunk)
+			return;
+
+		// All chunks are full except for the last one
+		size = (chunk_num == table->first_chunk + table->chunks.size() - 1) ?
+			used_samples_ * unit_size_ : chunk_capacity(chunk_num) * unit_size_;
+	}
+
+	// Filled chunks don't change anymore, so we can read them unlocked
+	vector<uint8_t> compressed;
+	const bool success = (chunk_compression_ == XorCompression) ?
+		xor_compress(chunk.get(), size, compressed) :
+		rle_compress(chunk.get(), size, compressed);
+	if (!success)
+		return;
+
+	compressed.shrink_to_fit();
+
+	lock_guard<recursive_mutex> lock(mutex_);
+
+	shared_ptr<ChunkTable> table = make_shared<ChunkTable>(*chunk_table());
+	if (chunk_num < table->first_chunk)
+		return;
+
+	DataChunk &c = table->chunks[chunk_num - table->first_chunk];
+	if (c.data != chunk)
+		return;
+
+	c.compressed = make_shared< const vector<uint8_t> >(move(compressed));
+	c.data.reset();
+	publish_chunk_table(table);
+
+	memory_account_.add(MemoryAccount::SampleData, -(int64_t)c.size);
+	memory_account_.add(MemoryAccount::CompressedData, c.compressed->size());
+
+	// The uncompressed chunk can serve as cached copy until it's evicted
+	lock_guard<mutex> cache_lock(cache_mutex_);
+	cache_chunk(chunk_num, chunk, c.size, false);
+}
+
+bool Segment::rle_compress(const uint8_t* data, uint64_t size,
+	vector<uint8_t> &dest) const
+{
+	// Each run is stored as run length (LEB128) followed by the sample.
+	// We give up when the data doesn't compress to at least half its size.
+	const uint64_t max_size = size / 2;
+	const uint8_t* const end = data + size;
+
+	dest.clear();
+	dest.reserve(min(max_size, (uint64_t)64 * 1024));
+
+	// Store the uncompressed size first
+	for (unsigned int i = 0; i < sizeof(uint64_t); i++)
+		dest.push_back((size >> (8 * i)) & 0xFF);
+
+	while (data < end) {
+		const uint8_t* run_end = data + unit_size_;
+		while ((run_end < end) && (memcmp(run_end, data, unit_size_) == 0))
+			run_end += unit_size_;
+
+		uint64_t run_length = (run_end - data) / unit_size_;
+		do {
+			const uint8_t byte = run_length & 0x7F;
+			run_length >>= 7;
+			dest.push_back(run_length ? (byte | 0x80) : byte);
+		} while (run_length);
+
+		dest.insert(dest.end(), data, data + unit_size_);
+
+		if (dest.size() > max_size)
+			return false;
+
+		data = run_end;
+	}
+
+	return true;
+}
+
+void Segment::rle_decompress(const vector<uint8_t> &src, uint8_t* dest) const
+{
+	const uint8_t* src_ptr = src.data();
+	const uint8_t* const src_end = src_ptr + src.size();
+
+	src_ptr += sizeof(uint64_t);  // Skip the uncompressed size
+
+	while (src_ptr < src_end) {
+		uint64_t run_length = 0;
+		unsigned int shift = 0;
+		uint8_t byte;
+		do {
+			byte = *src_ptr++;
+			run_length |= (uint64_t)(byte & 0x7F) << shift;
+			shift += 7;
+		} while (byte & 0x80);
+
+		if (unit_size_ == 1) {
+			memset(dest, *src_ptr, run_length);
+			dest += run_length;
+		} else
+			for (uint64_t i = 0; i < run_length; i++) {
+				memcpy(dest, src_ptr, unit_size_);
+				dest += unit_size_;
+			}
+
+		src_ptr += unit_size_;
+	}
+}
+
+bool Segment::xor_compress(const uint8_t* data, uint64_t size,
+	vector<uint8_t> &dest) const
+{
+	// Each sample is XORed with the previous one, as in Facebook's Gorilla.
+	// As slowly changing floats share the sign, the exponent and the upper
+	// bits of the mantissa, mostly a few bits in the middle are left:
+	//   0                   The sample didn't change
+	//   10 <bits>           The bits fit the window of the last 11 code
+	//   11 <5> <5> <bits>   The leading zero count and the bit count minus
+	//                       one of a new window, then its bits
+	// A new window is also started if the current one wastes more bits than
+	// the header of a new one takes, so that it can shrink again.
+	// We give up when the data doesn't compress to at least 7/8 its size.
+	const uint64_t max_size = size - size / 8;
+	const uint64_t count = size / sizeof(uint32_t);
+
+	dest.clear();
+	dest.reserve(min(max_size, (uint64_t)64 * 1024));
+
+	// Store the uncompressed size first
+	for (unsigned int i = 0; i < sizeof(uint64_t); i++)
+		dest.push_back((size >> (8 * i)) & 0xFF);
+
+	uint64_t acc = 0;
+	unsigned int acc_bits = 0;
+	const auto put_bits = [&](uint32_t value, unsigned int bits) {
+		acc = (acc << bits) | value;
+		acc_bits += bits;
+		while (acc_bits >= 8) {
+			acc_bits -= 8;
+			dest.push_back(acc >> acc_bits);
+		}
+	};
+
+	uint32_t prev = 0;
+	unsigned int window_lead = 32, window_trail = 0;
+	for (uint64_t i = 0; i < count; i++, data += sizeof(uint32_t)) {
+		uint32_t sample;
+		memcpy(&sample, data, sizeof(sample));
+		const uint32_t x = sample ^ prev;
+		prev = sample;
+
+		if (!x) {
+			put_bits(0, 1);
+			continue;
+		}
+
+		const unsigned int lead = __builtin_clz(x), trail = __builtin_ctz(x);
+		const unsigned int bits = 32 - lead - trail;
+		const unsigned int window_bits = 32 - window_lead - window_trail;
+		if ((lead >= window_lead) && (trail >= window_trail) &&
+			(window_bits <= bits + 10)) {
+			put_bits(2, 2);
+			put_bits(x >> window_trail, window_bits);
+		} else {
+			put_bits(3, 2);
+			put_bits((lead << 5) | (bits - 1), 10);
+			put_bits(x >> trail, bits);
+			window_lead = lead;
+			window_trail = trail;
+		}
+
+		if (dest.size() > max_size)
+			return false;
+	}
+
+	if (acc_bits > 0)
+		dest.push_back(acc << (8 - acc_bits));
+
+	return dest.size() <= max_size;
+}
+
+void Segment::xor_decompress(const vector<uint8_t> &src, uint8_t* dest) const
+{
+	const uint8_t* src_ptr = src.data();
+	const uint8_t* const src_end = src_ptr + src.size();
+
+	uint64_t size = 0;
+	for (unsigned int i = 0; i < sizeof(uint64_t); i++)
+		size |= (uint64_t)*src_ptr++ << (8 * i);
+	const uint64_t count = size / sizeof(uint32_t);
+
+	// The bits are read from the top of the accumulator, which is refilled
+	// byte by byte. Bytes past the end are read as zeroes.
+	uint64_t acc = 0;
+	unsigned int acc_bits = 0;
+	const auto get_bits = [&](unsigned int bits) {
+		while (acc_bits < bits) {
+			acc |= (uint64_t)((src_ptr < src_end) ? *src_ptr++ : 0) <<
+				(56 - acc_bits);
+			acc_bits += 8;
+		}
+		const uint32_t value = (bits > 0) ? (acc >> (64 - bits)) : 0;
+		acc <<= bits;
+		acc_bits -= bits;
+		return value;
+	};
+
+	uint32_t prev = 0;
+	unsigned int window_lead = 0, window_trail = 0;
+	for (uint64_t i = 0; i < count; i++, dest += sizeof(uint32_t)) {
+		if (get_bits(1)) {
+			if (get_bits(1)) {
+				const uint32_t header = get_bits(10);
+				window_lead = header >> 5;
+				window_trail = 32 - window_lead - ((header & 0x1F) + 1);
+			}
+
+			prev ^= get_bits(32 - window_lead - window_trail) << window_trail;
+		}
+
+		memcpy(dest, &prev, sizeof(prev));
+	}
+}
+
+void Segment::compression_thread_proc()
+{
+	unique_lock<mutex> lock(compression_mutex_);
+
+	while (!compression_queue_.empty()) {
+		const pair<Segment*, uint64_t> job = compression_queue_.front();
+		compression_queue_.pop_front();
+
+		compressing_segment_ = job.first;
+		lock.unlock();
+
+		job.first->compress_chunk(job.second);
+
+		lock.lock();
+		compressing_segment_ = nullptr;
+		compression_cond_.notify_all();
+	}
 
-	return ((chunk_size_ - it->chunk_offs) / unit_size_);
+	compression_thread_running_ = false;
 }
 
 } // namespace data
@@ -22,14 +22,28 @@
 #define PULSEVIEW_PV_DATA_SEGMENT_HPP
 
 #include "pv/util.hpp"
+#include "memorybudget.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include <QObject>
 
+using std::atomic;
+using std::condition_variable;
+using std::deque;
+using std::list;
+using std::mutex;
+using std::pair;
 using std::recursive_mutex;
+using std::shared_ptr;
 using std::vector;
 
 namespace SegmentTest {
@@ -43,22 +57,71 @@ struct MediumSize32Multi;
 struct MaxSize32Multi;
 struct MaxSize32MultiAtOnce;
 struct MaxSize32MultiIterated;
+struct MaxSize32MultiSwapped;
+struct MaxSize8MultiCompressed;
+struct MaxSize32MultiXorCompressed;
+struct MaxSize32PoolReuse;
+struct MaxSize8MultiInPlace;
+struct SmallSize16ManySegments;
+struct MediumSize32Rolling;
+struct MediumSize32RollingReaders;
+struct MediumSize32RollingNumbers;
+struct MediumSize8MemoryAccounting;
+struct MaxSize8CachedChunkAccounting;
+struct MediumSize32Spans;
 }  // namespace SegmentTest
 
 namespace pv {
 namespace data {
 
-typedef struct {
+struct SegmentDataIterator {
 	uint64_t sample_index, chunk_num, chunk_offs;
 	uint8_t* chunk;
-} SegmentDataIterator;
+	shared_ptr<uint8_t> chunk_ref;  ///< Keeps the chunk alive while in use
+};
+
+/**
+ * Samples stored consecutively in one chunk, handed out without copying them.
+ * The chunk is pinned, i.e. kept alive, for as long as the span exists, even
+ * if it is compressed, evicted or the segment is destroyed in the meantime.
+ */
+struct SegmentSpan {
+	const uint8_t* data;
+	uint64_t sample_count;
+	shared_ptr<uint8_t> pin;
+};
 
+/**
+ * Sample storage shared by all segment types.
+ *
+ * Samples are stored in chunks which are published to readers through an
+ * immutable chunk table that is replaced as a whole whenever a chunk is added,
+ * compressed or shrunk. The sample count is published after the samples were
+ * written, so readers may access all samples below get_sample_count() without
+ * taking mutex_, which only serializes writers and the data structures of the
+ * derived classes. Readers hold a reference on the chunks they use, keeping
+ * them alive even if they are replaced in the meantime.
+ */
 class Segment : public QObject
 {
 	Q_OBJECT
 
 private:
 	static const uint64_t MaxChunkSize;
+	static const uint64_t InitialChunkSize;
+
+	/// Chunk capacities are a multiple of this many samples so that the
+	/// sample blocks summarized by the derived classes don't straddle chunks
+	static const uint64_t ChunkSampleAlignment;
+
+	static const unsigned int MaxCachedChunks;
+
+public:
+	enum ChunkCompression {
+		NoCompression,
+		RunLengthCompression,  ///< Runs of identical samples
+		XorCompression         ///< Floats XORed with their predecessors
+	};
 
 public:
 	Segment(uint32_t segment_id, uint64_t samplerate, unsigned int unit_size);
@@ -67,7 +130,11 @@ public:
 
 	uint64_t get_sample_count() const;
 
-	const pv::util::Timestamp& start_time() const;
+	/**
+	 * Returns the time of the first sample held. This advances as old
+	 * samples are evicted, see set_max_sample_count().
+	 */
+	pv::util::Timestamp start_time() const;
 
 	double samplerate() const;
 	void set_samplerate(double samplerate);
@@ -81,9 +148,103 @@ public:
 
 	void free_unused_memory();
 
+	/**
+	 * Limits the number of samples held for rolling captures. Once the
+	 * limit is exceeded, the oldest chunks are evicted, which shifts the
+	 * sample indices and advances start_time() accordingly. Callers that
+	 * keep indices across calls can tell by evicted_sample_count().
+	 * @param max_sample_count The number of samples to keep at least,
+	 *        or 0 to keep all samples.
+	 */
+	void set_max_sample_count(uint64_t max_sample_count);
+	uint64_t max_sample_count() const;
+
+	/// Returns the number of samples evicted from the front of the segment.
+	uint64_t evicted_sample_count() const;
+
+	/**
+	 * Returns the number of the first sample held. Unlike indices, sample
+	 * numbers don't change when older samples are evicted, so they can be
+	 * kept across calls.
+	 */
+	uint64_t first_sample_number() const;
+
+	/// Returns the number the next sample appended will have.
+	uint64_t end_sample_number() const;
+
+	/**
+	 * Numbers the samples as if the given number of samples had been
+	 * evicted before the first one. Must be called before appending.
+	 */
+	void set_first_sample_number(uint64_t number);
+
+	/// Returns the time of sample number 0, which may have been evicted.
+	pv::util::Timestamp origin_time() const;
+
+	/// Returns the number of bytes used by compressed chunks.
+	uint64_t compressed_size() const;
+
+	/// Returns the number of samples held in compressed chunks.
+	uint64_t compressed_sample_count() const;
+
+	/**
+	 * Provides read access to a range of samples without copying them.
+	 * Each span covers the part of the range that is held by one chunk,
+	 * so the spans must be processed in order. Samples past the end are
+	 * returned as zeroes, as with get_raw_samples().
+	 * @param spans Receives the spans, existing elements are removed.
+	 */
+	void get_sample_spans(uint64_t start, uint64_t count,
+		vector<SegmentSpan> &spans) const;
+
+	/**
+	 * Like get_sample_spans(), but addresses the samples by number.
+	 * @return false if some of the samples were evicted already.
+	 */
+	bool get_sample_spans_by_number(uint64_t number, uint64_t count,
+		vector<SegmentSpan> &spans) const;
+
+	/// Returns the number of bytes appended to all segments by copying.
+	static uint64_t copied_byte_count();
+
+	/// Returns the number of bytes written to all segments in place.
+	static uint64_t in_place_byte_count();
+
 protected:
+	/**
+	 * Enables compression of chunks once they are completely filled.
+	 * Must be called before the first chunk is filled. XorCompression
+	 * needs samples of 4 bytes.
+	 */
+	void set_chunk_compression(ChunkCompression compression);
+
+	/**
+	 * Returns an upper bound for sample indices that were valid at any
+	 * earlier call to get_sample_count(), even if samples were evicted
+	 * since then. Only meant for assertions.
+	 */
+	uint64_t sample_count_bound() const;
+
 	void append_single_sample(void *data);
 	void append_samples(void *data, uint64_t samples);
+
+	/**
+	 * Returns the free space of the current chunk so that samples can be
+	 * written to it in place instead of being copied by append_samples().
+	 * The samples must then be appended using commit_appended_samples().
+	 * @param max_count Receives the number of samples that fit.
+	 */
+	uint8_t* get_append_buffer(uint64_t &max_count);
+	void commit_appended_samples(uint64_t count);
+
+	/**
+	 * Evicts the oldest chunks if more samples than allowed are held.
+	 * Called by the derived classes after appending so that they can
+	 * trim their own data structures accordingly.
+	 * @return The number of samples evicted, a multiple of
+	 *         ChunkSampleAlignment.
+	 */
+	uint64_t evict_old_chunks();
 	void get_raw_samples(uint64_t start, uint64_t count, uint8_t *dest) const;
 
 	SegmentDataIterator* begin_sample_iteration(uint64_t start);
@@ -92,19 +253,113 @@ protected:
 	uint8_t* get_iterator_value(SegmentDataIterator* it);
 	uint64_t get_iterator_valid_length(SegmentDataIterator* it);
 
+private:
+	struct DataChunk
+	{
+		shared_ptr<uint8_t> data;  ///< Null if the chunk is compressed
+		shared_ptr< const vector<uint8_t> > compressed;
+		uint64_t size;  ///< Number of bytes allocated for data
+	};
+
+	/**
+	 * The chunks held at some point in time. Evicting chunks publishes a
+	 * new table, so a table also determines which sample an index refers
+	 * to. Readers take both the sample count and the index base from the
+	 * same table for that reason.
+	 */
+	struct ChunkTable
+	{
+		/// Number of the first chunk held, all chunks before it were evicted
+		uint64_t first_chunk;
+		/// Index base, the number of samples evicted before the first chunk
+		uint64_t first_sample;
+		vector<DataChunk> chunks;
+	};
+
+	struct CachedChunk
+	{
+		uint64_t chunk_num;
+		shared_ptr<uint8_t> data;
+		uint64_t size;  ///< Number of bytes allocated for data
+	};
+
+	/// Returns the number of samples that fit into the given chunk.
+	uint64_t chunk_capacity(uint64_t chunk_num) const;
+	uint64_t chunk_start_sample(uint64_t chunk_num) const;
+	uint64_t chunk_of_sample(uint64_t sample) const;
+
+	/**
+	 * Allocates a chunk of the given size. Chunks that aren't reusable,
+	 * e.g. trimmed ones, are freed instead of being pooled when released.
+	 */
+	shared_ptr<uint8_t> allocate_chunk(uint64_t size,
+		bool reusable = true) const;
+	void start_new_chunk();
+
+	shared_ptr<const ChunkTable> chunk_table() const;
+	void publish_chunk_table(shared_ptr<const ChunkTable> table);
+
+	/// Fills spans with the samples from sample on, not relative to the
+	/// index base of the table
+	void fill_sample_spans(const ChunkTable &table, uint64_t sample,
+		uint64_t count, vector<SegmentSpan> &spans) const;
+
+	shared_ptr<uint8_t> get_chunk(const ChunkTable &table,
+		uint64_t chunk_num) const;
+	void cache_chunk(uint64_t chunk_num, shared_ptr<uint8_t> data,
+		uint64_t size, bool most_recent) const;
+	void trim_chunk_cache() const;
+
+	void queue_chunk_compression(uint64_t chunk_num);
+	void compress_chunk(uint64_t chunk_num);
+
+	bool rle_compress(const uint8_t* data, uint64_t size,
+		vector<uint8_t> &dest) const;
+	void rle_decompress(const vector<uint8_t> &src, uint8_t* dest) const;
+
+	bool xor_compress(const uint8_t* data, uint64_t size,
+		vector<uint8_t> &dest) const;
+	void xor_decompress(const vector<uint8_t> &src, uint8_t* dest) const;
+
+	static void compression_thread_proc();
+
+protected:
 	uint32_t segment_id_;
 	mutable recursive_mutex mutex_;
-	vector<uint8_t*> data_chunks_;
 	uint8_t* current_chunk_;
 	uint64_t used_samples_, unused_samples_;
-	uint64_t sample_count_;
+	/// Number of samples ever appended, including the evicted ones
+	atomic<uint64_t> appended_sample_count_;
+	/// Number of the first sample ever appended
+	uint64_t sample_number_base_;
 	pv::util::Timestamp start_time_;
 	double samplerate_;
-	uint64_t chunk_size_;
+	uint64_t max_sample_count_;
+	uint64_t first_chunk_samples_, max_chunk_samples_;
+	uint64_t growth_chunk_count_, growth_sample_count_;
 	unsigned int unit_size_;
-	int iterator_count_;
-	bool mem_optimization_requested_;
 	bool is_complete_;
+	const bool swap_backed_;
+	/// Mutable as the chunks decompressed by readers are accounted for, too
+	mutable MemoryAccount memory_account_;
+
+private:
+	ChunkCompression chunk_compression_;
+
+	/// Only accessed through chunk_table() and publish_chunk_table()
+	shared_ptr<const ChunkTable> chunk_table_;
+
+	/// Decompressed chunks, most recently used first
+	mutable mutex cache_mutex_;
+	mutable list<CachedChunk> chunk_cache_;
+
+	static mutex compression_mutex_;
+	static condition_variable compression_cond_;
+	static deque< pair<Segment*, uint64_t> > compression_queue_;
+	static Segment* compressing_segment_;
+	static bool compression_thread_running_;
+
+	static atomic<uint64_t> copied_bytes_, in_place_bytes_;
 
 	friend struct SegmentTest::SmallSize8Single;
 	friend struct SegmentTest::MediumSize8Single;
@@ -116,6 +371,18 @@ protected:
 	friend struct SegmentTest::MaxSize32Multi;
 	friend struct SegmentTest::MaxSize32MultiAtOnce;
 	friend struct SegmentTest::MaxSize32MultiIterated;
+	friend struct SegmentTest::MaxSize32MultiSwapped;
+	friend struct SegmentTest::MaxSize8MultiCompressed;
+	friend struct SegmentTest::MaxSize32MultiXorCompressed;
+	friend struct SegmentTest::MaxSize32PoolReuse;
+	friend struct SegmentTest::MaxSize8MultiInPlace;
+	friend struct SegmentTest::SmallSize16ManySegments;
+	friend struct SegmentTest::MediumSize32Rolling;
+	friend struct SegmentTest::MediumSize32RollingReaders;
+	friend struct SegmentTest::MediumSize32RollingNumbers;
+	friend struct SegmentTest::MediumSize8MemoryAccounting;
+	friend struct SegmentTest::MaxSize8CachedChunkAccounting;
+	friend struct SegmentTest::MediumSize32Spans;
 };
 
 } // namespace data
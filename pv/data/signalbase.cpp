@@ -33,6 +33,7 @@
 
 using std::dynamic_pointer_cast;
 using std::make_shared;
+using std::min;
 using std::out_of_range;
 using std::shared_ptr;
 using std::tie;
@@ -265,6 +266,46 @@ bool SignalBase::has_samples() const
 	return result;
 }
 
+uint64_t SignalBase::get_memory_usage(MemoryAccount::Category category) const
+{
+	uint64_t usage = 0;
+
+	if (data_)
+		usage += MemoryBudget::usage(data_.get(), category);
+
+	if (converted_data_)
+		usage += MemoryBudget::usage(converted_data_.get(), category);
+
+	return usage;
+}
+
+uint64_t SignalBase::get_deferred_memory(MemoryAccount::Category category) const
+{
+	uint64_t deferred = 0;
+
+	if (data_)
+		deferred += MemoryBudget::deferred(data_.get(), category);
+
+	if (converted_data_)
+		deferred += MemoryBudget::deferred(converted_data_.get(), category);
+
+	return deferred;
+}
+
+double SignalBase::get_compression_ratio() const
+{
+	if (!data_)
+		return 0;
+
+	uint64_t size = 0, compressed_size = 0;
+	for (const shared_ptr<Segment>& segment : data_->segments()) {
+		size += segment->compressed_sample_count() * segment->unit_size();
+		compressed_size += segment->compressed_size();
+	}
+
+	return compressed_size ? ((double)size / compressed_size) : 0;
+}
+
 double SignalBase::get_samplerate() const
 {
 	if (channel_type_ == AnalogChannel)
@@ -512,11 +553,13 @@ bool SignalBase::conversion_is_a2l() const
 void SignalBase::convert_single_segment_range(AnalogSegment *asegment,
 	LogicSegment *lsegment, uint64_t start_sample, uint64_t end_sample)
 {
+	if ((conversion_type_ != A2LConversionByThreshold) &&
+		(conversion_type_ != A2LConversionBySchmittTrigger))
+		return;
+
 	if (end_sample > start_sample) {
 		tie(min_value_, max_value_) = asegment->get_min_max();
 
-		// Create sigrok::Analog instance
-		float *asamples = new float[ConversionBlockSize];
 		uint8_t *lsamples = new uint8_t[ConversionBlockSize];
 
 		vector<shared_ptr<sigrok::Channel> > channels;
@@ -526,83 +569,56 @@ void SignalBase::convert_single_segment_range(AnalogSegment *asegment,
 		const sigrok::Quantity * const mq = sigrok::Quantity::VOLTAGE;
 		const sigrok::Unit * const unit = sigrok::Unit::VOLT;
 
-		shared_ptr<sigrok::Packet> packet =
-			Session::sr_context->create_analog_packet(channels,
-			asamples, ConversionBlockSize, mq, unit, mq_flags);
-
-		shared_ptr<sigrok::Analog> analog =
-			dynamic_pointer_cast<sigrok::Analog>(packet->payload());
+		const vector<double> thresholds = get_conversion_thresholds();
+		uint8_t state = 0;  // TODO Use value of logic sample n-1 instead of 0
 
-		// Convert
+		// Convert the analog samples right from the segment's chunks. Quantized
+		// samples are converted to floats for it, so they're read piece by piece.
+		vector<SegmentSpan> spans;
 		uint64_t i = start_sample;
-
-		if (conversion_type_ == A2LConversionByThreshold) {
-			const double threshold = get_conversion_thresholds()[0];
-
-			// Convert as many sample blocks as we can
-			while ((end_sample - i) > ConversionBlockSize) {
-				asegment->get_samples(i, i + ConversionBlockSize, asamples);
-
-				shared_ptr<sigrok::Logic> logic =
-					analog->get_logic_via_threshold(threshold, lsamples);
-
-				lsegment->append_payload(logic->data_pointer(), logic->data_length());
-				samples_added(lsegment->segment_id(), i, i + ConversionBlockSize);
-				i += ConversionBlockSize;
+		while (i < end_sample) {
+			asegment->get_float_spans(i,
+				min(end_sample - i, ConversionBlockSize * 256), spans);
+
+			for (const SegmentSpan &span : spans) {
+				float *asamples = (float*)span.data;
+
+				for (uint64_t offs = 0; offs < span.sample_count;) {
+					const uint64_t count =
+						min(span.sample_count - offs, ConversionBlockSize);
+
+					// Create sigrok::Analog instance
+					shared_ptr<sigrok::Packet> packet =
+						Session::sr_context->create_analog_packet(channels,
+						asamples + offs, count, mq, unit, mq_flags);
+
+					shared_ptr<sigrok::Analog> analog =
+						dynamic_pointer_cast<sigrok::Analog>(packet->payload());
+
+					// Convert straight into the logic segment if it has room
+					uint8_t *lbuffer = lsegment->get_payload_buffer(count);
+
+					shared_ptr<sigrok::Logic> logic;
+					if (conversion_type_ == A2LConversionByThreshold)
+						logic = analog->get_logic_via_threshold(thresholds[0],
+							lbuffer ? lbuffer : lsamples);
+					else
+						logic = analog->get_logic_via_schmitt_trigger(thresholds[0],
+							thresholds[1], &state, lbuffer ? lbuffer : lsamples);
+
+					if (lbuffer)
+						lsegment->commit_payload_buffer(count);
+					else
+						lsegment->append_payload(logic->data_pointer(), logic->data_length());
+					samples_added(lsegment->segment_id(), i, i + count);
+
+					offs += count;
+					i += count;
+				}
 			}
-
-			// Re-create sigrok::Analog and convert remaining samples
-			packet = Session::sr_context->create_analog_packet(channels,
-				asamples, end_sample - i, mq, unit, mq_flags);
-
-			analog = dynamic_pointer_cast<sigrok::Analog>(packet->payload());
-
-			asegment->get_samples(i, end_sample, asamples);
-			shared_ptr<sigrok::Logic> logic =
-				analog->get_logic_via_threshold(threshold, lsamples);
-			lsegment->append_payload(logic->data_pointer(), logic->data_length());
-			samples_added(lsegment->segment_id(), i, end_sample);
 		}
 
-		if (conversion_type_ == A2LConversionBySchmittTrigger) {
-			const vector<double> thresholds = get_conversion_thresholds();
-			const double lo_thr = thresholds[0];
-			const double hi_thr = thresholds[1];
-
-			uint8_t state = 0;  // TODO Use value of logic sample n-1 instead of 0
-
-			// Convert as many sample blocks as we can
-			while ((end_sample - i) > ConversionBlockSize) {
-				asegment->get_samples(i, i + ConversionBlockSize, asamples);
-
-				shared_ptr<sigrok::Logic> logic =
-					analog->get_logic_via_schmitt_trigger(lo_thr, hi_thr,
-						&state, lsamples);
-
-				lsegment->append_payload(logic->data_pointer(), logic->data_length());
-				samples_added(lsegment->segment_id(), i, i + ConversionBlockSize);
-				i += ConversionBlockSize;
-			}
-
-			// Re-create sigrok::Analog and convert remaining samples
-			packet = Session::sr_context->create_analog_packet(channels,
-				asamples, end_sample - i, mq, unit, mq_flags);
-
-			analog = dynamic_pointer_cast<sigrok::Analog>(packet->payload());
-
-			asegment->get_samples(i, end_sample, asamples);
-			shared_ptr<sigrok::Logic> logic =
-				analog->get_logic_via_schmitt_trigger(lo_thr, hi_thr,
-					&state, lsamples);
-			lsegment->append_payload(logic->data_pointer(), logic->data_length());
-			samples_added(lsegment->segment_id(), i, end_sample);
-		}
-
-		// If acquisition is ongoing, start-/endsample may have changed
-		end_sample = asegment->get_sample_count();
-
 		delete[] lsamples;
-		delete[] asamples;
 	}
 }
 
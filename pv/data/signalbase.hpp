@@ -35,6 +35,8 @@
 
 #include <libsigrokcxx/libsigrokcxx.hpp>
 
+#include "memorybudget.hpp"
+
 using std::atomic;
 using std::condition_variable;
 using std::map;
@@ -192,6 +194,25 @@ public:
 	 */
 	bool has_samples() const;
 
+	/**
+	 * Returns the number of bytes used for the sample data of this signal
+	 * and the data derived from it. Note that all logic channels of a
+	 * device share the same sample data.
+	 */
+	virtual uint64_t get_memory_usage(MemoryAccount::Category category) const;
+
+	/**
+	 * Returns the number of bytes of mip-maps and the like that would be
+	 * in use if they weren't built on demand.
+	 */
+	uint64_t get_deferred_memory(MemoryAccount::Category category) const;
+
+	/**
+	 * Returns by which factor the compressed chunks of the sample data
+	 * shrank, or 0 if no chunks are compressed.
+	 */
+	double get_compression_ratio() const;
+
 	/**
 	 * Returns the sample rate for this signal.
 	 */
@@ -0,0 +1,295 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2026 The PulseView developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h" // For HAVE_MMAP
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <QDebug>
+#include <QDir>
+
+#include "swapfile.hpp"
+
+using std::atomic_load;
+using std::atomic_store;
+using std::bad_alloc;
+using std::lock_guard;
+using std::make_shared;
+using std::memory_order_acquire;
+using std::memory_order_relaxed;
+using std::mutex;
+using std::pair;
+using std::sort;
+
+namespace pv {
+namespace data {
+
+const uint64_t SwapFile::SlotSize = 16 * 1024 * 1024;  /* 16MiB */
+const uint64_t SwapFile::DefaultHotBudget = 512 * 1024 * 1024;  /* 512MiB */
+
+mutex SwapFile::mutex_;
+bool SwapFile::enabled_ = false;
+QString SwapFile::directory_;
+uint64_t SwapFile::hot_budget_ = SwapFile::DefaultHotBudget;
+int SwapFile::fd_ = -1;
+uint64_t SwapFile::slot_count_ = 0;
+vector<uint64_t> SwapFile::free_slots_;
+map<const uint8_t*, SwapFile::MappedChunk> SwapFile::chunks_;
+uint64_t SwapFile::mapped_size_ = 0;
+shared_ptr<const SwapFile::ChunkIndex> SwapFile::index_ =
+	make_shared<const SwapFile::ChunkIndex>();
+atomic<uint64_t> SwapFile::access_epoch_(0);
+atomic<uint64_t> SwapFile::resident_size_(0);
+
+void SwapFile::configure(bool enabled, const QString &directory,
+	uint64_t hot_budget)
+{
+	lock_guard<mutex> lock(mutex_);
+
+#ifndef HAVE_MMAP
+	if (enabled)
+		qWarning() << "Disk-backed sample storage is not supported on this platform";
+	enabled = false;
+#endif
+
+	enabled_ = enabled;
+	hot_budget_ = hot_budget;
+
+	// A new directory only takes effect if the file wasn't created yet
+	directory_ = directory;
+
+	evict_cold_chunks(nullptr);
+}
+
+bool SwapFile::enabled()
+{
+	lock_guard<mutex> lock(mutex_);
+	return enabled_;
+}
+
+uint8_t* SwapFile::allocate_chunk(uint64_t size)
+{
+	assert(size <= SlotSize);
+
+	lock_guard<mutex> lock(mutex_);
+
+#ifdef HAVE_MMAP
+	if (!open_file())
+		throw bad_alloc();
+
+	uint64_t slot;
+	if (!free_slots_.empty()) {
+		slot = free_slots_.back();
+		free_slots_.pop_back();
+	} else {
+		// Grow the file by one slot; this doesn't allocate any disk
+		// space as the file is sparse
+		if (ftruncate(fd_, (slot_count_ + 1) * SlotSize) != 0) {
+			qWarning() << "Failed to grow swap file:" << strerror(errno);
+			throw bad_alloc();
+		}
+		slot = slot_count_++;
+	}
+
+	void* chunk = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		fd_, slot * SlotSize);
+	if (chunk == MAP_FAILED) {
+		free_slots_.push_back(slot);
+		throw bad_alloc();
+	}
+
+	MappedChunk &c = chunks_[(const uint8_t*)chunk];
+	c.slot = slot;
+	c.length = size;
+	c.resident = true;
+	c.last_access = ++access_epoch_;
+	publish_index();
+
+	mapped_size_ += size;
+	resident_size_ += size;
+
+	evict_cold_chunks((const uint8_t*)chunk);
+
+	return (uint8_t*)chunk;
+#else
+	(void)size;
+	throw bad_alloc();
+#endif
+}
+
+void SwapFile::release_chunk(uint8_t* chunk)
+{
+	lock_guard<mutex> lock(mutex_);
+
+	const auto it = chunks_.find(chunk);
+	assert(it != chunks_.end());
+	if (it == chunks_.end())
+		return;
+
+	const MappedChunk &c = it->second;
+
+#ifdef HAVE_MMAP
+	munmap(chunk, c.length);
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+	// Give the disk space back, the slot will be reused later
+	fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		c.slot * SlotSize, SlotSize);
+#endif
+#endif
+
+	mapped_size_ -= c.length;
+	if (c.resident)
+		resident_size_ -= c.length;
+
+	free_slots_.push_back(c.slot);
+	chunks_.erase(it);
+	publish_index();
+}
+
+void SwapFile::mark_hot(const uint8_t* chunk)
+{
+	// The caller holds a reference to the chunk, so its state stays alive
+	const shared_ptr<const ChunkIndex> index = atomic_load(&index_);
+	const auto it = index->find(chunk);
+	if (it == index->end())
+		return;
+
+	MappedChunk &c = *it->second;
+	c.last_access.store(access_epoch_.load(memory_order_relaxed),
+		memory_order_relaxed);
+	if (c.resident.load(memory_order_acquire))
+		return;
+
+	// The kernel faults the pages back in on access, we only need to
+	// keep track of them
+	lock_guard<mutex> lock(mutex_);
+
+	if (!c.resident.exchange(true)) {
+		c.last_access = ++access_epoch_;
+		resident_size_ += c.length;
+		evict_cold_chunks(chunk);
+	}
+}
+
+uint64_t SwapFile::mapped_size()
+{
+	lock_guard<mutex> lock(mutex_);
+	return mapped_size_;
+}
+
+uint64_t SwapFile::resident_size()
+{
+	return resident_size_;
+}
+
+bool SwapFile::open_file()
+{
+#ifdef HAVE_MMAP
+	if (fd_ >= 0)
+		return true;
+
+	const QString dir = directory_.isEmpty() ? QDir::tempPath() : directory_;
+	QByteArray path = QDir(dir).filePath("pulseview-XXXXXX").toLocal8Bit();
+
+	fd_ = mkstemp(path.data());
+	if (fd_ < 0) {
+		qWarning() << "Failed to create swap file in" << dir << ":" <<
+			strerror(errno);
+		return false;
+	}
+
+	// Remove the directory entry right away so that the file vanishes
+	// once we close it or terminate, even if we crash
+	unlink(path.constData());
+
+	qDebug() << "Using swap file for sample data in" << dir;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void SwapFile::publish_index()
+{
+	shared_ptr<ChunkIndex> index = make_shared<ChunkIndex>();
+	for (auto &entry : chunks_)
+		index->emplace_hint(index->end(), entry.first, &entry.second);
+
+	atomic_store(&index_, shared_ptr<const ChunkIndex>(index));
+}
+
+void SwapFile::evict_cold_chunks(const uint8_t* keep)
+{
+	if (resident_size_ <= hot_budget_)
+		return;
+
+	// Least recently used first. The given chunk is about to be accessed.
+	vector< pair<uint64_t, const uint8_t*> > resident;
+	for (const auto &entry : chunks_)
+		if (entry.second.resident && (entry.first != keep))
+			resident.emplace_back(entry.second.last_access, entry.first);
+	sort(resident.begin(), resident.end());
+
+	for (auto it = resident.begin();
+			(resident_size_ > hot_budget_) && (it != resident.end()); it++) {
+		MappedChunk &c = chunks_[it->second];
+		if (!c.resident.exchange(false))
+			continue;
+
+#ifdef HAVE_MMAP
+		void* const addr = (void*)it->second;
+
+		// Dropping the pages of a shared file mapping only unmaps them,
+		// they stay in the page cache until they're written to the file.
+		// So we have them written right away, which lets the kernel
+		// reclaim them.
+#ifdef MADV_PAGEOUT
+		if (madvise(addr, c.length, MADV_PAGEOUT) != 0)
+#endif
+		{
+#ifdef SYNC_FILE_RANGE_WRITE
+			sync_file_range(fd_, c.slot * SlotSize, c.length, SYNC_FILE_RANGE_WRITE);
+#else
+			msync(addr, c.length, MS_ASYNC);
+#endif
+			madvise(addr, c.length, MADV_DONTNEED);
+#ifdef POSIX_FADV_DONTNEED
+			posix_fadvise(fd_, c.slot * SlotSize, c.length, POSIX_FADV_DONTNEED);
+#endif
+		}
+#endif
+
+		resident_size_ -= c.length;
+	}
+}
+
+} // namespace data
+} // namespace pv
@@ -0,0 +1,143 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2026 The PulseView developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULSEVIEW_PV_DATA_SWAPFILE_HPP
+#define PULSEVIEW_PV_DATA_SWAPFILE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <QString>
+
+using std::atomic;
+using std::map;
+using std::mutex;
+using std::shared_ptr;
+using std::vector;
+
+namespace pv {
+namespace data {
+
+/**
+ * Process-wide backing store for segment data chunks.
+ *
+ * When enabled, chunks are not allocated on the heap but are memory-mapped
+ * from a single sparse, already unlinked temporary file. Every chunk gets a
+ * fixed-size slot in that file so that slots of released chunks can be
+ * reused without fragmenting the file.
+ *
+ * Only the most recently used chunks are kept resident up to a configurable
+ * budget; all other chunks are handed back to the kernel, which writes them
+ * out to the file and faults them back in transparently when accessed again.
+ * Chunk pointers therefore stay valid for the entire lifetime of a chunk.
+ *
+ * Accesses to resident chunks don't take a lock. They only note the current
+ * access epoch in the chunk, which the eviction uses to find the least
+ * recently used chunks.
+ */
+class SwapFile
+{
+public:
+	/// Size of one slot in the swap file. Chunks must not be larger.
+	static const uint64_t SlotSize;
+
+	/// Default amount of chunk memory to keep resident.
+	static const uint64_t DefaultHotBudget;
+
+public:
+	/**
+	 * Configures the use of the swap file for chunks that are allocated
+	 * from now on. Chunks that were already allocated are not affected.
+	 * @param enabled Whether new chunks should be backed by the swap file.
+	 * @param directory The directory to create the swap file in. If empty,
+	 *        the system's temporary directory is used.
+	 * @param hot_budget The number of bytes of chunk data to keep resident.
+	 */
+	static void configure(bool enabled, const QString &directory,
+		uint64_t hot_budget);
+
+	static bool enabled();
+
+	/**
+	 * Maps a new chunk of the given size.
+	 * @throws std::bad_alloc if the chunk could not be mapped.
+	 */
+	static uint8_t* allocate_chunk(uint64_t size);
+
+	static void release_chunk(uint8_t* chunk);
+
+	/**
+	 * Informs the swap file that the given chunk is about to be accessed.
+	 * If its pages were handed back to the kernel, the least recently used
+	 * chunks are evicted from memory in turn.
+	 */
+	static void mark_hot(const uint8_t* chunk);
+
+	/// Returns the number of bytes of chunk data currently mapped.
+	static uint64_t mapped_size();
+
+	/// Returns the number of bytes of chunk data currently kept resident.
+	static uint64_t resident_size();
+
+private:
+	struct MappedChunk
+	{
+		uint64_t slot;
+		uint64_t length;
+		atomic<bool> resident;
+		atomic<uint64_t> last_access;  ///< Access epoch of the last access
+	};
+
+	/// Maps chunk pointers to their state, replaced as a whole when it changes
+	typedef map<const uint8_t*, MappedChunk*> ChunkIndex;
+
+	static bool open_file();
+	static void publish_index();
+
+	/// Evicts the least recently used chunks except for the given one.
+	static void evict_cold_chunks(const uint8_t* keep);
+
+private:
+	static mutex mutex_;
+
+	static bool enabled_;
+	static QString directory_;
+	static uint64_t hot_budget_;
+
+	static int fd_;
+	static uint64_t slot_count_;
+	static vector<uint64_t> free_slots_;
+
+	static map<const uint8_t*, MappedChunk> chunks_;
+	static uint64_t mapped_size_;
+
+	/// Only accessed through atomic_load() and atomic_store()
+	static shared_ptr<const ChunkIndex> index_;
+	static atomic<uint64_t> access_epoch_;
+	static atomic<uint64_t> resident_size_;
+};
+
+} // namespace data
+} // namespace pv
+
+#endif // PULSEVIEW_PV_DATA_SWAPFILE_HPP
@@ -24,6 +24,7 @@
 #include <QApplication>
 #include <QComboBox>
 #include <QDialogButtonBox>
+#include <QDir>
 #include <QFileDialog>
 #include <QFormLayout>
 #include <QGroupBox>
@@ -44,6 +45,7 @@
 #include "settings.hpp"
 
 #include "pv/application.hpp"
+#include "pv/data/memorybudget.hpp"
 #include "pv/devicemanager.hpp"
 #include "pv/globalsettings.hpp"
 #include "pv/logging.hpp"
@@ -276,6 +278,78 @@ QWidget *Settings::get_general_settings_form(QWidget *parent) const
 		SLOT(on_general_save_with_setup_changed(int)));
 	general_layout->addRow(tr("Save session &setup along with .sr file"), cb);
 
+	// Sample memory settings
+	QGroupBox *mem_group = new QGroupBox(tr("Sample Memory"));
+	form_layout->addWidget(mem_group);
+
+	QFormLayout *mem_layout = new QFormLayout();
+	mem_group->setLayout(mem_layout);
+
+	cb = create_checkbox(GlobalSettings::Key_Mem_DiskBacking,
+		SLOT(on_mem_diskBacking_changed(int)));
+	mem_layout->addRow(tr("Store sample data in a temporary file on &disk"), cb);
+
+	QSpinBox *hot_budget_sb = new QSpinBox();
+	hot_budget_sb->setRange(16, 1024 * 1024);
+	hot_budget_sb->setSingleStep(64);
+	hot_budget_sb->setSuffix(tr(" MiB"));
+	hot_budget_sb->setValue(
+		settings.value(GlobalSettings::Key_Mem_HotChunkBudget).toInt());
+	connect(hot_budget_sb, SIGNAL(valueChanged(int)), this,
+		SLOT(on_mem_hotChunkBudget_changed(int)));
+	mem_layout->addRow(tr("Amount of disk-backed sample data to keep in RAM"), hot_budget_sb);
+
+	QLineEdit *swap_directory_le = new QLineEdit();
+	swap_directory_le->setPlaceholderText(QDir::tempPath());
+	swap_directory_le->setText(
+		settings.value(GlobalSettings::Key_Mem_SwapDirectory).toString());
+	connect(swap_directory_le, SIGNAL(textChanged(const QString&)),
+		this, SLOT(on_mem_swapDirectory_changed(const QString&)));
+	mem_layout->addRow(tr("Directory of the temporary file"), swap_directory_le);
+
+	cb = create_checkbox(GlobalSettings::Key_Mem_CompressLogic,
+		SLOT(on_mem_compressLogic_changed(int)));
+	mem_layout->addRow(tr("&Compress logic data in the background"), cb);
+
+	cb = create_checkbox(GlobalSettings::Key_Mem_BitPlanes,
+		SLOT(on_mem_bitPlanes_changed(int)));
+	mem_layout->addRow(tr("Keep per-channel copies of logic data for faster &edge search"), cb);
+
+	cb = create_checkbox(GlobalSettings::Key_Mem_QuantizeAnalog,
+		SLOT(on_mem_quantizeAnalog_changed(int)));
+	mem_layout->addRow(tr("Keep analog data of ADCs as &integers"), cb);
+
+	cb = create_checkbox(GlobalSettings::Key_Mem_CompressAnalog,
+		SLOT(on_mem_compressAnalog_changed(int)));
+	mem_layout->addRow(tr("Compress &float analog data in the background"), cb);
+
+	cb = create_checkbox(GlobalSettings::Key_Mem_RollingCapture,
+		SLOT(on_mem_rollingCapture_changed(int)));
+	mem_layout->addRow(tr("Only keep the most recent samples (&rolling capture)"), cb);
+
+	QSpinBox *rolling_window_sb = new QSpinBox();
+	rolling_window_sb->setRange(1, 7 * 24 * 60 * 60);
+	rolling_window_sb->setSuffix(tr(" s"));
+	rolling_window_sb->setValue(
+		settings.value(GlobalSettings::Key_Mem_RollingWindow).toInt());
+	connect(rolling_window_sb, SIGNAL(valueChanged(int)), this,
+		SLOT(on_mem_rollingWindow_changed(int)));
+	mem_layout->addRow(tr("Duration of a rolling capture"), rolling_window_sb);
+
+	QSpinBox *budget_sb = new QSpinBox();
+	budget_sb->setRange(0, 1024 * 1024);
+	budget_sb->setSingleStep(256);
+	budget_sb->setSuffix(tr(" MiB"));
+	budget_sb->setSpecialValueText(tr("Unlimited"));
+	budget_sb->setValue(settings.value(GlobalSettings::Key_Mem_Budget).toInt());
+	connect(budget_sb, SIGNAL(valueChanged(int)), this,
+		SLOT(on_mem_budget_changed(int)));
+	mem_layout->addRow(tr("Memory budget for sample data, decoders included"), budget_sb);
+
+	QLabel *description_3 = new QLabel(tr("(Takes effect with the next acquisition)"));
+	description_3->setAlignment(Qt::AlignRight);
+	mem_layout->addRow(description_3);
+
 	return form;
 }
 
@@ -663,6 +737,69 @@ void Settings::on_general_save_with_setup_changed(int state)
 	settings.setValue(GlobalSettings::Key_General_SaveWithSetup, state ? true : false);
 }
 
+void Settings::on_mem_diskBacking_changed(int state)
+{
+	GlobalSettings settings;
+	settings.setValue(GlobalSettings::Key_Mem_DiskBacking, state ? true : false);
+}
+
+void Settings::on_mem_hotChunkBudget_changed(int value)
+{
+	GlobalSettings settings;
+	settings.setValue(GlobalSettings::Key_Mem_HotChunkBudget, value);
+}
+
+void Settings::on_mem_swapDirectory_changed(const QString &text)
+{
+	GlobalSettings settings;
+	settings.setValue(GlobalSettings::Key_Mem_SwapDirectory, text);
+}
+
+void Settings::on_mem_compressLogic_changed(int state)
+{
+	GlobalSettings settings;
+	settings.setValue(GlobalSettings::Key_Mem_CompressLogic, state ? true : false);
+}
+
+void Settings::on_mem_bitPlanes_changed(int state)
+{
+	GlobalSettings settings;
+	settings.setValue(GlobalSettings::Key_Mem_BitPlanes, state ? true : false);
+}
+
+void Settings::on_mem_quantizeAnalog_changed(int state)
+{
+	GlobalSettings settings;
+	settings.setValue(GlobalSettings::Key_Mem_QuantizeAnalog, state ? true : false);
+}
+
+void Settings::on_mem_compressAnalog_changed(int state)
+{
+	GlobalSettings settings;
+	settings.setValue(GlobalSettings::Key_Mem_CompressAnalog, state ? true : false);
+}
+
+void Settings::on_mem_rollingCapture_changed(int state)
+{
+	GlobalSettings settings;
+	settings.setValue(GlobalSettings::Key_Mem_RollingCapture, state ? true : false);
+}
+
+void Settings::on_mem_rollingWindow_changed(int value)
+{
+	GlobalSettings settings;
+	settings.setValue(GlobalSettings::Key_Mem_RollingWindow, value);
+}
+
+void Settings::on_mem_budget_changed(int value)
+{
+	GlobalSettings settings;
+	settings.setValue(GlobalSettings::Key_Mem_Budget, value);
+
+	// Decoders started from now on are subject to the new budget
+	pv::data::MemoryBudget::set_budget((uint64_t)value * 1024 * 1024);
+}
+
 void Settings::on_view_zoomToFitDuringAcq_changed(int state)
 {
 	GlobalSettings settings;
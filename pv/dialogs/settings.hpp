@@ -62,6 +62,16 @@ private Q_SLOTS:
 	void on_general_theme_changed(int value);
 	void on_general_style_changed(int value);
 	void on_general_save_with_setup_changed(int state);
+	void on_mem_diskBacking_changed(int state);
+	void on_mem_hotChunkBudget_changed(int value);
+	void on_mem_swapDirectory_changed(const QString &text);
+	void on_mem_compressLogic_changed(int state);
+	void on_mem_rollingCapture_changed(int state);
+	void on_mem_rollingWindow_changed(int value);
+	void on_mem_budget_changed(int value);
+	void on_mem_bitPlanes_changed(int state);
+	void on_mem_quantizeAnalog_changed(int state);
+	void on_mem_compressAnalog_changed(int state);
 	void on_view_zoomToFitDuringAcq_changed(int state);
 	void on_view_zoomToFitAfterAcq_changed(int state);
 	void on_view_triggerIsZero_changed(int state);
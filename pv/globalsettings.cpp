@@ -73,6 +73,16 @@ const QString GlobalSettings::Key_View_CursorShowSamples = "View_CursorShowSampl
 const QString GlobalSettings::Key_Dec_InitialStateConfigurable = "Dec_InitialStateConfigurable";
 const QString GlobalSettings::Key_Dec_ExportFormat = "Dec_ExportFormat";
 const QString GlobalSettings::Key_Dec_AlwaysShowAllRows = "Dec_AlwaysShowAllRows";
+const QString GlobalSettings::Key_Mem_DiskBacking = "Mem_DiskBacking";
+const QString GlobalSettings::Key_Mem_HotChunkBudget = "Mem_HotChunkBudget";
+const QString GlobalSettings::Key_Mem_SwapDirectory = "Mem_SwapDirectory";
+const QString GlobalSettings::Key_Mem_CompressLogic = "Mem_CompressLogic";
+const QString GlobalSettings::Key_Mem_RollingCapture = "Mem_RollingCapture";
+const QString GlobalSettings::Key_Mem_RollingWindow = "Mem_RollingWindow";
+const QString GlobalSettings::Key_Mem_Budget = "Mem_Budget";
+const QString GlobalSettings::Key_Mem_BitPlanes = "Mem_BitPlanes";
+const QString GlobalSettings::Key_Mem_QuantizeAnalog = "Mem_QuantizeAnalog";
+const QString GlobalSettings::Key_Mem_CompressAnalog = "Mem_CompressAnalog";
 const QString GlobalSettings::Key_Log_BufferSize = "Log_BufferSize";
 const QString GlobalSettings::Key_Log_NotifyOfStacktrace = "Log_NotifyOfStacktrace";
 
@@ -160,6 +170,28 @@ void GlobalSettings::set_defaults_where_needed()
 		value(Key_Dec_ExportFormat).toString() == "%s %d: %c: %1")
 		setValue(Key_Dec_ExportFormat, "%s %d: %r: %1");
 
+	// Keep sample data in RAM by default, and if it isn't, keep 512 MiB of it
+	if (!contains(Key_Mem_DiskBacking))
+		setValue(Key_Mem_DiskBacking, false);
+	if (!contains(Key_Mem_HotChunkBudget))
+		setValue(Key_Mem_HotChunkBudget, 512);
+	if (!contains(Key_Mem_SwapDirectory))
+		setValue(Key_Mem_SwapDirectory, QString());
+	if (!contains(Key_Mem_CompressLogic))
+		setValue(Key_Mem_CompressLogic, false);
+	if (!contains(Key_Mem_RollingCapture))
+		setValue(Key_Mem_RollingCapture, false);
+	if (!contains(Key_Mem_RollingWindow))
+		setValue(Key_Mem_RollingWindow, 60);
+	if (!contains(Key_Mem_Budget))
+		setValue(Key_Mem_Budget, 0);  // Unlimited
+	if (!contains(Key_Mem_BitPlanes))
+		setValue(Key_Mem_BitPlanes, false);
+	if (!contains(Key_Mem_QuantizeAnalog))
+		setValue(Key_Mem_QuantizeAnalog, true);
+	if (!contains(Key_Mem_CompressAnalog))
+		setValue(Key_Mem_CompressAnalog, false);
+
 	// Default to 500 lines of backlog
 	if (!contains(Key_Log_BufferSize))
 		setValue(Key_Log_BufferSize, 500);
@@ -78,6 +78,16 @@ public:
 	static const QString Key_Dec_InitialStateConfigurable;
 	static const QString Key_Dec_ExportFormat;
 	static const QString Key_Dec_AlwaysShowAllRows;
+	static const QString Key_Mem_DiskBacking;
+	static const QString Key_Mem_HotChunkBudget;
+	static const QString Key_Mem_SwapDirectory;
+	static const QString Key_Mem_CompressLogic;
+	static const QString Key_Mem_RollingCapture;
+	static const QString Key_Mem_RollingWindow;
+	static const QString Key_Mem_Budget;
+	static const QString Key_Mem_BitPlanes;
+	static const QString Key_Mem_QuantizeAnalog;
+	static const QString Key_Mem_CompressAnalog;
 	static const QString Key_Log_BufferSize;
 	static const QString Key_Log_NotifyOfStacktrace;
 
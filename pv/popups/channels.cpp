@@ -17,6 +17,7 @@
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <map>
 
 #include <QApplication>
@@ -33,6 +34,7 @@
 #include <pv/binding/device.hpp>
 #include <pv/data/logic.hpp>
 #include <pv/data/logicsegment.hpp>
+#include <pv/data/memorybudget.hpp>
 #include <pv/data/signalbase.hpp>
 #include <pv/devices/device.hpp>
 
@@ -40,6 +42,7 @@ using std::make_shared;
 using std::map;
 using std::out_of_range;
 using std::shared_ptr;
+using std::sort;
 using std::unordered_set;
 using std::vector;
 using std::weak_ptr;
@@ -47,6 +50,8 @@ using std::weak_ptr;
 using pv::data::SignalBase;
 using pv::data::Logic;
 using pv::data::LogicSegment;
+using pv::data::MemoryAccount;
+using pv::data::MemoryBudget;
 
 using sigrok::Channel;
 using sigrok::ChannelGroup;
@@ -157,6 +162,9 @@ Channels::Channels(Session &session, QWidget *parent) :
 	layout_.addItem(new QSpacerItem(0, 15, QSizePolicy::Expanding, QSizePolicy::Expanding));
 	layout_.addRow(&filter_buttons_bar_);
 
+	layout_.addItem(new QSpacerItem(0, 15, QSizePolicy::Expanding, QSizePolicy::Expanding));
+	layout_.addRow(&memory_usage_label_);
+
 	// Connect the check-box signal mapper
 	connect(&check_box_mapper_, SIGNAL(mapped(QWidget*)),
 		this, SLOT(on_channel_checked(QWidget*)));
@@ -320,6 +328,83 @@ void Channels::populate_group(shared_ptr<ChannelGroup> group,
 	}
 }
 
+QString Channels::format_memory_size(uint64_t bytes)
+{
+	if (bytes < 1024 * 1024)
+		return tr("%1 KiB").arg((bytes + 1023) / 1024);
+	else
+		return tr("%1 MiB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+void Channels::update_memory_usage()
+{
+	const QString category_names[MemoryAccount::CategoryCount] = {
+		tr("Samples"), tr("Compressed samples"), tr("Mip-maps and envelopes"),
+		tr("Per-channel copies"), tr("Annotations"), tr("Binary decoder output") };
+
+	// All logic channels share the same sample data, so it's only listed once
+	QString text = tr("<b>Memory usage</b>");
+	bool logic_listed = false;
+
+	vector< shared_ptr<SignalBase> > sigs;
+	for (const shared_ptr<SignalBase>& b : session_.signalbases())
+		sigs.push_back(b);
+	sort(sigs.begin(), sigs.end(),
+		[](const shared_ptr<SignalBase> &a, const shared_ptr<SignalBase> &b)
+			{ return (a->type() != b->type()) ?
+				(a->type() < b->type()) : (a->index() < b->index()); });
+
+	for (const shared_ptr<SignalBase>& sig : sigs) {
+		uint64_t total = 0;
+		QString tool_tip;
+
+		for (int c = 0; c < MemoryAccount::CategoryCount; c++) {
+			const uint64_t usage = sig->get_memory_usage((MemoryAccount::Category)c);
+			const uint64_t deferred =
+				sig->get_deferred_memory((MemoryAccount::Category)c);
+			if ((usage == 0) && (deferred == 0))
+				continue;
+
+			total += usage;
+
+			if (!tool_tip.isEmpty())
+				tool_tip += "\n";
+			tool_tip += QString("%1: %2").arg(category_names[c],
+				format_memory_size(usage));
+			if (deferred > 0)
+				tool_tip += tr(" (%1 not built yet)").arg(
+					format_memory_size(deferred));
+		}
+
+		for (auto& entry : check_box_signal_map_)
+			if (entry.second == sig)
+				entry.first->setToolTip(tool_tip);
+
+		if (sig->type() == SignalBase::LogicChannel) {
+			if (logic_listed)
+				continue;
+			logic_listed = true;
+			text += tr("<br>Logic channels: %1").arg(format_memory_size(total));
+		} else
+			text += QString("<br>%1: %2").arg(sig->display_name().toHtmlEscaped(),
+				format_memory_size(total));
+
+		const double ratio = sig->get_compression_ratio();
+		if (ratio > 0)
+			text += tr(", compressed %1:1").arg(ratio, 0, 'f', 1);
+	}
+
+	if (MemoryBudget::budget() > 0)
+		text += tr("<br>Total: %1 of %2").arg(
+			format_memory_size(MemoryBudget::total_usage()),
+			format_memory_size(MemoryBudget::budget()));
+	else
+		text += tr("<br>Total: %1").arg(
+			format_memory_size(MemoryBudget::total_usage()));
+
+	memory_usage_label_.setText(text);
+}
+
 void Channels::showEvent(QShowEvent *event)
 {
 	pv::widgets::Popup::showEvent(event);
@@ -352,6 +437,8 @@ void Channels::showEvent(QShowEvent *event)
 	}
 
 	updating_channels_ = false;
+
+	update_memory_usage();
 }
 
 void Channels::on_channel_checked(QWidget *widget)
@@ -79,6 +79,9 @@ private:
 	void populate_group(shared_ptr<sigrok::ChannelGroup> group,
 		const vector< shared_ptr<pv::data::SignalBase> > sigs);
 
+	static QString format_memory_size(uint64_t bytes);
+	void update_memory_usage();
+
 	void showEvent(QShowEvent *event);
 
 private Q_SLOTS:
@@ -107,6 +110,8 @@ private:
 		check_box_signal_map_;
 	map< shared_ptr<sigrok::ChannelGroup>, QLabel*> group_label_map_;
 
+	QLabel memory_usage_label_;
+
 	QGridLayout filter_buttons_bar_;
 	QPushButton enable_all_channels_, disable_all_channels_;
 	QPushButton enable_all_logic_channels_, disable_all_logic_channels_;
@@ -28,16 +28,20 @@
 #include <QFileInfo>
 
 #include "devicemanager.hpp"
+#include "globalsettings.hpp"
 #include "mainwindow.hpp"
 #include "session.hpp"
 #include "util.hpp"
 
 #include "data/analog.hpp"
 #include "data/analogsegment.hpp"
+#include "data/chunkpool.hpp"
 #include "data/decode/decoder.hpp"
 #include "data/logic.hpp"
 #include "data/logicsegment.hpp"
+#include "data/memorybudget.hpp"
 #include "data/signalbase.hpp"
+#include "data/swapfile.hpp"
 
 #include "devices/hardwaredevice.hpp"
 #include "devices/inputfile.hpp"
@@ -83,7 +87,6 @@ using std::string;
 #ifdef ENABLE_FLOW
 using std::unique_lock;
 #endif
-using std::unique_ptr;
 using std::unordered_set;
 using std::vector;
 
@@ -96,6 +99,7 @@ using sigrok::InputFormat;
 using sigrok::Logic;
 using sigrok::Meta;
 using sigrok::Packet;
+using sigrok::Rational;
 using sigrok::Session;
 
 using Glib::VariantBase;
@@ -121,8 +125,12 @@ Session::Session(DeviceManager &device_manager, QString name) :
 	name_(name),
 	capture_state_(Stopped),
 	cur_samplerate_(0),
+	rolling_window_(0),
 	data_saved_(true)
 {
+	GlobalSettings settings;
+	data::MemoryBudget::set_budget(
+		settings.value(GlobalSettings::Key_Mem_Budget).toULongLong() * 1024 * 1024);
 }
 
 Session::~Session()
@@ -708,6 +716,36 @@ void Session::start_capture(function<void (const QString)> error_handler)
 
 	trigger_list_.clear();
 
+	// Determine where the sample data of this acquisition will be kept
+	GlobalSettings settings;
+	data::SwapFile::configure(
+		settings.value(GlobalSettings::Key_Mem_DiskBacking).toBool(),
+		settings.value(GlobalSettings::Key_Mem_SwapDirectory).toString(),
+		settings.value(GlobalSettings::Key_Mem_HotChunkBudget).toULongLong() * 1024 * 1024);
+	data::LogicSegment::set_compression_enabled(
+		settings.value(GlobalSettings::Key_Mem_CompressLogic).toBool());
+	data::LogicSegment::set_bit_planes_enabled(
+		settings.value(GlobalSettings::Key_Mem_BitPlanes).toBool());
+	data::AnalogSegment::set_quantization_enabled(
+		settings.value(GlobalSettings::Key_Mem_QuantizeAnalog).toBool());
+	data::AnalogSegment::set_compression_enabled(
+		settings.value(GlobalSettings::Key_Mem_CompressAnalog).toBool());
+	rolling_window_ = settings.value(GlobalSettings::Key_Mem_RollingCapture).toBool() ?
+		settings.value(GlobalSettings::Key_Mem_RollingWindow).toDouble() : 0;
+
+	data::MemoryBudget::set_budget(
+		settings.value(GlobalSettings::Key_Mem_Budget).toULongLong() * 1024 * 1024);
+	if (data::MemoryBudget::exceeded()) {
+		error_handler(tr("Memory budget exceeded, acquisition not started."));
+		return;
+	}
+
+	// Re-arm the memory reserve in case the last acquisition used it up
+	if (!data::ChunkPool::reserve_headroom(data::ChunkPool::DefaultHeadroom)) {
+		error_handler(tr("Out of memory, acquisition not started."));
+		return;
+	}
+
 	// Revert name back to default name (e.g. "Session 1") for real devices
 	// as the (possibly saved) data is gone. File devices keep their name.
 	shared_ptr<devices::HardwareDevice> hw_device =
@@ -891,8 +929,15 @@ void Session::set_capture_state(capture_state state)
 
 	if (state == Running)
 		acq_time_.restart();
-	if (state == Stopped)
+	if (state == Stopped) {
 		qDebug("Acquisition took %.2f s", acq_time_.elapsed() / 1000.);
+		qDebug("Chunk allocations: %llu total, %llu from heap",
+			(unsigned long long)data::ChunkPool::allocation_count(),
+			(unsigned long long)data::ChunkPool::heap_allocation_count());
+		qDebug("Sample bytes ingested: %llu copied, %llu written in place",
+			(unsigned long long)data::Segment::copied_byte_count(),
+			(unsigned long long)data::Segment::in_place_byte_count());
+	}
 
 	{
 		lock_guard<mutex> lock(sampling_mutex_);
@@ -1099,6 +1144,7 @@ void Session::sample_thread_proc(function<void (const QString)> error_handler)
 	}
 
 	out_of_memory_ = false;
+	memory_budget_exceeded_ = false;
 
 	{
 		lock_guard<recursive_mutex> lock(data_mutex_);
@@ -1149,6 +1195,8 @@ void Session::sample_thread_proc(function<void (const QString)> error_handler)
 
 	if (out_of_memory_)
 		error_handler(tr("Out of memory, acquisition stopped."));
+	else if (memory_budget_exceeded_)
+		error_handler(tr("Memory budget exceeded, acquisition stopped."));
 }
 
 void Session::free_unused_memory()
@@ -1380,6 +1428,15 @@ void Session::feed_in_logic(shared_ptr<Logic> logic)
 		cur_logic_segment_ = make_shared<data::LogicSegment>(
 			*logic_data_, logic_data_->get_segment_count(),
 			logic->unit_size(), cur_samplerate_);
+		if (rolling_window_ > 0)
+			cur_logic_segment_->set_max_sample_count(
+				rolling_window_ * cur_samplerate_);
+
+		// Files are read faster than the mip-map can be built on a
+		// single thread
+		if (dynamic_pointer_cast<devices::File>(device_))
+			cur_logic_segment_->set_parallel_mipmap(true);
+
 		logic_data_->push_segment(cur_logic_segment_);
 
 		signal_new_segment();
@@ -1409,14 +1466,50 @@ void Session::feed_in_analog(shared_ptr<Analog> analog)
 	const vector<shared_ptr<Channel>> channels = analog->channels();
 	bool sweep_beginning = false;
 
-	unique_ptr<float[]> data(new float[analog->num_samples() * channels.size()]);
-	analog->get_data_as_float(data.get());
+	// Integer samples of ADCs are kept as they are if the driver reports
+	// the resolution of the ADC in bits, they're converted to floats otherwise
+	data::AnalogSegment::Quantization quantization = {0, false, 0, 0};
+	if (data::AnalogSegment::quantization_enabled() && !analog->is_float() &&
+		(analog->unitsize() <= 2) && !analog->is_digits_decimal() &&
+		(analog->digits() > 0) && (analog->digits() <= 8 * (int)analog->unitsize()) &&
+		(analog->is_bigendian() == (Q_BYTE_ORDER == Q_BIG_ENDIAN))) {
+		const shared_ptr<Rational> scale = analog->scale();
+		const shared_ptr<Rational> offset = analog->offset();
+
+		quantization.unit_size = analog->unitsize();
+		quantization.is_signed = analog->is_signed();
+		quantization.scale = scale->numerator() / (float)scale->denominator();
+		quantization.offset = offset->numerator() / (float)offset->denominator();
+	}
+
+	// The segments that take float samples, which are appended together
+	vector<data::AnalogSegment*> float_segments(channels.size(), nullptr);
+	bool have_float_segments = false;
 
 	if (signalbases_.empty())
 		update_signals();
 
-	float *channel_data = data.get();
-	for (auto& channel : channels) {
+	// Quantized segments can't take samples of another encoding without
+	// losing precision, so new segments are started when the encoding changes
+	bool encoding_changed = false;
+	for (const shared_ptr<Channel> &channel : channels) {
+		const auto iter = cur_analog_segments_.find(channel);
+		if ((iter != cur_analog_segments_.end()) &&
+			iter->second->is_quantized() &&
+			(iter->second->quantization() != quantization))
+			encoding_changed = true;
+	}
+
+	if (encoding_changed) {
+		for (auto& entry : cur_analog_segments_)
+			entry.second->set_complete();
+		cur_analog_segments_.clear();
+
+		signal_segment_completed();
+	}
+
+	for (unsigned int i = 0; i < channels.size(); i++) {
+		const shared_ptr<Channel> &channel = channels[i];
 		shared_ptr<data::AnalogSegment> segment;
 
 		// Try to get the segment of the channel
@@ -1438,8 +1531,14 @@ void Session::feed_in_analog(shared_ptr<Analog> analog)
 			assert(data);
 
 			// Create a segment, keep it in the maps of channels
-			segment = make_shared<data::AnalogSegment>(
-				*data, data->get_segment_count(), cur_samplerate_);
+			if (quantization.unit_size)
+				segment = make_shared<data::AnalogSegment>(*data,
+					data->get_segment_count(), cur_samplerate_, quantization);
+			else
+				segment = make_shared<data::AnalogSegment>(
+					*data, data->get_segment_count(), cur_samplerate_);
+			if (rolling_window_ > 0)
+				segment->set_max_sample_count(rolling_window_ * cur_samplerate_);
 			cur_analog_segments_[channel] = segment;
 
 			// Push the segment into the analog data.
@@ -1450,9 +1549,26 @@ void Session::feed_in_analog(shared_ptr<Analog> analog)
 
 		assert(segment);
 
-		// Append the samples in the segment
-		segment->append_interleaved_samples(channel_data++, analog->num_samples(),
-			channels.size());
+		// Append the samples in the segment, float segments take any encoding
+		if (segment->is_quantized())
+			segment->append_interleaved_quantized_samples(
+				(const uint8_t*)analog->data_pointer() + i * quantization.unit_size,
+				analog->num_samples(), channels.size());
+		else {
+			float_segments[i] = segment.get();
+			have_float_segments = true;
+		}
+	}
+
+	if (have_float_segments) {
+		// The buffer is kept for the next packets
+		static thread_local vector<float> float_data;
+		if (float_data.size() < analog->num_samples() * channels.size())
+			float_data.resize(analog->num_samples() * channels.size());
+		analog->get_data_as_float(float_data.data());
+
+		data::AnalogSegment::append_interleaved_channels(float_segments,
+			float_data.data(), analog->num_samples());
 	}
 
 	if (sweep_beginning) {
@@ -1463,6 +1579,14 @@ void Session::feed_in_analog(shared_ptr<Analog> analog)
 	data_received();
 }
 
+void Session::enforce_memory_budget()
+{
+	if (!memory_budget_exceeded_ && data::MemoryBudget::exceeded()) {
+		memory_budget_exceeded_ = true;
+		device_->stop();
+	}
+}
+
 void Session::data_feed_in(shared_ptr<sigrok::Device> device,
 	shared_ptr<Packet> packet)
 {
@@ -1488,6 +1612,7 @@ void Session::data_feed_in(shared_ptr<sigrok::Device> device,
 	case SR_DF_LOGIC:
 		try {
 			feed_in_logic(dynamic_pointer_cast<Logic>(packet->payload()));
+			enforce_memory_budget();
 		} catch (bad_alloc&) {
 			out_of_memory_ = true;
 			device_->stop();
@@ -1497,6 +1622,7 @@ void Session::data_feed_in(shared_ptr<sigrok::Device> device,
 	case SR_DF_ANALOG:
 		try {
 			feed_in_analog(dynamic_pointer_cast<Analog>(packet->payload()));
+			enforce_memory_budget();
 		} catch (bad_alloc&) {
 			out_of_memory_ = true;
 			device_->stop();
@@ -248,6 +248,9 @@ private:
 
 	void feed_in_analog(shared_ptr<sigrok::Analog> analog);
 
+	/// Stops the acquisition if the memory budget was exceeded.
+	void enforce_memory_budget();
+
 	void data_feed_in(shared_ptr<sigrok::Device> device,
 		shared_ptr<sigrok::Packet> packet);
 
@@ -297,6 +300,7 @@ private:
 	mutable recursive_mutex data_mutex_;
 	shared_ptr<data::Logic> logic_data_;
 	uint64_t cur_samplerate_;
+	double rolling_window_;  ///< In seconds, 0 if not a rolling capture
 	shared_ptr<data::LogicSegment> cur_logic_segment_;
 	map< shared_ptr<sigrok::Channel>, shared_ptr<data::AnalogSegment> >
 		cur_analog_segments_;
@@ -304,7 +308,7 @@ private:
 
 	std::thread sampling_thread_;
 
-	bool out_of_memory_;
+	bool out_of_memory_, memory_budget_exceeded_;
 	bool data_saved_;
 	bool frame_began_;
 
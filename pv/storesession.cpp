@@ -50,6 +50,8 @@ using std::vector;
 
 using Glib::VariantBase;
 
+using pv::data::SegmentSpan;
+
 using sigrok::ConfigKey;
 using sigrok::Error;
 using sigrok::OutputFormat;
@@ -232,8 +234,9 @@ void StoreSession::store_proc(vector< shared_ptr<data::SignalBase> > achannel_li
 	unsigned int asamples_per_block = INT_MAX;
 
 	if (!asegment_list.empty()) {
-		// We assume all analog channels use the sample unit size
-		aunit_size = asegment_list.front()->unit_size();
+		// Analog samples are handed to the output as floats, even if
+		// the segments keep them quantized
+		aunit_size = sizeof(float);
 		asamples_per_block = BlockSize / aunit_size;
 	}
 	if (lsegment) {
@@ -251,46 +254,54 @@ void StoreSession::store_proc(vector< shared_ptr<data::SignalBase> > achannel_li
 	const unsigned int samples_per_block =
 		min(asamples_per_block, lsamples_per_block);
 
+	vector< vector<SegmentSpan> > aspans(asegment_list.size());
+	vector<SegmentSpan> lspans;
+
 	const auto context = session_.device_manager().context();
 	while (!interrupt_ && sample_count_) {
 		progress_updated();
 
-		const uint64_t packet_len =
+		uint64_t packet_len =
 			min((uint64_t)samples_per_block, sample_count_);
 
+		// Hand the samples to the output right from the segments' chunks.
+		// All channels must be sent with the same length, so the packet
+		// ends where the first chunk of any of the segments ends.
+		for (unsigned int i = 0; i < asegment_list.size(); i++) {
+			asegment_list.at(i)->get_float_spans(start_sample_, packet_len, aspans[i]);
+			packet_len = min(packet_len, aspans[i].front().sample_count);
+		}
+
+		if (lsegment) {
+			lsegment->get_sample_spans(start_sample_, packet_len, lspans);
+			packet_len = min(packet_len, lspans.front().sample_count);
+		}
+
 		try {
 			for (unsigned int i = 0; i < achannel_list.size(); i++) {
 				shared_ptr<sigrok::Channel> achannel = (achannel_list.at(i))->channel();
-				shared_ptr<data::AnalogSegment> asegment = asegment_list.at(i);
-
-				float *adata = new float[packet_len];
-				asegment->get_samples(start_sample_, start_sample_ + packet_len, adata);
+				const SegmentSpan &aspan = aspans[i].front();
 
 				auto analog = context->create_analog_packet(
 					vector<shared_ptr<sigrok::Channel> >{achannel},
-					(float *)adata, packet_len,
+					(float *)aspan.data, packet_len,
 					sigrok::Quantity::VOLTAGE, sigrok::Unit::VOLT,
 					vector<const sigrok::QuantityFlag *>());
 				const string adata_str = output_->receive(analog);
 
 				if (output_stream_.is_open())
 					output_stream_ << adata_str;
-
-				delete[] adata;
 			}
 
 			if (lsegment) {
 				const size_t data_size = packet_len * lunit_size;
-				uint8_t* ldata = new uint8_t[data_size];
-				lsegment->get_samples(start_sample_, start_sample_ + packet_len, ldata);
+				const SegmentSpan &lspan = lspans.front();
 
-				auto logic = context->create_logic_packet((void*)ldata, data_size, lunit_size);
+				auto logic = context->create_logic_packet((void*)lspan.data, data_size, lunit_size);
 				const string ldata_str = output_->receive(logic);
 
 				if (output_stream_.is_open())
 					output_stream_ << ldata_str;
-
-				delete[] ldata;
 			}
 		} catch (Error& error) {
 			error_ = tr("Error while saving: ") + error.what();
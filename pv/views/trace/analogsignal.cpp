@@ -91,7 +91,6 @@ const QColor AnalogSignal::ThresholdColorLo = QColor(255, 0, 0, 8 * 256 / 100);
 const QColor AnalogSignal::ThresholdColorNe = QColor(0,   0, 0, 10 * 256 / 100);
 const QColor AnalogSignal::ThresholdColorHi = QColor(0, 255, 0, 8 * 256 / 100);
 
-const int64_t AnalogSignal::TracePaintBlockSize = 1024 * 1024;  // 4 MiB (due to float)
 const float AnalogSignal::EnvelopeThreshold = 64.0f;
 
 const int AnalogSignal::MaximumVDivs = 10;
@@ -407,52 +406,49 @@ void AnalogSignal::paint_trace(QPainter &p,
 
 	vector<QRectF> sampling_points[3];
 
-	int64_t sample_count = min(points_count, TracePaintBlockSize);
-	int64_t block_sample = 0;
-	float *sample_block = new float[TracePaintBlockSize];
-	segment->get_samples(start, start + sample_count, sample_block);
+	// Paint the samples right from the segment's chunks
+	vector<pv::data::SegmentSpan> spans;
+	segment->get_float_spans(start, points_count, spans);
 
 	if (show_hover_marker_)
 		reset_pixel_values();
 
 	const int w = 2;
-	for (int64_t sample = start; sample <= end; sample++, block_sample++) {
-
-		// Fetch next block of samples if we finished the current one
-		if (block_sample == TracePaintBlockSize) {
-			block_sample = 0;
-			sample_count = min(points_count - sample, TracePaintBlockSize);
-			segment->get_samples(sample, sample + sample_count, sample_block);
-		}
-
-		const float abs_x = sample / samples_per_pixel - pixels_offset;
-		const float x = left + abs_x;
-
-		*point++ = QPointF(x, y - sample_block[block_sample] * scale_);
-
-		// Generate the pixel<->value lookup table for the mouse hover
-		if (show_hover_marker_)
-			process_next_sample_value(abs_x, sample_block[block_sample]);
-
-		// Create the sampling points if needed
-		if (show_sampling_points) {
-			int idx = 0;  // Neutral
-
-			if (paint_thr_dots) {
-				if (thresholds.size() == 1)
-					idx = (sample_block[block_sample] >= thresholds[0]) ? 2 : 1;
-				else if (thresholds.size() == 2) {
-					if (sample_block[block_sample] > thresholds[1])
-						idx = 2;  // High
-					else if (sample_block[block_sample] < thresholds[0])
-						idx = 1;  // Low
+	int64_t sample = start;
+	for (const pv::data::SegmentSpan &span : spans) {
+		const float *samples = (const float*)span.data;
+
+		for (uint64_t i = 0; i < span.sample_count; i++, sample++) {
+			const float value = samples[i];
+
+			const float abs_x = sample / samples_per_pixel - pixels_offset;
+			const float x = left + abs_x;
+
+			*point++ = QPointF(x, y - value * scale_);
+
+			// Generate the pixel<->value lookup table for the mouse hover
+			if (show_hover_marker_)
+				process_next_sample_value(abs_x, value);
+
+			// Create the sampling points if needed
+			if (show_sampling_points) {
+				int idx = 0;  // Neutral
+
+				if (paint_thr_dots) {
+					if (thresholds.size() == 1)
+						idx = (value >= thresholds[0]) ? 2 : 1;
+					else if (thresholds.size() == 2) {
+						if (value > thresholds[1])
+							idx = 2;  // High
+						else if (value < thresholds[0])
+							idx = 1;  // Low
+					}
 				}
-			}
 
-			sampling_points[idx].emplace_back(x - (w / 2), y - sample_block[block_sample] * scale_ - (w / 2), w, w);
+				sampling_points[idx].emplace_back(x - (w / 2), y - value * scale_ - (w / 2), w, w);
+			}
 		}
 	}
-	delete[] sample_block;
 
 	// QPainter::drawPolyline() is slow, let's paint the lines ourselves
 	for (int64_t i = 1; i < points_count; i++)
@@ -495,8 +491,8 @@ void AnalogSignal::paint_envelope(QPainter &p,
 	p.setPen(QPen(Qt::NoPen));
 	p.setBrush(base_->color());
 
-	QRectF *const rects = new QRectF[e.length];
-	QRectF *rect = rects;
+	envelope_rects_.clear();
+	envelope_rects_.reserve(e.length - 1);
 
 	for (uint64_t sample = 0; sample < e.length - 1; sample++) {
 		const float x = ((e.scale * sample + e.start) /
@@ -515,13 +511,10 @@ void AnalogSignal::paint_envelope(QPainter &p,
 		if (h <= 0.0f && h >= -1.0f)
 			h = -1.0f;
 
-		*rect++ = QRectF(x, t, 1.0f, h);
+		envelope_rects_.emplace_back(x, t, 1.0f, h);
 	}
 
-	p.drawRects(rects, e.length);
-
-	delete[] rects;
-	delete[] e.samples;
+	p.drawRects(envelope_rects_.data(), envelope_rects_.size());
 }
 
 void AnalogSignal::paint_logic_mid(QPainter &p, ViewItemPaintParams &pp)
@@ -829,14 +822,9 @@ vector<data::LogicSegment::EdgePair> AnalogSignal::get_nearest_level_changes(uin
 	if (!segment || (segment->get_sample_count() == 0))
 		return vector<LogicSegment::EdgePair>();
 
-	const View *view = owner_->view();
-	assert(view);
-	const double samples_per_pixel = base_->get_samplerate() * view->scale();
-
 	vector<LogicSegment::EdgePair> edges;
 
-	segment->get_surrounding_edges(edges, sample_pos,
-		samples_per_pixel / LogicSignal::Oversampling, 0);
+	segment->get_surrounding_edges(edges, sample_pos, 0);
 
 	if (edges.empty())
 		return vector<LogicSegment::EdgePair>();
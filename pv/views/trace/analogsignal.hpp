@@ -24,6 +24,7 @@
 
 #include <QColor>
 #include <QComboBox>
+#include <QRectF>
 #include <QSpinBox>
 
 #include <pv/views/trace/signal.hpp>
@@ -59,7 +60,6 @@ private:
 	static const QColor ThresholdColorNe;
 	static const QColor ThresholdColorHi;
 
-	static const int64_t TracePaintBlockSize;
 	static const float EnvelopeThreshold;
 
 	static const int MaximumVDivs;
@@ -190,6 +190,7 @@ private:
 
 	int conversion_threshold_disp_mode_;
 
+	vector<QRectF> envelope_rects_;  // Reused by paint_envelope() to avoid allocating each frame
 	vector<float> value_at_pixel_pos_;
 	float value_at_hover_pos_;
 	float prev_value_at_pixel_;  // Only used during lookup table update
@@ -58,6 +58,7 @@ using sigrok::TriggerMatch;
 using sigrok::TriggerMatchType;
 
 using pv::data::LogicSegment;
+using pv::data::SignalBase;
 
 namespace pv {
 namespace views {
@@ -98,6 +99,7 @@ const char* LogicSignal::TriggerMarkerIcons[8] = {
 
 QCache<QString, const QIcon> LogicSignal::icon_cache_;
 QCache<QString, const QPixmap> LogicSignal::pixmap_cache_;
+LogicSignal::EdgeBatch LogicSignal::edge_batch_;
 
 LogicSignal::LogicSignal(
 	pv::Session &session,
@@ -188,7 +190,7 @@ void LogicSignal::paint_mid(QPainter &p, ViewItemPaintParams &pp)
 
 	const int y = get_visual_y();
 
-	if (!base_->enabled())
+	if (!is_painted(pp))
 		return;
 
 	const float low_offset = y + 0.5f;
@@ -217,8 +219,8 @@ void LogicSignal::paint_mid(QPainter &p, ViewItemPaintParams &pp)
 	const uint64_t end_sample = min(max(ceil(end).convert_to<int64_t>(),
 		(int64_t)0), last_sample);
 
-	segment->get_subsampled_edges(edges, start_sample, end_sample,
-		samples_per_pixel / Oversampling, base_->index());
+	get_edges_to_paint(pp, segment, start_sample, end_sample,
+		samples_per_pixel / Oversampling, edges);
 	assert(edges.size() >= 2);
 
 	const float first_sample_x =
@@ -386,14 +388,9 @@ vector<LogicSegment::EdgePair> LogicSignal::get_nearest_level_changes(uint64_t s
 	if (!segment || (segment->get_sample_count() == 0))
 		return vector<LogicSegment::EdgePair>();
 
-	const View *view = owner_->view();
-	assert(view);
-	const double samples_per_pixel = base_->get_samplerate() * view->scale();
-
 	vector<LogicSegment::EdgePair> edges;
 
-	segment->get_surrounding_edges(edges, sample_pos,
-		samples_per_pixel / Oversampling, base_->index());
+	segment->get_surrounding_edges(edges, sample_pos, base_->index());
 
 	if (edges.empty())
 		return vector<LogicSegment::EdgePair>();
@@ -420,6 +417,17 @@ void LogicSignal::paint_caps(QPainter &p, QLineF *const lines,
 	p.drawLines(lines, line - lines);
 }
 
+bool LogicSignal::is_painted(const ViewItemPaintParams &pp) const
+{
+	if (!base_->enabled())
+		return false;
+
+	const int y = pp.top() + get_visual_y();
+	const pair<int, int> extents = v_extents();
+	return (y + extents.first <= pp.bottom()) &&
+		(y + extents.second >= pp.top());
+}
+
 shared_ptr<pv::data::LogicSegment> LogicSignal::get_logic_segment_to_paint() const
 {
 	shared_ptr<pv::data::LogicSegment> segment;
@@ -445,6 +453,42 @@ shared_ptr<pv::data::LogicSegment> LogicSignal::get_logic_segment_to_paint() con
 	return segment;
 }
 
+void LogicSignal::get_edges_to_paint(const ViewItemPaintParams &pp,
+	const shared_ptr<LogicSegment> &segment, uint64_t start_sample,
+	uint64_t end_sample, float min_length,
+	vector<LogicSegment::EdgePair> &edges)
+{
+	EdgeBatch &batch = edge_batch_;
+	const unsigned int index = base_->index();
+
+	if ((batch.pass != pp.pass()) || (batch.segment.lock() != segment) ||
+		(batch.start_sample != start_sample) ||
+		(batch.end_sample != end_sample) || (batch.min_length != min_length)) {
+		// Only the traces of the segment that are painted in this pass
+		uint64_t sig_mask = UINT64_C(1) << index;
+		for (const shared_ptr<LogicSignal>& s :
+			owner_->view()->list_by_type<LogicSignal>())
+			if ((s->base()->logic_data() == base_->logic_data()) &&
+				s->is_painted(pp))
+				sig_mask |= UINT64_C(1) << s->base()->index();
+
+		batch.pass = pp.pass();
+		batch.segment = segment;
+		batch.start_sample = start_sample;
+		batch.end_sample = end_sample;
+		batch.min_length = min_length;
+		segment->get_subsampled_edges(batch.edges, start_sample, end_sample,
+			min_length, sig_mask);
+	}
+
+	// Every trace is painted once per pass, so the edges are handed over
+	if ((index < batch.edges.size()) && !batch.edges[index].empty())
+		edges.swap(batch.edges[index]);
+	else
+		segment->get_subsampled_edges(edges, start_sample, end_sample,
+			min_length, index);
+}
+
 void LogicSignal::init_trigger_actions(QWidget *parent)
 {
 	trigger_none_ = new QAction(*get_icon(":/icons/trigger-none.svg"),
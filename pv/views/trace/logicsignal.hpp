@@ -32,6 +32,7 @@
 using std::pair;
 using std::shared_ptr;
 using std::vector;
+using std::weak_ptr;
 
 class QIcon;
 class QToolBar;
@@ -119,8 +120,20 @@ private:
 		bool level, double samples_per_pixel, double pixels_offset,
 		float x_offset, float y_offset);
 
+	/// Returns true if the trace is enabled and lies within the viewport
+	bool is_painted(const ViewItemPaintParams &pp) const;
+
 	shared_ptr<pv::data::LogicSegment> get_logic_segment_to_paint() const;
 
+	/**
+	 * Gets the edges to paint. They're found at once for all traces of
+	 * the segment that are painted in the same pass.
+	 */
+	void get_edges_to_paint(const ViewItemPaintParams &pp,
+		const shared_ptr<pv::data::LogicSegment> &segment,
+		uint64_t start_sample, uint64_t end_sample, float min_length,
+		vector<data::LogicSegment::EdgePair> &edges);
+
 	void init_trigger_actions(QWidget *parent);
 
 	const vector<int32_t> get_trigger_types() const;
@@ -133,6 +146,17 @@ private:
 	static const QIcon* get_icon(const char *path);
 	static const QPixmap* get_pixmap(const char *path);
 
+private:
+	/// The edges of the channels of a segment found for a paint pass
+	struct EdgeBatch
+	{
+		uint64_t pass;
+		weak_ptr<pv::data::LogicSegment> segment;
+		uint64_t start_sample, end_sample;
+		float min_length;
+		vector< vector<data::LogicSegment::EdgePair> > edges;
+	};
+
 private Q_SLOTS:
 	void on_setting_changed(const QString &key, const QVariant &value);
 
@@ -161,6 +185,8 @@ private:
 
 	static QCache<QString, const QIcon> icon_cache_;
 	static QCache<QString, const QPixmap> pixmap_cache_;
+
+	static EdgeBatch edge_batch_;
 };
 
 } // namespace trace
@@ -28,12 +28,15 @@ namespace pv {
 namespace views {
 namespace trace {
 
+uint64_t ViewItemPaintParams::next_pass_ = 0;
+
 ViewItemPaintParams::ViewItemPaintParams(
 	const QRect &rect, double scale, const pv::util::Timestamp& offset) :
 	rect_(rect),
 	scale_(scale),
 	offset_(offset),
-	bg_color_state_(false)
+	bg_color_state_(false),
+	pass_(next_pass_++)
 {
 	assert(scale > 0.0);
 }
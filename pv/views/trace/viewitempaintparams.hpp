@@ -20,6 +20,8 @@
 #ifndef PULSEVIEW_PV_VIEWS_TRACEVIEW_VIEWITEMPAINTPARAMS_HPP
 #define PULSEVIEW_PV_VIEWS_TRACEVIEW_VIEWITEMPAINTPARAMS_HPP
 
+#include <cstdint>
+
 #include "pv/util.hpp"
 
 #include <QFont>
@@ -75,6 +77,14 @@ public:
 		return (offset_ / scale_).convert_to<double>();
 	}
 
+	/**
+	 * Identifies the paint pass, so that items can share the data they
+	 * compute for it.
+	 */
+	uint64_t pass() const {
+		return pass_;
+	}
+
 	bool next_bg_color_state() {
 		const bool state = bg_color_state_;
 		bg_color_state_ = !bg_color_state_;
@@ -91,6 +101,9 @@ private:
 	double scale_;
 	pv::util::Timestamp offset_;
 	bool bg_color_state_;
+	uint64_t pass_;
+
+	static uint64_t next_pass_;
 };
 
 } // namespace trace
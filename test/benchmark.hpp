@@ -0,0 +1,69 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2026 The PulseView developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PULSEVIEW_TEST_BENCHMARK_HPP
+#define PULSEVIEW_TEST_BENCHMARK_HPP
+
+#include <chrono>
+
+#include <boost/test/unit_test.hpp>
+
+/*
+ * Benchmarks report their results with BOOST_TEST_MESSAGE, so run them with
+ * --log_level=message. They take long and need a lot of memory, so they're
+ * only registered as test cases if the tests are configured with
+ * ENABLE_BENCHMARKS. Otherwise they're still compiled but never run.
+ */
+#ifdef ENABLE_BENCHMARKS
+#define BENCHMARK_TEST_CASE(name) BOOST_AUTO_TEST_CASE(name)
+#else
+#define BENCHMARK_TEST_CASE(name) inline void name##_benchmark()
+#endif
+
+/// Measures the time passed since it was created or restarted
+class Stopwatch
+{
+public:
+	Stopwatch() :
+		start_(std::chrono::steady_clock::now())
+	{
+	}
+
+	void restart()
+	{
+		start_ = std::chrono::steady_clock::now();
+	}
+
+	long long microseconds() const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start_).count();
+	}
+
+	long long nanoseconds() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start_).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start_;
+};
+
+#endif
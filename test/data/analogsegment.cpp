@@ -113,3 +113,601 @@ BOOST_AUTO_TEST_CASE(Basic)
 
 BOOST_AUTO_TEST_SUITE_END()
 #endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <pv/data/analog.hpp>
+#include <pv/data/analogsegment.hpp>
+#include <pv/data/memorybudget.hpp>
+#include <pv/data/mipmapkernels.hpp>
+
+#include "test/benchmark.hpp"
+
+using pv::data::Analog;
+using pv::data::AnalogSegment;
+using pv::data::MemoryAccount;
+using pv::data::MemoryBudget;
+using pv::data::MipMapKernels;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE(AnalogSegmentEnvelopeTest)
+
+BOOST_AUTO_TEST_CASE(Deferred)
+{
+	const uint64_t sample_count = 1000000;
+
+	vector<float> data(sample_count);
+	for (uint64_t i = 0; i < sample_count; i++)
+		data[i] = sinf(i * 0.001f) * (i % 7);
+
+	Analog analog;
+	AnalogSegment s(analog, 0, 1);
+	s.append_interleaved_samples(data.data(), sample_count, 1);
+
+	// Nothing is summarized while the samples are appended
+	const uint64_t deferred =
+		MemoryBudget::deferred(&analog, MemoryAccount::SummaryData);
+	BOOST_CHECK_EQUAL(MemoryBudget::usage(&analog, MemoryAccount::SummaryData), 0);
+	BOOST_CHECK(deferred > 0);
+	BOOST_CHECK_EQUAL(s.get_min_max().first,
+		*std::min_element(data.begin(), data.end()));
+	BOOST_CHECK_EQUAL(s.get_min_max().second,
+		*std::max_element(data.begin(), data.end()));
+
+	// Only the first half is built for a section of it
+	for (float min_length : {16.0f, 300.0f}) {
+		AnalogSegment::EnvelopeSection e;
+		s.get_envelope_section(e, 0, sample_count / 2, min_length);
+
+		BOOST_REQUIRE(e.length > 0);
+		for (uint64_t i = 0; i < e.length; i++) {
+			const auto first = data.begin() + e.start + i * e.scale;
+			BOOST_REQUIRE_EQUAL(e.samples[i].min,
+				*std::min_element(first, first + e.scale));
+			BOOST_REQUIRE_EQUAL(e.samples[i].max,
+				*std::max_element(first, first + e.scale));
+		}
+	}
+
+	BOOST_CHECK(MemoryBudget::usage(&analog, MemoryAccount::SummaryData) > 0);
+	BOOST_CHECK(MemoryBudget::deferred(&analog, MemoryAccount::SummaryData) <
+		deferred);
+
+	AnalogSegment::EnvelopeSection e;
+	s.get_envelope_section(e, 0, sample_count, 16.0f);
+
+	BOOST_CHECK_EQUAL(MemoryBudget::deferred(&analog, MemoryAccount::SummaryData), 0);
+}
+
+// Sections point into the envelope levels and stay valid while the segment
+// grows and evicts samples
+BOOST_AUTO_TEST_CASE(Pinned)
+{
+	const uint64_t sample_count = 2000000, max_sample_count = 300000;
+	const uint64_t block_length = 40961;
+
+	vector<float> data(sample_count);
+	for (uint64_t i = 0; i < sample_count; i++)
+		data[i] = (i % 1000) * 0.5f - 100.0f;
+
+	Analog analog;
+	AnalogSegment s(analog, 0, 1);
+	s.set_max_sample_count(max_sample_count);
+
+	vector<AnalogSegment::EnvelopeSection> sections;
+	vector< vector<AnalogSegment::EnvelopeSample> > copies;
+
+	for (uint64_t i = 0; i < sample_count; i += block_length) {
+		const uint64_t count = std::min(block_length, sample_count - i);
+		s.append_interleaved_samples(data.data() + i, count, 1);
+
+		for (float min_length : {16.0f, 300.0f}) {
+			AnalogSegment::EnvelopeSection e, f;
+			s.get_envelope_section(e, 0, s.get_sample_count(), min_length);
+			s.get_envelope_section(f, 0, s.get_sample_count(), min_length);
+			BOOST_REQUIRE(e.length > 0);
+			BOOST_CHECK_EQUAL(e.samples, f.samples);
+
+			sections.push_back(e);
+			copies.emplace_back(e.samples, e.samples + e.length);
+		}
+	}
+
+	for (size_t i = 0; i < sections.size(); i++)
+		for (uint64_t j = 0; j < sections[i].length; j++) {
+			BOOST_REQUIRE_EQUAL(sections[i].samples[j].min, copies[i][j].min);
+			BOOST_REQUIRE_EQUAL(sections[i].samples[j].max, copies[i][j].max);
+		}
+}
+
+// Measures how fast the envelopes of several channels are built
+BENCHMARK_TEST_CASE(Benchmark)
+{
+	const uint64_t sample_count = 8 * 1024 * 1024;
+	const MipMapKernels::InstructionSet default_set =
+		MipMapKernels::instruction_set();
+
+	vector<float> data(sample_count);
+	for (uint64_t i = 0; i < sample_count; i++)
+		data[i] = sinf(i * 0.001f) + (i % 13) * 0.01f;
+
+	for (unsigned int channels : {4, 16}) {
+		for (int set = MipMapKernels::Scalar;
+			set <= MipMapKernels::supported_instruction_set(); set++) {
+			MipMapKernels::set_instruction_set((MipMapKernels::InstructionSet)set);
+
+			Analog analog;
+			vector< std::unique_ptr<AnalogSegment> > segments;
+			for (unsigned int i = 0; i < channels; i++) {
+				segments.emplace_back(new AnalogSegment(analog, 0, 1));
+				segments.back()->append_interleaved_samples(data.data(),
+					sample_count, 1);
+			}
+
+			const Stopwatch stopwatch;
+			for (auto &s : segments) {
+				AnalogSegment::EnvelopeSection e;
+				s->get_envelope_section(e, 0, sample_count, 16.0f);
+			}
+			const double ns = stopwatch.nanoseconds();
+
+			BOOST_TEST_MESSAGE(channels << " channels, " <<
+				MipMapKernels::instruction_set_name(MipMapKernels::instruction_set()) <<
+				": " << ((ns > 0) ? (channels * sample_count * 1000 / ns) : 0) <<
+				" MS/s");
+		}
+	}
+
+	MipMapKernels::set_instruction_set(default_set);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(AnalogSegmentStatsTest)
+
+static void check_range_stats(AnalogSegment &s, const vector<float> &data,
+	uint64_t offset, uint64_t start, uint64_t end)
+{
+	long double sum = 0, sum_of_squares = 0;
+	for (uint64_t i = start; i < end; i++) {
+		sum += data[offset + i];
+		sum_of_squares += (long double)data[offset + i] * data[offset + i];
+	}
+
+	const AnalogSegment::RangeStats stats = s.get_range_stats(start, end);
+	BOOST_REQUIRE_EQUAL(stats.count, end - start);
+	BOOST_REQUIRE_CLOSE(stats.sum, (double)sum, 1e-11);
+	BOOST_REQUIRE_CLOSE(stats.sum_of_squares, (double)sum_of_squares, 1e-11);
+}
+
+BOOST_AUTO_TEST_CASE(MatchReference)
+{
+	const uint64_t sample_count = 3000017;
+
+	vector<float> data(sample_count);
+	for (uint64_t i = 0; i < sample_count; i++)
+		data[i] = sinf(i * 0.001f) * (i % 7) + 1000.0f;
+
+	Analog analog;
+	AnalogSegment s(analog, 0, 1);
+	s.append_interleaved_samples(data.data(), sample_count, 1);
+
+	// Nothing is summed up before statistics are asked for
+	const uint64_t usage =
+		MemoryBudget::usage(&analog, MemoryAccount::SummaryData);
+	check_range_stats(s, data, 0, 0, 0);
+	check_range_stats(s, data, 0, 100, 200);
+	BOOST_CHECK_EQUAL(MemoryBudget::usage(&analog, MemoryAccount::SummaryData),
+		usage);
+
+	check_range_stats(s, data, 0, 0, sample_count);
+	check_range_stats(s, data, 0, 4096, 65536 * 16);
+	uint32_t rand = 1;
+	for (int i = 0; i < 200; i++) {
+		rand = rand * 1103515245 + 12345;
+		const uint64_t start = (rand >> 8) % sample_count;
+		rand = rand * 1103515245 + 12345;
+		const uint64_t end = start + (rand >> 8) % (sample_count - start + 1);
+		check_range_stats(s, data, 0, start, end);
+	}
+
+	BOOST_CHECK(MemoryBudget::usage(&analog, MemoryAccount::SummaryData) >
+		usage);
+}
+
+BOOST_AUTO_TEST_CASE(NaN)
+{
+	vector<float> data(100000, 1.0f);
+	data[50000] = NAN;
+
+	Analog analog;
+	AnalogSegment s(analog, 0, 1);
+	s.append_interleaved_samples(data.data(), data.size(), 1);
+
+	BOOST_CHECK(std::isnan(s.get_range_stats(0, data.size()).sum));
+	BOOST_CHECK(std::isnan(s.get_range_stats(40000, 60000).sum_of_squares));
+	BOOST_CHECK_EQUAL(s.get_range_stats(0, 50000).sum, 50000);
+	BOOST_CHECK_EQUAL(s.get_range_stats(50001, data.size()).sum, 49999);
+}
+
+BOOST_AUTO_TEST_CASE(Rolling)
+{
+	const uint64_t sample_count = 2000000, max_sample_count = 300000;
+	const uint64_t block_length = 4099;
+
+	vector<float> data(sample_count);
+	for (uint64_t i = 0; i < sample_count; i++)
+		data[i] = (i % 1000) * 0.5f - 100.0f;
+
+	Analog analog;
+	AnalogSegment s(analog, 0, 1);
+	s.set_max_sample_count(max_sample_count);
+
+	for (uint64_t i = 0; i < sample_count; i += block_length) {
+		const uint64_t count = std::min(block_length, sample_count - i);
+		s.append_interleaved_samples(data.data() + i, count, 1);
+
+		// The data of the segment begins at the oldest sample kept
+		const uint64_t offset = i + count - s.get_sample_count();
+		const uint64_t n = s.get_sample_count();
+		check_range_stats(s, data, offset, 0, n);
+		check_range_stats(s, data, offset, n / 3, n - n / 5);
+	}
+}
+
+// Measures how fast the statistics of a cursor range are returned
+BENCHMARK_TEST_CASE(Benchmark)
+{
+	const uint64_t sample_count = 64 * 1024 * 1024;
+
+	vector<float> data(sample_count);
+	for (uint64_t i = 0; i < sample_count; i++)
+		data[i] = sinf(i * 0.001f);
+
+	Analog analog;
+	AnalogSegment s(analog, 0, 1);
+	s.append_interleaved_samples(data.data(), sample_count, 1);
+
+	Stopwatch stopwatch;
+	s.get_range_stats(0, sample_count);
+	BOOST_TEST_MESSAGE("Building the statistics of " << sample_count <<
+		" samples: " << stopwatch.microseconds() << " us");
+
+	const int queries = 1000;
+	double mean = 0;
+	uint32_t rand = 1;
+	stopwatch.restart();
+	for (int i = 0; i < queries; i++) {
+		rand = rand * 1103515245 + 12345;
+		const uint64_t first = (rand >> 8) % (sample_count / 2);
+		const AnalogSegment::RangeStats stats =
+			s.get_range_stats(first, first + sample_count / 3);
+		mean += stats.sum / stats.count;
+	}
+	BOOST_TEST_MESSAGE("Range statistics: " <<
+		(double)stopwatch.microseconds() / queries << " us per query" <<
+		" (mean " << mean / queries << ")");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(AnalogSegmentQuantizationTest)
+
+template <typename T>
+static void check_quantized(bool is_signed)
+{
+	const uint64_t sample_count = 1000003, stride = 3;
+	const AnalogSegment::Quantization q = {sizeof(T), is_signed, 0.01f, -0.5f};
+
+	// Interleave the samples with the ones of other channels
+	vector<T> raw(sample_count * stride);
+	vector<float> data(sample_count);
+	uint32_t rand = 1;
+	for (uint64_t i = 0; i < sample_count; i++) {
+		rand = rand * 1103515245 + 12345;
+		const T sample = (T)(rand >> 16);
+		raw[i * stride + 1] = sample;
+		data[i] = sample * q.scale + q.offset;
+	}
+
+	Analog analog, float_analog;
+	AnalogSegment s(analog, 0, 1, q);
+	AnalogSegment f(float_analog, 0, 1);
+	BOOST_REQUIRE(s.is_quantized());
+	BOOST_REQUIRE(!f.is_quantized());
+
+	s.append_interleaved_quantized_samples(raw.data() + 1, sample_count, stride);
+	f.append_interleaved_samples(data.data(), sample_count, 1);
+
+	// Only the size of the samples differs
+	BOOST_CHECK_EQUAL(s.unit_size(), sizeof(T));
+	BOOST_CHECK(MemoryBudget::usage(&analog, MemoryAccount::SampleData) * 2 <=
+		MemoryBudget::usage(&float_analog, MemoryAccount::SampleData) * sizeof(T));
+	BOOST_CHECK(s.get_min_max() == f.get_min_max());
+
+	vector<float> samples(sample_count);
+	s.get_samples(0, sample_count, samples.data());
+	BOOST_CHECK(samples == data);
+
+	vector<pv::data::SegmentSpan> spans;
+	s.get_float_spans(12345, 200000, spans);
+	uint64_t index = 12345;
+	for (const pv::data::SegmentSpan &span : spans)
+		for (uint64_t i = 0; i < span.sample_count; i++)
+			BOOST_REQUIRE_EQUAL(((const float*)span.data)[i], data[index++]);
+	BOOST_CHECK_EQUAL(index, 12345 + 200000);
+
+	for (float min_length : {16.0f, 5000.0f}) {
+		AnalogSegment::EnvelopeSection e, fe;
+		s.get_envelope_section(e, 0, sample_count, min_length);
+		f.get_envelope_section(fe, 0, sample_count, min_length);
+
+		BOOST_REQUIRE_EQUAL(e.length, fe.length);
+		for (uint64_t i = 0; i < e.length; i++) {
+			BOOST_REQUIRE_EQUAL(e.samples[i].min, fe.samples[i].min);
+			BOOST_REQUIRE_EQUAL(e.samples[i].max, fe.samples[i].max);
+		}
+	}
+
+	const AnalogSegment::RangeStats stats = s.get_range_stats(777, 900001);
+	const AnalogSegment::RangeStats float_stats = f.get_range_stats(777, 900001);
+	BOOST_CHECK_EQUAL(stats.sum, float_stats.sum);
+	BOOST_CHECK_EQUAL(stats.sum_of_squares, float_stats.sum_of_squares);
+}
+
+BOOST_AUTO_TEST_CASE(Lossless)
+{
+	check_quantized<int8_t>(true);
+	check_quantized<uint8_t>(false);
+	check_quantized<int16_t>(true);
+	check_quantized<uint16_t>(false);
+}
+
+BOOST_AUTO_TEST_CASE(FloatSamples)
+{
+	const AnalogSegment::Quantization q = {1, true, 0.5f, 1.0f};
+
+	Analog analog;
+	AnalogSegment s(analog, 0, 1, q);
+
+	// Values are rounded to the nearest step and clamped to the range
+	const float data[] = {1.0f, 1.5f, 1.6f, -1.2f, 1000.0f, -1000.0f};
+	const float expected[] = {1.0f, 1.5f, 1.5f, -1.0f, 64.5f, -63.0f};
+	s.append_interleaved_samples(data, 6, 1);
+
+	float samples[6];
+	s.get_samples(0, 6, samples);
+	for (int i = 0; i < 6; i++)
+		BOOST_CHECK_EQUAL(samples[i], expected[i]);
+
+	BOOST_CHECK_EQUAL(s.get_min_max().first, -63.0f);
+	BOOST_CHECK_EQUAL(s.get_min_max().second, 64.5f);
+}
+
+BOOST_AUTO_TEST_CASE(Rolling)
+{
+	const uint64_t sample_count = 2000000, max_sample_count = 300000;
+	const uint64_t block_length = 4099;
+	const AnalogSegment::Quantization q = {2, false, 0.25f, 0.0f};
+
+	vector<uint16_t> raw(sample_count);
+	for (uint64_t i = 0; i < sample_count; i++)
+		raw[i] = i % 1000;
+
+	Analog analog;
+	AnalogSegment s(analog, 0, 1, q);
+	s.set_max_sample_count(max_sample_count);
+
+	for (uint64_t i = 0; i < sample_count; i += block_length) {
+		const uint64_t count = std::min(block_length, sample_count - i);
+		s.append_interleaved_quantized_samples(raw.data() + i, count, 1);
+	}
+
+	const uint64_t n = s.get_sample_count();
+	const uint64_t offset = sample_count - n;
+	BOOST_CHECK(n >= max_sample_count);
+
+	vector<float> samples(n);
+	s.get_samples(0, n, samples.data());
+	for (uint64_t i = 0; i < n; i++)
+		BOOST_REQUIRE_EQUAL(samples[i], raw[offset + i] * 0.25f);
+
+	AnalogSegment::EnvelopeSection e;
+	s.get_envelope_section(e, 0, n, 16.0f);
+	for (uint64_t i = 0; i < e.length; i++) {
+		const auto first = raw.begin() + offset + e.start + i * e.scale;
+		BOOST_REQUIRE_EQUAL(e.samples[i].min,
+			*std::min_element(first, first + e.scale) * 0.25f);
+		BOOST_REQUIRE_EQUAL(e.samples[i].max,
+			*std::max_element(first, first + e.scale) * 0.25f);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(AnalogSegmentCompressionTest)
+
+// Readings of a DMM, which stay the same for a while, and a slow waveform
+static void fill_float_data(vector<float> &data)
+{
+	for (uint64_t i = 0; i < data.size(); i++)
+		data[i] = ((i / 1000000) % 2) ? (((i / 5000) % 7) * 0.1f + 0.3f) :
+			sinf(i * 1e-5f) * 12.5f;
+}
+
+static void wait_for_compression(const AnalogSegment &s, uint64_t sample_count)
+{
+	for (int i = 0; (i < 1000) && (s.compressed_sample_count() < sample_count); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+
+BOOST_AUTO_TEST_CASE(Lossless)
+{
+	const uint64_t sample_count = 5000000;
+
+	vector<float> data(sample_count);
+	fill_float_data(data);
+
+	AnalogSegment::set_compression_enabled(true);
+	Analog analog;
+	AnalogSegment s(analog, 0, 1);
+	AnalogSegment::set_compression_enabled(false);
+
+	s.append_interleaved_samples(data.data(), sample_count, 1);
+	s.free_unused_memory();
+	wait_for_compression(s, sample_count);
+
+	BOOST_CHECK_EQUAL(s.compressed_sample_count(), sample_count);
+	BOOST_CHECK(MemoryBudget::usage(&analog, MemoryAccount::CompressedData) > 0);
+	BOOST_CHECK(MemoryBudget::usage(&analog, MemoryAccount::CompressedData) <
+		sample_count * sizeof(float) / 2);
+
+	vector<float> samples(sample_count);
+	s.get_samples(0, sample_count, samples.data());
+	BOOST_CHECK(samples == data);
+
+	AnalogSegment::EnvelopeSection e;
+	s.get_envelope_section(e, 0, sample_count, 16.0f);
+	for (uint64_t i = 0; i < e.length; i++) {
+		const auto first = data.begin() + e.start + i * e.scale;
+		BOOST_REQUIRE_EQUAL(e.samples[i].min,
+			*std::min_element(first, first + e.scale));
+		BOOST_REQUIRE_EQUAL(e.samples[i].max,
+			*std::max_element(first, first + e.scale));
+	}
+}
+
+// Measures how well float samples compress and how fast they're read back
+BENCHMARK_TEST_CASE(Benchmark)
+{
+	const uint64_t sample_count = 32 * 1024 * 1024;
+
+	vector<float> data(sample_count);
+	fill_float_data(data);
+
+	AnalogSegment::set_compression_enabled(true);
+	Analog analog;
+	AnalogSegment s(analog, 0, 1);
+	AnalogSegment::set_compression_enabled(false);
+
+	Stopwatch stopwatch;
+	s.append_interleaved_samples(data.data(), sample_count, 1);
+	s.free_unused_memory();
+	wait_for_compression(s, sample_count);
+	double ns = stopwatch.nanoseconds();
+
+	BOOST_TEST_MESSAGE("Compressed to " << (double)s.compressed_size() /
+		(s.compressed_sample_count() * sizeof(float)) * 100 << " % at " <<
+		((ns > 0) ? (sample_count * 1000 / ns) : 0) << " MS/s");
+
+	vector<float> samples(sample_count);
+	stopwatch.restart();
+	s.get_samples(0, sample_count, samples.data());
+	ns = stopwatch.nanoseconds();
+
+	BOOST_TEST_MESSAGE("Decompressed at " <<
+		((ns > 0) ? (sample_count * 1000 / ns) : 0) << " MS/s");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(AnalogSegmentIngestTest)
+
+static const unsigned int ChannelCount = 16;
+static const uint64_t PacketLength = 4096;
+
+static void fill_packets(vector<float> &data)
+{
+	for (uint64_t i = 0; i < data.size(); i++)
+		data[i] = sinf((i / ChannelCount) * 0.001f * (i % ChannelCount + 1));
+}
+
+BOOST_AUTO_TEST_CASE(MatchesSingleChannels)
+{
+	const uint64_t sample_count = 100003;
+
+	vector<float> data(sample_count * ChannelCount);
+	fill_packets(data);
+
+	Analog analog;
+	vector< std::unique_ptr<AnalogSegment> > batched, single;
+	vector<AnalogSegment*> segments;
+	for (unsigned int c = 0; c < ChannelCount; c++) {
+		batched.emplace_back(new AnalogSegment(analog, 0, 1));
+		single.emplace_back(new AnalogSegment(analog, 0, 1));
+		// Skip a channel, as is done for quantized ones
+		segments.push_back((c == 5) ? nullptr : batched.back().get());
+	}
+
+	for (uint64_t i = 0; i < sample_count; i += PacketLength) {
+		const uint64_t count = std::min(PacketLength, sample_count - i);
+		const float* const packet = data.data() + i * ChannelCount;
+
+		AnalogSegment::append_interleaved_channels(segments, packet, count);
+		for (unsigned int c = 0; c < ChannelCount; c++)
+			single[c]->append_interleaved_samples(packet + c, count, ChannelCount);
+	}
+
+	BOOST_CHECK_EQUAL(batched[5]->get_sample_count(), 0);
+	for (unsigned int c = 0; c < ChannelCount; c++) {
+		if (c == 5)
+			continue;
+
+		BOOST_REQUIRE_EQUAL(batched[c]->get_sample_count(), sample_count);
+		BOOST_CHECK(batched[c]->get_min_max() == single[c]->get_min_max());
+
+		vector<float> a(sample_count), b(sample_count);
+		batched[c]->get_samples(0, sample_count, a.data());
+		single[c]->get_samples(0, sample_count, b.data());
+		BOOST_CHECK(a == b);
+	}
+}
+
+// Measures the throughput of appending a stream of 16 channel packets
+BENCHMARK_TEST_CASE(Benchmark)
+{
+	const uint64_t sample_count = 4 * 1024 * 1024;
+
+	// The same packets are appended over and over
+	vector<float> data(64 * PacketLength * ChannelCount);
+	fill_packets(data);
+	const uint64_t packet_count = data.size() / (PacketLength * ChannelCount);
+
+	for (bool batch : {false, true}) {
+		Analog analog;
+		vector< std::unique_ptr<AnalogSegment> > owned;
+		vector<AnalogSegment*> segments;
+		for (unsigned int c = 0; c < ChannelCount; c++) {
+			owned.emplace_back(new AnalogSegment(analog, 0, 1));
+			segments.push_back(owned.back().get());
+		}
+
+		const Stopwatch stopwatch;
+		for (uint64_t i = 0; i < sample_count / PacketLength; i++) {
+			const float* const packet = data.data() +
+				(i % packet_count) * PacketLength * ChannelCount;
+			if (batch)
+				AnalogSegment::append_interleaved_channels(segments, packet,
+					PacketLength);
+			else
+				for (unsigned int c = 0; c < ChannelCount; c++)
+					segments[c]->append_interleaved_samples(packet + c,
+						PacketLength, ChannelCount);
+		}
+		const double ns = stopwatch.nanoseconds();
+
+		BOOST_TEST_MESSAGE((batch ? "Batched" : "Channel by channel") <<
+			": " << ((ns > 0) ? (sample_count * ChannelCount * 1000 / ns) : 0) <<
+			" MS/s");
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -19,16 +19,24 @@
 
 #include <extdef.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <vector>
 
 #include <boost/test/unit_test.hpp>
 
+#include <pv/data/logic.hpp>
 #include <pv/data/logicsegment.hpp>
+#include <pv/data/memorybudget.hpp>
 
-#if 0
+#include "test/benchmark.hpp"
+
+using pv::data::Logic;
 using pv::data::LogicSegment;
+using pv::data::MemoryAccount;
+using pv::data::MemoryBudget;
 using std::vector;
-#endif
 
 // Dummy, remove again when unit tests are fixed.
 BOOST_AUTO_TEST_SUITE(DummyTestSuite)
@@ -38,6 +46,695 @@ BOOST_AUTO_TEST_CASE(DummyTestCase)
 }
 BOOST_AUTO_TEST_SUITE_END()
 
+// Toggles random channels after random intervals of up to 2000 samples
+static void fill_segment(LogicSegment &s, uint64_t sample_count)
+{
+	const unsigned int unit_size = s.unit_size();
+	const uint64_t block_size = 64 * 1024;
+	vector<uint8_t> block(block_size * unit_size);
+
+	uint64_t value = 0, next_toggle = 0;
+	uint32_t rand = 1;
+
+	for (uint64_t i = 0; i < sample_count;) {
+		const uint64_t n = std::min(block_size, sample_count - i);
+
+		for (uint64_t j = 0; j < n; j++, i++) {
+			if (i == next_toggle) {
+				rand = rand * 1103515245 + 12345;
+				value ^= UINT64_C(1) << ((rand >> 16) % (unit_size * 8));
+				next_toggle += 1 + (rand >> 8) % 2000;
+			}
+			memcpy(&block[j * unit_size], &value, unit_size);
+		}
+
+		s.append_payload(block.data(), n * unit_size);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(LogicSegmentBitPlaneTest)
+
+BOOST_AUTO_TEST_CASE(MatchingEdges)
+{
+	const uint64_t sample_count = 1000000;
+
+	Logic logic(32);
+
+	LogicSegment::set_bit_planes_enabled(false);
+	LogicSegment interleaved(logic, 0, 4, 1);
+	fill_segment(interleaved, sample_count);
+
+	LogicSegment::set_bit_planes_enabled(true);
+	LogicSegment planar(logic, 0, 4, 1);
+	fill_segment(planar, sample_count);
+	LogicSegment::set_bit_planes_enabled(false);
+
+	for (int sig_index = 0; sig_index < 32; sig_index += 7)
+		for (float min_length : {1.0f, 7.0f, 100.0f}) {
+			vector<LogicSegment::EdgePair> a, b;
+			interleaved.get_subsampled_edges(a, 0, sample_count - 1,
+				min_length, sig_index);
+			planar.get_subsampled_edges(b, 0, sample_count - 1,
+				min_length, sig_index);
+
+			BOOST_CHECK(a.size() > 2);
+			BOOST_CHECK(a == b);
+		}
+
+	// Extract an unaligned range of both layouts
+	const uint64_t start = 12345, count = 100001;
+	vector<uint64_t> a((count + 63) / 64), b((count + 63) / 64);
+	interleaved.get_channel_bits(5, start, count, a.data());
+	planar.get_channel_bits(5, start, count, b.data());
+	BOOST_CHECK(a == b);
+
+	uint8_t sample[4];
+	for (uint64_t i = 0; i < count; i += 997) {
+		interleaved.get_samples(start + i, start + i + 1, sample);
+		BOOST_REQUIRE_EQUAL((a[i / 64] >> (i % 64)) & 1, (sample[0] >> 5) & 1);
+	}
+}
+
+// Compares the time it takes to find all edges of a channel at full
+// resolution
+BENCHMARK_TEST_CASE(Benchmark)
+{
+	const uint64_t sample_count = 4 * 1024 * 1024;
+
+	for (unsigned int channels : {8, 16, 32, 64}) {
+		Logic logic(channels);
+		vector<LogicSegment::EdgePair> edges[2];
+		long long times[3];
+
+		for (int planar = 0; planar < 2; planar++) {
+			LogicSegment::set_bit_planes_enabled(planar);
+			LogicSegment s(logic, 0, channels / 8, 1);
+			fill_segment(s, sample_count);
+
+			// The first search of the planar layout builds the plane
+			for (int pass = 0; pass <= planar; pass++) {
+				edges[planar].clear();
+
+				const Stopwatch stopwatch;
+				s.get_subsampled_edges(edges[planar], 0, sample_count - 1,
+					1.0f, channels - 1);
+				times[planar + pass] = stopwatch.microseconds();
+			}
+		}
+		LogicSegment::set_bit_planes_enabled(false);
+
+		BOOST_CHECK(edges[0] == edges[1]);
+		BOOST_TEST_MESSAGE(channels << " channels, " << edges[0].size() <<
+			" edges: interleaved " << times[0] << " us, planar " << times[2] <<
+			" us (" << times[1] << " us including conversion)");
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(LogicSegmentMipMapTest)
+
+static void check_matching_searches(LogicSegment &serial,
+	LogicSegment &parallel)
+{
+	const uint64_t sample_count = serial.get_sample_count();
+	BOOST_REQUIRE_EQUAL(parallel.get_sample_count(), sample_count);
+
+	for (int sig_index : {0, (int)serial.unit_size() * 8 - 1}) {
+		uint64_t a = 0, b = 0;
+		for (uint64_t origin = 0; origin < sample_count; origin += 99991) {
+			BOOST_REQUIRE_EQUAL(serial.find_next_edge(sig_index, origin, a),
+				parallel.find_next_edge(sig_index, origin, b));
+			BOOST_REQUIRE_EQUAL(a, b);
+
+			BOOST_REQUIRE_EQUAL(serial.find_previous_edge(sig_index, origin, a),
+				parallel.find_previous_edge(sig_index, origin, b));
+			BOOST_REQUIRE_EQUAL(a, b);
+		}
+	}
+}
+
+static void check_matching_edges(LogicSegment &serial, LogicSegment &parallel)
+{
+	const uint64_t sample_count = serial.get_sample_count();
+
+	for (int sig_index : {0, (int)serial.unit_size() * 8 - 1})
+		for (float min_length : {1.0f, 100.0f, 100000.0f}) {
+			vector<LogicSegment::EdgePair> a, b;
+			serial.get_subsampled_edges(a, 0, sample_count - 1,
+				min_length, sig_index);
+			parallel.get_subsampled_edges(b, 0, sample_count - 1,
+				min_length, sig_index);
+
+			BOOST_CHECK(a.size() > 2);
+			BOOST_CHECK(a == b);
+		}
+
+	check_matching_searches(serial, parallel);
+}
+
+BOOST_AUTO_TEST_CASE(MatchingEdges)
+{
+	const uint64_t sample_count = 20000007;
+
+	for (unsigned int unit_size : {1, 3}) {
+		Logic logic(unit_size * 8);
+
+		LogicSegment serial(logic, 0, unit_size, 1);
+		fill_segment(serial, sample_count);
+
+		LogicSegment parallel(logic, 0, unit_size, 1);
+		parallel.set_parallel_mipmap(true);
+		fill_segment(parallel, sample_count);
+
+		check_matching_edges(serial, parallel);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Deferred)
+{
+	const uint64_t sample_count = 1000000;
+
+	Logic logic(8);
+	LogicSegment s(logic, 0, 1, 1);
+	fill_segment(s, sample_count);
+
+	// Nothing is summarized while the samples are appended
+	const uint64_t deferred =
+		MemoryBudget::deferred(&logic, MemoryAccount::SummaryData);
+	BOOST_CHECK_EQUAL(MemoryBudget::usage(&logic, MemoryAccount::SummaryData), 0);
+	BOOST_CHECK(deferred > 0);
+
+	// Searching backwards builds the levels up to the origin only
+	uint64_t edge;
+	BOOST_CHECK(s.find_previous_edge(0, sample_count / 2, edge));
+	BOOST_CHECK(MemoryBudget::usage(&logic, MemoryAccount::SummaryData) > 0);
+	BOOST_CHECK(MemoryBudget::deferred(&logic, MemoryAccount::SummaryData) <
+		deferred);
+
+	// Extend the partially built levels by more samples, then compare
+	// them to levels that were built at once
+	const uint64_t more_count = 333333;
+	vector<uint8_t> data(sample_count + more_count);
+	for (uint64_t i = 0; i < more_count; i++)
+		data[sample_count + i] = (i / 1000) & 0xff;
+	s.append_payload(&data[sample_count], more_count);
+	s.get_samples(0, sample_count, data.data());
+
+	Logic reference_logic(8);
+	LogicSegment reference(reference_logic, 0, 1, 1);
+	reference.append_payload(data.data(), data.size());
+
+	check_matching_edges(reference, s);
+
+	BOOST_CHECK(s.get_edge_count(0, 0, s.get_sample_count()) > 0);
+	BOOST_CHECK_EQUAL(MemoryBudget::deferred(&logic, MemoryAccount::SummaryData), 0);
+}
+
+BOOST_AUTO_TEST_CASE(RangePastEnd)
+{
+	const uint64_t sample_count = 100000;
+
+	Logic logic(8);
+	LogicSegment s(logic, 0, 1, 1);
+	fill_segment(s, sample_count);
+
+	// Ranges reaching past the last sample, e.g. because samples were
+	// evicted, end at the last sample
+	for (float min_length : {1.0f, 100.0f}) {
+		vector<LogicSegment::EdgePair> a, b;
+		s.get_subsampled_edges(a, 0, sample_count - 1, min_length, 0);
+		s.get_subsampled_edges(b, 0, sample_count + 1000, min_length, 0);
+		BOOST_CHECK(a == b);
+
+		vector< vector<LogicSegment::EdgePair> > all;
+		s.get_subsampled_edges(all, 0, sample_count + 1000, min_length, 1);
+		BOOST_CHECK(all[0] == a);
+	}
+
+	LogicSegment empty(logic, 0, 1, 1);
+	vector<LogicSegment::EdgePair> edges;
+	empty.get_subsampled_edges(edges, 0, 1000, 1.0f, 0);
+	BOOST_CHECK(edges.empty());
+}
+
+// Compares the time it takes to append the samples of a file and to build
+// the mip-map when it's first shown
+BENCHMARK_TEST_CASE(Benchmark)
+{
+	const uint64_t sample_count = 64 * 1024 * 1024;
+	const uint64_t block_size = 1024 * 1024;
+
+	Logic logic(8);
+	vector<uint8_t> data(sample_count);
+	{
+		LogicSegment source(logic, 0, 1, 1);
+		fill_segment(source, sample_count);
+		source.get_samples(0, sample_count, data.data());
+	}
+
+	for (int parallel = 0; parallel < 2; parallel++) {
+		LogicSegment s(logic, 0, 1, 1);
+		s.set_parallel_mipmap(parallel);
+
+		Stopwatch stopwatch;
+		for (uint64_t i = 0; i < sample_count; i += block_size)
+			s.append_payload(&data[i], block_size);
+		const long long append_time = stopwatch.microseconds();
+
+		// Show the whole capture
+		vector<LogicSegment::EdgePair> edges;
+		stopwatch.restart();
+		s.get_subsampled_edges(edges, 0, sample_count - 1,
+			sample_count / 2000, 0);
+		const long long zoom_time = stopwatch.microseconds();
+
+		BOOST_TEST_MESSAGE(sample_count << " samples appended in " <<
+			append_time << " us, first shown after " << zoom_time <<
+			" us with a " << (parallel ? "parallel" : "serial") << " mip-map");
+	}
+}
+
+// Measures the edge searches at zoom levels finer than a mip-map block on
+// a channel that changes every few dozen samples
+BENCHMARK_TEST_CASE(FineZoomBenchmark)
+{
+	const uint64_t sample_count = 16 * 1024 * 1024;
+
+	for (unsigned int unit_size : {1, 3, 4, 8}) {
+		Logic logic(unit_size * 8);
+		LogicSegment s(logic, 0, unit_size, 1);
+
+		vector<uint8_t> data(sample_count * unit_size);
+		uint32_t rand = 1;
+		uint8_t value = 0;
+		for (uint64_t i = 0; i < sample_count; i++) {
+			rand = rand * 1103515245 + 12345;
+			if (((rand >> 16) % 50) == 0)
+				value ^= 2;
+			data[i * unit_size] = value;
+		}
+		s.append_payload(data.data(), data.size());
+
+		// Build the mip-map before timing the searches
+		vector<LogicSegment::EdgePair> edges;
+		s.get_subsampled_edges(edges, 0, sample_count - 1, 1.0f, 1);
+
+		for (float min_length : {1.0f, 4.0f}) {
+			edges.clear();
+
+			const Stopwatch stopwatch;
+			s.get_subsampled_edges(edges, 0, sample_count - 1, min_length, 1);
+			const long long time = stopwatch.microseconds();
+
+			BOOST_TEST_MESSAGE("Unit size " << unit_size << ", " <<
+				edges.size() << " edges at " << min_length <<
+				" samples per pixel in " << time << " us");
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(LogicSegmentEdgeIndexTest)
+
+// Toggles channel 0 on every sample and the others at random
+static void fill_toggling(LogicSegment &s, uint64_t sample_count, uint32_t &rand)
+{
+	const unsigned int unit_size = s.unit_size();
+	vector<uint8_t> block(sample_count * unit_size);
+
+	uint64_t value = 0;
+	for (uint64_t i = 0; i < sample_count; i++) {
+		rand = rand * 1103515245 + 12345;
+		if (((rand >> 16) % 500) == 0)
+			value ^= UINT64_C(2) << ((rand >> 8) % (unit_size * 8 - 1));
+		value ^= 1;
+		memcpy(&block[i * unit_size], &value, unit_size);
+	}
+
+	s.append_payload(block.data(), block.size());
+}
+
+static void check_edges(LogicSegment &s)
+{
+	const unsigned int unit_size = s.unit_size();
+	const uint64_t sample_count = s.get_sample_count();
+
+	vector<uint8_t> data(sample_count * unit_size);
+	s.get_samples(0, sample_count, data.data());
+
+	uint32_t rand = 42;
+	for (int sig_index : {0, 1, 7, (int)unit_size * 8 - 1}) {
+		// Find the edges sample by sample
+		vector<uint64_t> edges;
+		const unsigned int byte = sig_index / 8, bit = sig_index % 8;
+		for (uint64_t i = 1; i < sample_count; i++)
+			if (((data[i * unit_size + byte] ^
+					data[(i - 1) * unit_size + byte]) >> bit) & 1)
+				edges.push_back(i);
+
+		BOOST_CHECK_EQUAL(s.get_edge_count(sig_index, 0, sample_count),
+			edges.size());
+
+		// At full resolution, every edge is listed between the initial
+		// and the final state
+		vector<LogicSegment::EdgePair> subsampled;
+		s.get_subsampled_edges(subsampled, 0, sample_count - 1, 1.0f,
+			sig_index);
+		BOOST_REQUIRE_EQUAL(subsampled.size(), edges.size() + 2);
+		for (uint64_t i = 0; i < edges.size(); i++)
+			BOOST_REQUIRE_EQUAL(subsampled[i + 1].first, edges[i]);
+		BOOST_CHECK_EQUAL(subsampled.back().first, sample_count);
+
+		for (int i = 0; i < 50; i++) {
+			rand = rand * 1103515245 + 12345;
+			const uint64_t a = (rand >> 4) % sample_count;
+			rand = rand * 1103515245 + 12345;
+			const uint64_t b = (rand >> 4) % sample_count;
+			const uint64_t start = std::min(a, b), end = std::max(a, b);
+
+			const uint64_t expected =
+				std::lower_bound(edges.begin(), edges.end(), end) -
+				std::lower_bound(edges.begin(), edges.end(), start);
+			BOOST_REQUIRE_EQUAL(s.get_edge_count(sig_index, start, end), expected);
+
+			// The nearest edges on either side of the origin
+			vector<LogicSegment::EdgePair> surrounding;
+			s.get_surrounding_edges(surrounding, a, sig_index);
+
+			vector<uint64_t> expected_edges;
+			auto next = std::upper_bound(edges.begin(), edges.end(), a);
+			if (next != edges.begin())
+				expected_edges.push_back(*(next - 1));
+			if (next != edges.end())
+				expected_edges.push_back(*next);
+
+			BOOST_REQUIRE_EQUAL(surrounding.size(), expected_edges.size());
+			for (unsigned int j = 0; j < surrounding.size(); j++)
+				BOOST_REQUIRE_EQUAL(surrounding[j].first, expected_edges[j]);
+		}
+
+		uint64_t edge;
+		for (uint64_t n = 0; n < edges.size(); n += 1 + edges.size() / 100) {
+			BOOST_REQUIRE(s.find_nth_edge(sig_index, n, edge));
+			BOOST_REQUIRE_EQUAL(edge, edges[n]);
+		}
+		if (!edges.empty()) {
+			BOOST_REQUIRE(s.find_nth_edge(sig_index, edges.size() - 1, edge));
+			BOOST_CHECK_EQUAL(edge, edges.back());
+		}
+		BOOST_CHECK(!s.find_nth_edge(sig_index, edges.size(), edge));
+	}
+}
+
+static void check_high_counts(LogicSegment &s)
+{
+	const unsigned int unit_size = s.unit_size();
+	const uint64_t sample_count = s.get_sample_count();
+
+	vector<uint8_t> data(sample_count * unit_size);
+	s.get_samples(0, sample_count, data.data());
+
+	uint32_t rand = 7;
+	for (int sig_index : {1, (int)unit_size * 4, (int)unit_size * 8 - 1}) {
+		// Count the high samples up to every sample
+		vector<uint64_t> counts(sample_count + 1, 0);
+		const unsigned int byte = sig_index / 8, bit = sig_index % 8;
+		for (uint64_t i = 0; i < sample_count; i++)
+			counts[i + 1] = counts[i] +
+				((data[i * unit_size + byte] >> bit) & 1);
+
+		BOOST_CHECK_EQUAL(s.get_high_sample_count(sig_index, 0, sample_count),
+			counts[sample_count]);
+
+		for (int i = 0; i < 50; i++) {
+			rand = rand * 1103515245 + 12345;
+			const uint64_t a = (rand >> 4) % sample_count;
+			rand = rand * 1103515245 + 12345;
+			const uint64_t b = (rand >> 4) % sample_count;
+			const uint64_t start = std::min(a, b), end = std::max(a, b);
+
+			BOOST_REQUIRE_EQUAL(s.get_high_sample_count(sig_index, start, end),
+				counts[end] - counts[start]);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(MatchingEdges)
+{
+	Logic logic(16);
+	LogicSegment s(logic, 0, 2, 1);
+
+	uint32_t rand = 1;
+	for (int i = 0; i < 7; i++)
+		fill_toggling(s, 50000 + i * 12345, rand);
+
+	check_edges(s);
+	check_high_counts(s);
+}
+
+BOOST_AUTO_TEST_CASE(SparseEdges)
+{
+	// Few edges far apart, so that the searches zoom through most levels
+	// of the mip-map, and a tail that isn't summarized yet
+	const uint64_t sample_count = 3 * 1024 * 1024 + 7;
+	const vector<uint64_t> edges = {1, 17, 4096, 70000, 1048576, 2500001,
+		sample_count - 3};
+
+	Logic logic(8);
+	LogicSegment s(logic, 0, 1, 1);
+
+	vector<uint8_t> data(sample_count, 0);
+	for (uint64_t edge : edges)
+		for (uint64_t i = edge; i < sample_count; i++)
+			data[i] ^= 0x10;
+	s.append_payload(data.data(), data.size());
+
+	uint64_t edge;
+	vector<uint64_t> origins = {0, sample_count - 1};
+	for (uint64_t e : edges)
+		for (uint64_t origin : {e - 1, e, e + 1})
+			origins.push_back(origin);
+	for (uint64_t origin = 0; origin < sample_count; origin += 9973)
+		origins.push_back(origin);
+
+	for (uint64_t origin : origins) {
+		auto next = std::upper_bound(edges.begin(), edges.end(), origin);
+
+		BOOST_REQUIRE_EQUAL(s.find_previous_edge(4, origin, edge),
+			next != edges.begin());
+		if (next != edges.begin())
+			BOOST_REQUIRE_EQUAL(edge, *(next - 1));
+
+		BOOST_REQUIRE_EQUAL(s.find_next_edge(4, origin, edge),
+			next != edges.end());
+		if (next != edges.end())
+			BOOST_REQUIRE_EQUAL(edge, *next);
+
+		// Other signals don't have any edges
+		BOOST_REQUIRE(!s.find_previous_edge(3, origin, edge));
+		BOOST_REQUIRE(!s.find_next_edge(3, origin, edge));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(UnitSizes)
+{
+	for (unsigned int unit_size = 1; unit_size <= 8; unit_size++) {
+		Logic logic(unit_size * 8);
+		LogicSegment s(logic, 0, unit_size, 1);
+
+		uint32_t rand = unit_size;
+		for (int i = 0; i < 3; i++)
+			fill_toggling(s, 20000 + i * 777, rand);
+
+		check_edges(s);
+		check_high_counts(s);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Rolling)
+{
+	Logic logic(24);
+	LogicSegment s(logic, 0, 3, 1);
+	s.set_max_sample_count(300000);
+
+	uint32_t rand = 1;
+	for (int i = 0; i < 40; i++) {
+		fill_toggling(s, 30001, rand);
+
+		if (i % 10 == 9) {
+			check_edges(s);
+			check_high_counts(s);
+		}
+	}
+
+	BOOST_CHECK(s.evicted_sample_count() > 0);
+}
+
+// Measures the edge searches of mouse moves and the duty cycle
+// measurements of cursor ranges
+BENCHMARK_TEST_CASE(Benchmark)
+{
+	const uint64_t sample_count = 32 * 1024 * 1024;
+
+	Logic logic(8);
+	LogicSegment s(logic, 0, 1, 1);
+
+	Stopwatch stopwatch;
+	fill_segment(s, sample_count);
+	const long long fill_time = stopwatch.microseconds();
+
+	// Search the edges around the origin of many mouse moves
+	vector<LogicSegment::EdgePair> edges;
+	stopwatch.restart();
+	for (uint64_t origin = sample_count / 2; origin < sample_count; origin += 1000) {
+		edges.clear();
+		s.get_surrounding_edges(edges, origin, 7);
+	}
+	const long long search_time = stopwatch.microseconds();
+
+	// Measure the duty cycle of many cursor ranges
+	uint64_t high_count = 0;
+	stopwatch.restart();
+	for (uint64_t origin = 0; origin < sample_count / 2; origin += 1000)
+		high_count += s.get_high_sample_count(7, origin, origin + sample_count / 2);
+	const long long count_time = stopwatch.microseconds();
+
+	BOOST_CHECK(high_count > 0);
+	BOOST_TEST_MESSAGE(sample_count << " samples appended in " << fill_time <<
+		" us, " << (sample_count / 2 / 1000) << " edge searches took " <<
+		search_time << " us, as many duty cycle measurements " <<
+		count_time << " us");
+}
+
+// Compares the time it takes to index the samples of every width
+BENCHMARK_TEST_CASE(UnitSizeBenchmark)
+{
+	const uint64_t sample_count = 8 * 1024 * 1024;
+
+	for (unsigned int unit_size = 1; unit_size <= 8; unit_size++) {
+		Logic logic(unit_size * 8);
+		LogicSegment s(logic, 0, unit_size, 1);
+		fill_segment(s, sample_count);
+
+		Stopwatch stopwatch;
+		const uint64_t edge_count = s.get_edge_count(0, 0, sample_count);
+		const long long edge_time = stopwatch.microseconds();
+
+		stopwatch.restart();
+		const uint64_t high_count = s.get_high_sample_count(0, 0, sample_count);
+		const long long high_time = stopwatch.microseconds();
+
+		BOOST_CHECK(edge_count > 0);
+		BOOST_CHECK(high_count > 0);
+		BOOST_TEST_MESSAGE("Unit size " << unit_size << ": edges indexed in " <<
+			edge_time << " us, high samples in " << high_time << " us");
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(LogicSegmentMultiChannelTest)
+
+static void check_multi_channel_edges(LogicSegment &s, uint64_t sig_mask)
+{
+	const uint64_t sample_count = s.get_sample_count();
+	const uint64_t ranges[][2] = {{0, sample_count - 1},
+		{12345, sample_count / 2 + 777}, {sample_count - 100, sample_count - 1}};
+
+	for (const auto &range : ranges)
+		for (float min_length : {1.0f, 3.0f, 15.9f, 16.0f, 100.0f, 3000.5f,
+				70000.0f}) {
+			vector< vector<LogicSegment::EdgePair> > edges;
+			s.get_subsampled_edges(edges, range[0], range[1], min_length,
+				sig_mask);
+			BOOST_REQUIRE_EQUAL(edges.size(), s.unit_size() * 8);
+
+			for (unsigned int i = 0; i < edges.size(); i++) {
+				vector<LogicSegment::EdgePair> expected;
+				if ((sig_mask >> i) & 1)
+					s.get_subsampled_edges(expected, range[0], range[1],
+						min_length, i);
+
+				BOOST_REQUIRE_MESSAGE(edges[i] == expected, "Signal " << i <<
+					", " << min_length << " samples per pixel, range " <<
+					range[0] << " to " << range[1]);
+			}
+		}
+}
+
+BOOST_AUTO_TEST_CASE(MatchingEdges)
+{
+	for (unsigned int unit_size : {1, 3, 8}) {
+		Logic logic(unit_size * 8);
+		LogicSegment s(logic, 0, unit_size, 1);
+
+		uint32_t rand = unit_size;
+		LogicSegmentEdgeIndexTest::fill_toggling(s, 300000, rand);
+		fill_segment(s, 300000);
+
+		const uint64_t all = (unit_size < 8) ?
+			((UINT64_C(1) << (unit_size * 8)) - 1) : ~UINT64_C(0);
+		check_multi_channel_edges(s, all);
+		check_multi_channel_edges(s, 0x46);
+	}
+}
+
+// Compares finding the edges of all channels one by one to a single pass
+BENCHMARK_TEST_CASE(Benchmark)
+{
+	const uint64_t sample_count = 16 * 1024 * 1024;
+
+	for (int bus = 0; bus < 2; bus++) {
+		Logic logic(64);
+		LogicSegment s(logic, 0, 8, 1);
+
+		// Channels toggling independently, or a bus whose channels change
+		// at the same time, driven by a counter
+		if (!bus)
+			fill_segment(s, sample_count);
+		else {
+			vector<uint64_t> data(sample_count);
+			for (uint64_t i = 0; i < sample_count; i++)
+				data[i] = (i / 1000) * UINT64_C(0x0101010101010101);
+			s.append_payload(data.data(), data.size() * sizeof(uint64_t));
+		}
+
+		// Build the mip-map before timing the searches
+		vector<LogicSegment::EdgePair> edges;
+		s.get_subsampled_edges(edges, 0, sample_count - 1, 1.0f, 0);
+
+		for (float min_length : {1.0f, 4.0f, 1000.0f}) {
+			Stopwatch stopwatch;
+			for (int i = 0; i < 64; i++) {
+				edges.clear();
+				s.get_subsampled_edges(edges, 0, sample_count - 1,
+					min_length, i);
+			}
+			const long long single_time = stopwatch.microseconds();
+
+			edges.clear();
+			stopwatch.restart();
+			s.get_subsampled_edges(edges, 0, sample_count - 1, min_length, 0);
+			const long long one_time = stopwatch.microseconds();
+
+			vector< vector<LogicSegment::EdgePair> > all_edges;
+			stopwatch.restart();
+			s.get_subsampled_edges(all_edges, 0, sample_count - 1,
+				min_length, ~UINT64_C(0));
+			const long long multi_time = stopwatch.microseconds();
+
+			BOOST_TEST_MESSAGE((bus ? "Bus, " : "Random toggles, ") <<
+				min_length << " samples per pixel: 64 channels one by one " <<
+				"in " << single_time << " us, in a single pass in " <<
+				multi_time << " us, channel 0 in " << one_time << " us");
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
 #if 0
 BOOST_AUTO_TEST_SUITE(LogicSegmentTest)
 
@@ -0,0 +1,273 @@
+/*
+ * This file is part of the PulseView project.
+ *
+ * Copyright (C) 2026 The PulseView developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <pv/data/mipmapkernels.hpp>
+
+#include "test/benchmark.hpp"
+
+using pv::data::MipMapKernels;
+using std::equal;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE(MipMapKernelsTest)
+
+static const unsigned int BlockLength = MipMapKernels::BlockLength;
+
+static void fill_random(vector<uint8_t> &data)
+{
+	uint32_t rand = 1;
+	for (uint8_t &byte : data) {
+		rand = rand * 1103515245 + 12345;
+		// Make most bits stay the same for a while
+		byte = ((rand >> 16) % 8) ? 0 : (rand >> 24);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(MatchReference)
+{
+	// An odd block count leaves a block for the tail of the vector kernels
+	const uint64_t block_count = 1001;
+	const MipMapKernels::InstructionSet default_set =
+		MipMapKernels::instruction_set();
+
+	for (unsigned int unit_size = 1; unit_size <= 8; unit_size++) {
+		vector<uint8_t> in(block_count * BlockLength * unit_size);
+		fill_random(in);
+		const uint8_t prev_sample[8] = {0xa5, 0, 0xff, 1, 2, 3, 4, 5};
+
+		// Compute the expected results sample by sample
+		vector<uint8_t> xor_ref(block_count * unit_size, 0);
+		vector<uint8_t> or_ref(block_count * unit_size, 0);
+		for (uint64_t i = 0; i < block_count * BlockLength; i++)
+			for (unsigned int j = 0; j < unit_size; j++) {
+				const uint8_t prev = (i == 0) ? prev_sample[j] :
+					in[(i - 1) * unit_size + j];
+				const uint8_t sample = in[i * unit_size + j];
+				xor_ref[(i / BlockLength) * unit_size + j] |= prev ^ sample;
+				or_ref[(i / BlockLength) * unit_size + j] |= sample;
+			}
+
+		for (int set = MipMapKernels::Scalar;
+			set <= MipMapKernels::supported_instruction_set(); set++) {
+			MipMapKernels::set_instruction_set((MipMapKernels::InstructionSet)set);
+
+			vector<uint8_t> out(block_count * unit_size);
+			MipMapKernels::xor_accumulate(in.data(), out.data(), block_count,
+				unit_size, prev_sample);
+			BOOST_CHECK_MESSAGE(out == xor_ref, "XOR kernel, " <<
+				MipMapKernels::instruction_set_name(MipMapKernels::instruction_set()) <<
+				", unit size " << unit_size);
+
+			MipMapKernels::or_reduce(in.data(), out.data(), block_count, unit_size);
+			BOOST_CHECK_MESSAGE(out == or_ref, "OR kernel, " <<
+				MipMapKernels::instruction_set_name(MipMapKernels::instruction_set()) <<
+				", unit size " << unit_size);
+		}
+	}
+
+	MipMapKernels::set_instruction_set(default_set);
+}
+
+BOOST_AUTO_TEST_CASE(MinMaxReference)
+{
+	const uint64_t block_count = 1001;
+	const MipMapKernels::InstructionSet default_set =
+		MipMapKernels::instruction_set();
+
+	vector<float> in(block_count * BlockLength);
+	uint32_t rand = 1;
+	for (float &value : in) {
+		rand = rand * 1103515245 + 12345;
+		value = (int)(rand >> 16) * 0.001f - 16.0f;
+	}
+
+	// Scatter NaNs and infinities over the blocks, fill one block with NaNs
+	// and one with infinities
+	for (uint64_t i = 3; i < in.size(); i += 37)
+		in[i] = NAN;
+	in[100] = INFINITY;
+	in[201] = -INFINITY;
+	std::fill(in.begin() + 5 * BlockLength, in.begin() + 6 * BlockLength, NAN);
+	std::fill(in.begin() + 7 * BlockLength, in.begin() + 8 * BlockLength,
+		INFINITY);
+
+	// Compute the expected results, ignoring NaNs
+	vector<float> ref(block_count * 2);
+	for (uint64_t b = 0; b < block_count; b++) {
+		vector<float> values;
+		for (unsigned int i = 0; i < BlockLength; i++)
+			if (!std::isnan(in[b * BlockLength + i]))
+				values.push_back(in[b * BlockLength + i]);
+
+		ref[b * 2] = values.empty() ? NAN :
+			*std::min_element(values.begin(), values.end());
+		ref[b * 2 + 1] = values.empty() ? NAN :
+			*std::max_element(values.begin(), values.end());
+	}
+
+	// The next level combines the pairs, a block of pairs is all NaN as well
+	vector<float> pairs(ref);
+	std::fill(pairs.begin() + 32 * BlockLength, pairs.begin() + 34 * BlockLength,
+		NAN);
+	const uint64_t pair_block_count = block_count / BlockLength;
+	vector<float> pair_ref(pair_block_count * 2);
+	for (uint64_t b = 0; b < pair_block_count; b++) {
+		float lo = NAN, hi = NAN;
+		for (unsigned int i = 0; i < BlockLength; i++) {
+			const float* const p = &pairs[(b * BlockLength + i) * 2];
+			if (!std::isnan(p[0]) && (std::isnan(lo) || p[0] < lo))
+				lo = p[0];
+			if (!std::isnan(p[1]) && (std::isnan(hi) || p[1] > hi))
+				hi = p[1];
+		}
+		pair_ref[b * 2] = lo;
+		pair_ref[b * 2 + 1] = hi;
+	}
+
+	// NaNs don't compare equal
+	const auto same = [](const vector<float> &a, const vector<float> &b) {
+		for (uint64_t i = 0; i < a.size(); i++)
+			if ((a[i] != b[i]) && !(std::isnan(a[i]) && std::isnan(b[i])))
+				return false;
+		return true;
+	};
+
+	for (int set = MipMapKernels::Scalar;
+		set <= MipMapKernels::supported_instruction_set(); set++) {
+		MipMapKernels::set_instruction_set((MipMapKernels::InstructionSet)set);
+
+		vector<float> out(block_count * 2);
+		MipMapKernels::min_max_samples(in.data(), out.data(), block_count);
+		BOOST_CHECK_MESSAGE(same(out, ref), "Min/max kernel, " <<
+			MipMapKernels::instruction_set_name(MipMapKernels::instruction_set()));
+
+		vector<float> pair_out(pair_block_count * 2);
+		MipMapKernels::min_max_reduce(pairs.data(), pair_out.data(),
+			pair_block_count);
+		BOOST_CHECK_MESSAGE(same(pair_out, pair_ref), "Min/max reduction, " <<
+			MipMapKernels::instruction_set_name(MipMapKernels::instruction_set()));
+	}
+
+	MipMapKernels::set_instruction_set(default_set);
+}
+
+BOOST_AUTO_TEST_CASE(DeinterleaveReference)
+{
+	// Odd sample counts leave rows for the tail of the vector kernels
+	const uint64_t sample_count = 1003;
+	const MipMapKernels::InstructionSet default_set =
+		MipMapKernels::instruction_set();
+
+	for (unsigned int channel_count = 1; channel_count <= 17; channel_count++) {
+		vector<float> in(sample_count * channel_count);
+		for (uint64_t i = 0; i < in.size(); i++)
+			in[i] = i * 0.5f;
+
+		vector<float> ref(in.size());
+		for (uint64_t i = 0; i < sample_count; i++)
+			for (unsigned int c = 0; c < channel_count; c++)
+				ref[c * sample_count + i] = in[i * channel_count + c];
+
+		for (int set = MipMapKernels::Scalar;
+			set <= MipMapKernels::supported_instruction_set(); set++) {
+			MipMapKernels::set_instruction_set((MipMapKernels::InstructionSet)set);
+
+			vector<float> out(in.size());
+			MipMapKernels::deinterleave(in.data(), out.data(), sample_count,
+				channel_count);
+			BOOST_CHECK_MESSAGE(out == ref, "Deinterleave kernel, " <<
+				MipMapKernels::instruction_set_name(MipMapKernels::instruction_set()) <<
+				", " << channel_count << " channels");
+
+			// Only the selected channels need to be split off
+			vector<uint8_t> channel_mask(channel_count);
+			for (unsigned int c = 0; c < channel_count; c += 3)
+				channel_mask[c] = 1;
+
+			vector<float> masked_out(in.size());
+			MipMapKernels::deinterleave(in.data(), masked_out.data(), sample_count,
+				channel_count, channel_mask.data());
+			for (unsigned int c = 0; c < channel_count; c += 3)
+				BOOST_CHECK_MESSAGE(equal(ref.begin() + c * sample_count,
+					ref.begin() + (c + 1) * sample_count,
+					masked_out.begin() + c * sample_count),
+					"Masked deinterleave kernel, " <<
+					MipMapKernels::instruction_set_name(MipMapKernels::instruction_set()) <<
+					", " << channel_count << " channels, channel " << c);
+		}
+	}
+
+	MipMapKernels::set_instruction_set(default_set);
+}
+
+// Measures the throughput of the kernels of each instruction set
+BENCHMARK_TEST_CASE(Benchmark)
+{
+	const uint64_t data_size = 32 * 1024 * 1024;
+	const int passes = 4;
+	const MipMapKernels::InstructionSet default_set =
+		MipMapKernels::instruction_set();
+
+	vector<uint8_t> in(data_size);
+	fill_random(in);
+	vector<uint8_t> out(data_size / BlockLength);
+	const uint8_t prev_sample[8] = {0};
+
+	for (unsigned int unit_size = 1; unit_size <= 8; unit_size++) {
+		const uint64_t block_count = data_size / (BlockLength * unit_size);
+
+		for (int set = MipMapKernels::Scalar;
+			set <= MipMapKernels::supported_instruction_set(); set++) {
+			MipMapKernels::set_instruction_set((MipMapKernels::InstructionSet)set);
+
+			double rates[2];
+			for (int kernel = 0; kernel < 2; kernel++) {
+				const Stopwatch stopwatch;
+				for (int pass = 0; pass < passes; pass++)
+					if (kernel == 0)
+						MipMapKernels::xor_accumulate(in.data(), out.data(),
+							block_count, unit_size, prev_sample);
+					else
+						MipMapKernels::or_reduce(in.data(), out.data(),
+							block_count, unit_size);
+				const double ns = stopwatch.nanoseconds();
+
+				// Bytes per nanosecond equals GB/s
+				rates[kernel] = (ns > 0) ?
+					(block_count * BlockLength * unit_size * passes / ns) : 0;
+			}
+
+			BOOST_TEST_MESSAGE("Unit size " << unit_size << ", " <<
+				MipMapKernels::instruction_set_name(MipMapKernels::instruction_set()) <<
+				": XOR " << rates[0] << " GB/s, OR " << rates[1] << " GB/s");
+		}
+	}
+
+	MipMapKernels::set_instruction_set(default_set);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -20,13 +20,30 @@
 
 #include <extdef.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <boost/test/unit_test.hpp>
 
+#include <pv/data/chunkpool.hpp>
+#include <pv/data/memorybudget.hpp>
 #include <pv/data/segment.hpp>
+#include <pv/data/swapfile.hpp>
 
+#include "test/benchmark.hpp"
+
+using pv::data::ChunkPool;
+using pv::data::MemoryAccount;
+using pv::data::MemoryBudget;
 using pv::data::Segment;
+using pv::data::SwapFile;
 
 BOOST_AUTO_TEST_SUITE(SegmentTest)
 
@@ -296,4 +313,731 @@ BOOST_AUTO_TEST_CASE(MaxSize32MultiIterated)
 	s.end_sample_iteration(it);
 }
 
+BOOST_AUTO_TEST_CASE(MaxSize32MultiSwapped)
+{
+	// Keep only one chunk resident so that the others need to be paged in
+	SwapFile::configure(true, QString(), pv::data::Segment::MaxChunkSize);
+	Segment s(0, 1, sizeof(uint32_t));
+	SwapFile::configure(false, QString(), pv::data::Segment::MaxChunkSize);
+
+	uint32_t num_samples = 3*(pv::data::Segment::MaxChunkSize / sizeof(uint32_t));
+
+	//----- Add all samples, requiring multiple swapped chunks, in one call ----//
+	uint32_t *data = new uint32_t[num_samples];
+	for (uint32_t i = 0; i < num_samples; i++)
+		data[i] = i;
+
+	s.append_samples(data, num_samples);
+	delete[] data;
+
+	BOOST_CHECK(s.get_sample_count() == num_samples);
+	BOOST_CHECK(SwapFile::resident_size() < SwapFile::mapped_size());
+
+	uint8_t *sample_data = new uint8_t[sizeof(uint32_t) * num_samples];
+	s.get_raw_samples(0, num_samples, sample_data);
+	for (uint32_t i = 0; i < num_samples; i++) {
+		BOOST_CHECK_EQUAL(*((uint32_t*)(sample_data + i * sizeof(uint32_t))), i);
+	}
+	delete[] sample_data;
+
+	// Paging the chunks back in evicted the others in turn
+	BOOST_CHECK(SwapFile::resident_size() < SwapFile::mapped_size());
+
+	pv::data::SegmentDataIterator* it = s.begin_sample_iteration(0);
+
+	for (uint32_t i = 0; i < num_samples; i++) {
+		BOOST_CHECK_EQUAL(*((uint32_t*)s.get_iterator_value(it)), i);
+		s.continue_sample_iteration(it, 1);
+	}
+
+	s.end_sample_iteration(it);
+
+	SwapFile::configure(false, QString(), SwapFile::DefaultHotBudget);
+}
+
+BOOST_AUTO_TEST_CASE(MaxSize8MultiCompressed)
+{
+	Segment s(0, 1, sizeof(uint8_t));
+	s.set_chunk_compression(Segment::RunLengthCompression);
+
+	// Long runs with a few short ones in between, spanning multiple chunks
+	uint32_t num_samples = 3*pv::data::Segment::MaxChunkSize + 1000;
+
+	uint8_t *data = new uint8_t[num_samples];
+	for (uint32_t i = 0; i < num_samples; i++)
+		data[i] = (i / 4096) % 256;
+
+	s.append_samples(data, num_samples);
+	s.free_unused_memory();
+
+	// Wait for the background compression to finish
+	for (int i = 0; (i < 500) && (s.compressed_sample_count() < num_samples); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	BOOST_CHECK(s.get_sample_count() == num_samples);
+	BOOST_CHECK_EQUAL(s.compressed_sample_count(), num_samples);
+	BOOST_CHECK(s.compressed_size() < num_samples / 100);
+
+	uint8_t *sample_data = new uint8_t[num_samples];
+	s.get_raw_samples(0, num_samples, sample_data);
+	BOOST_CHECK(memcmp(data, sample_data, num_samples) == 0);
+	delete[] sample_data;
+
+	pv::data::SegmentDataIterator* it = s.begin_sample_iteration(0);
+
+	for (uint32_t i = 0; i < num_samples; i++) {
+		BOOST_CHECK_EQUAL(*s.get_iterator_value(it), data[i]);
+		s.continue_sample_iteration(it, 1);
+	}
+
+	s.end_sample_iteration(it);
+
+	delete[] data;
+}
+
+BOOST_AUTO_TEST_CASE(MaxSize32MultiXorCompressed)
+{
+	Segment s(0, 1, sizeof(float));
+	s.set_chunk_compression(Segment::XorCompression);
+
+	// A slow waveform followed by a chunk of noise, which doesn't compress
+	uint64_t chunk_num = 0;
+	while (s.chunk_start_sample(chunk_num) < 3*pv::data::Segment::MaxChunkSize / sizeof(float))
+		chunk_num++;
+	const uint32_t wave_samples = s.chunk_start_sample(chunk_num);
+	const uint32_t num_samples = wave_samples + s.chunk_capacity(chunk_num);
+
+	float *data = new float[num_samples];
+	for (uint32_t i = 0; i < wave_samples; i++)
+		data[i] = (i % 100000 < 30000) ? 0.0f : roundf(sinf(i * 1e-4f) * 1000) / 1024;
+	uint32_t rand = 1;
+	for (uint32_t i = wave_samples; i < num_samples; i++) {
+		rand = rand * 1103515245 + 12345;
+		data[i] = (float)rand;
+	}
+
+	s.append_samples(data, num_samples);
+	s.free_unused_memory();
+
+	// Wait for the background compression to finish
+	for (int i = 0; (i < 500) && (s.compressed_sample_count() < wave_samples); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	BOOST_CHECK(s.get_sample_count() == num_samples);
+	BOOST_CHECK_EQUAL(s.compressed_sample_count(), wave_samples);
+	BOOST_CHECK(s.compressed_size() < wave_samples * sizeof(float) / 3);
+
+	float *sample_data = new float[num_samples];
+	s.get_raw_samples(0, num_samples, (uint8_t*)sample_data);
+	BOOST_CHECK(memcmp(data, sample_data, num_samples * sizeof(float)) == 0);
+	delete[] sample_data;
+
+	delete[] data;
+}
+
+/// Gives access to the lock that derived classes hold while appending
+struct LockableSegment : public Segment
+{
+	LockableSegment() :
+		Segment(0, 1, sizeof(uint32_t))
+	{
+	}
+
+	using Segment::append_samples;
+	using Segment::get_raw_samples;
+
+	std::recursive_mutex& mutex() { return mutex_; }
+};
+
+/**
+ * Reads the last sample while a writer appends blocks and holds the lock
+ * for 500us each time. Returns the number of reads done while the writer
+ * held the lock, and the latencies of all reads in nanoseconds.
+ */
+static uint64_t read_under_contention(int block_count,
+	std::vector<long long> &latencies)
+{
+	LockableSegment s;
+
+	const uint32_t block_size = 4096;
+
+	std::atomic<bool> writer_locked(false), writer_done(false);
+
+	// The writer saturates the segment lock like a derived class does
+	// while it updates its own data structures after appending
+	std::thread writer([&] {
+		std::vector<uint32_t> block(block_size);
+		uint32_t value = 0;
+
+		for (int b = 0; b < block_count; b++) {
+			for (uint32_t& v : block)
+				v = value++;
+
+			std::lock_guard<std::recursive_mutex> lock(s.mutex());
+			writer_locked = true;
+			s.append_samples(block.data(), block_size);
+
+			const Stopwatch hold;
+			while (hold.microseconds() < 500);
+			writer_locked = false;
+		}
+
+		writer_done = true;
+	});
+
+	uint64_t reads_while_locked = 0;
+
+	while (!writer_done) {
+		const bool locked = writer_locked;
+		const Stopwatch read;
+
+		const uint64_t count = s.get_sample_count();
+		uint32_t sample = 0;
+		if (count > 0)
+			s.get_raw_samples(count - 1, 1, (uint8_t*)&sample);
+
+		latencies.push_back(read.nanoseconds());
+
+		if (locked && writer_locked)
+			reads_while_locked++;
+
+		if (count > 0)
+			BOOST_REQUIRE_EQUAL(sample, count - 1);
+	}
+
+	writer.join();
+
+	BOOST_CHECK_EQUAL(s.get_sample_count(), block_size * block_count);
+
+	return reads_while_locked;
+}
+
+BOOST_AUTO_TEST_CASE(MaxSize32ReaderContention)
+{
+	std::vector<long long> latencies;
+
+	// Readers must make progress while the writer holds the lock
+	BOOST_CHECK(read_under_contention(20, latencies) > 0);
+}
+
+BENCHMARK_TEST_CASE(ReaderContentionBenchmark)
+{
+	std::vector<long long> latencies;
+	read_under_contention(500, latencies);
+
+	std::sort(latencies.begin(), latencies.end());
+	BOOST_TEST_MESSAGE("Reader latency under contention (ns): median " <<
+		latencies[latencies.size() / 2] << ", p99 " <<
+		latencies[latencies.size() * 99 / 100] << ", max " <<
+		latencies.back() << " over " << latencies.size() << " reads");
+}
+
+BOOST_AUTO_TEST_CASE(MaxSize32PoolReuse)
+{
+	uint32_t num_samples = 3*(pv::data::Segment::MaxChunkSize / sizeof(uint32_t));
+
+	uint32_t *data = new uint32_t[num_samples];
+	for (uint32_t i = 0; i < num_samples; i++)
+		data[i] = i;
+
+	{
+		Segment s(0, 1, sizeof(uint32_t));
+		s.append_samples(data, num_samples);
+	}
+
+	//----- A second acquisition of the same size must reuse all chunks ----//
+	const uint64_t allocations = ChunkPool::allocation_count();
+	const uint64_t heap_allocations = ChunkPool::heap_allocation_count();
+
+	uint64_t chunk_count;
+
+	{
+		Segment s(0, 1, sizeof(uint32_t));
+		s.append_samples(data, num_samples);
+		chunk_count = s.chunk_table()->chunks.size();
+
+		BOOST_CHECK(s.get_sample_count() == num_samples);
+
+		uint8_t *sample_data = new uint8_t[sizeof(uint32_t) * num_samples];
+		s.get_raw_samples(0, num_samples, sample_data);
+		BOOST_CHECK(memcmp(data, sample_data, sizeof(uint32_t) * num_samples) == 0);
+		delete[] sample_data;
+	}
+
+	BOOST_CHECK_EQUAL(ChunkPool::allocation_count() - allocations, chunk_count);
+	BOOST_CHECK_EQUAL(ChunkPool::heap_allocation_count(), heap_allocations);
+	BOOST_CHECK(ChunkPool::pooled_size() > 0);
+
+	//----- Trimmed chunks aren't pooled ----//
+	ChunkPool::set_pool_limit(UINT64_MAX);
+
+	uint64_t full_chunks_size = 0, pooled_size;
+
+	{
+		Segment s(0, 1, sizeof(uint32_t));
+		s.append_samples(data, num_samples / 2);
+		s.free_unused_memory();
+
+		const auto table = s.chunk_table();
+		for (uint64_t i = 0; i + 1 < table->chunks.size(); i++)
+			full_chunks_size += table->chunks[i].size;
+
+		pooled_size = ChunkPool::pooled_size();
+	}
+
+	BOOST_CHECK_EQUAL(ChunkPool::pooled_size() - pooled_size, full_chunks_size);
+
+	ChunkPool::set_pool_limit(ChunkPool::DefaultPoolLimit);
+
+	delete[] data;
+}
+
+BOOST_AUTO_TEST_CASE(MaxSize8MultiInPlace)
+{
+	Segment s(0, 1, sizeof(uint8_t));
+
+	uint32_t num_samples = 2*pv::data::Segment::MaxChunkSize + 1000;
+	const uint32_t block_size = 3000;
+
+	const uint64_t copied_bytes = Segment::copied_byte_count();
+	const uint64_t in_place_bytes = Segment::in_place_byte_count();
+
+	//----- Write in place where possible, copy where a block doesn't fit ----//
+	uint8_t *block = new uint8_t[block_size];
+	uint64_t expected_copied_bytes = 0;
+	uint32_t i = 0;
+	while (i < num_samples) {
+		const uint32_t count = std::min(block_size, num_samples - i);
+
+		uint64_t max_count;
+		uint8_t *dest = s.get_append_buffer(max_count);
+		if (count > max_count)
+			dest = block;
+
+		for (uint32_t j = 0; j < count; j++)
+			dest[j] = (i + j) % 251;
+
+		if (dest == block) {
+			s.append_samples(block, count);
+			expected_copied_bytes += count;
+		} else
+			s.commit_appended_samples(count);
+
+		i += count;
+	}
+	delete[] block;
+
+	BOOST_CHECK(s.get_sample_count() == num_samples);
+
+	// Only the blocks spanning a chunk boundary were copied
+	BOOST_CHECK(expected_copied_bytes > 0);
+	BOOST_CHECK(expected_copied_bytes <= s.chunk_table()->chunks.size() * block_size);
+	BOOST_CHECK_EQUAL(Segment::copied_byte_count() - copied_bytes,
+		expected_copied_bytes);
+	BOOST_CHECK_EQUAL(Segment::in_place_byte_count() - in_place_bytes,
+		num_samples - expected_copied_bytes);
+
+	uint8_t *sample_data = new uint8_t[num_samples];
+	s.get_raw_samples(0, num_samples, sample_data);
+	for (i = 0; i < num_samples; i++)
+		BOOST_REQUIRE_EQUAL(sample_data[i], i % 251);
+	delete[] sample_data;
+}
+
+BOOST_AUTO_TEST_CASE(SmallSize16ManySegments)
+{
+	const unsigned int segment_count = 5000;
+	const uint32_t num_samples = 100;
+
+	uint16_t data[num_samples];
+	for (uint32_t i = 0; i < num_samples; i++)
+		data[i] = i;
+
+	//----- Many short segments must each only occupy a small chunk ----//
+	std::vector<Segment*> segments;
+	uint64_t chunk_bytes = 0;
+
+	for (unsigned int n = 0; n < segment_count; n++) {
+		Segment* s = new Segment(n, 1, sizeof(uint16_t));
+		s->append_samples(data, num_samples);
+
+		BOOST_REQUIRE_EQUAL(s->chunk_table()->chunks.size(), 1);
+		chunk_bytes += s->chunk_capacity(0) * sizeof(uint16_t);
+
+		segments.push_back(s);
+	}
+
+	BOOST_CHECK(chunk_bytes <= segment_count * Segment::InitialChunkSize);
+
+	for (Segment* s : segments) {
+		uint16_t sample_data[num_samples];
+		s->get_raw_samples(0, num_samples, (uint8_t*)sample_data);
+		BOOST_REQUIRE(memcmp(data, sample_data, sizeof(data)) == 0);
+		delete s;
+	}
+
+	//----- Growing chunks must be addressed correctly ----//
+	Segment s(0, 1, sizeof(uint16_t));
+
+	const uint32_t long_num_samples = 2 * Segment::MaxChunkSize / sizeof(uint16_t);
+	for (uint32_t i = 0; i < long_num_samples; i++) {
+		const uint16_t sample = i % 65521;
+		s.append_single_sample((void*)&sample);
+	}
+
+	BOOST_CHECK(s.chunk_table()->chunks.size() > 2);
+	BOOST_CHECK_EQUAL(s.chunk_capacity(s.chunk_table()->chunks.size() - 1),
+		Segment::MaxChunkSize / sizeof(uint16_t));
+
+	for (uint64_t c = 0; c < s.chunk_table()->chunks.size(); c++) {
+		BOOST_CHECK_EQUAL(s.chunk_of_sample(s.chunk_start_sample(c)), c);
+		if (c > 0)
+			BOOST_CHECK_EQUAL(s.chunk_of_sample(s.chunk_start_sample(c) - 1), c - 1);
+	}
+
+	uint16_t *sample_data = new uint16_t[long_num_samples];
+	s.get_raw_samples(0, long_num_samples, (uint8_t*)sample_data);
+	for (uint32_t i = 0; i < long_num_samples; i++)
+		BOOST_REQUIRE_EQUAL(sample_data[i], i % 65521);
+
+	// Reading across a chunk boundary
+	const uint64_t boundary = s.chunk_start_sample(3);
+	s.get_raw_samples(boundary - 10, 20, (uint8_t*)sample_data);
+	for (uint32_t i = 0; i < 20; i++)
+		BOOST_REQUIRE_EQUAL(sample_data[i], (boundary - 10 + i) % 65521);
+	delete[] sample_data;
+
+	pv::data::SegmentDataIterator* it = s.begin_sample_iteration(0);
+	for (uint32_t i = 0; i < long_num_samples; i += 16) {
+		BOOST_REQUIRE_EQUAL(*((uint16_t*)s.get_iterator_value(it)), i % 65521);
+		BOOST_REQUIRE(s.get_iterator_valid_length(it) >= 16);
+		s.continue_sample_iteration(it, 16);
+	}
+	s.end_sample_iteration(it);
+}
+
+BOOST_AUTO_TEST_CASE(MediumSize32Rolling)
+{
+	const double samplerate = 1000;
+	Segment s(0, samplerate, sizeof(uint32_t));
+
+	const uint64_t max_sample_count = Segment::MaxChunkSize / sizeof(uint32_t);
+	s.set_max_sample_count(max_sample_count);
+
+	//----- Keep appending, the segment must only hold the most recent samples ----//
+	const uint32_t block_size = 100000;
+	uint32_t *block = new uint32_t[block_size];
+	uint32_t total = 0;
+
+	for (int b = 0; b < 100; b++) {
+		for (uint32_t i = 0; i < block_size; i++)
+			block[i] = total++;
+
+		s.append_samples(block, block_size);
+		s.evict_old_chunks();
+
+		const uint64_t count = s.get_sample_count();
+		BOOST_REQUIRE_EQUAL(count + s.evicted_sample_count(), total);
+		if (total >= max_sample_count)
+			BOOST_REQUIRE(count >= max_sample_count);
+		BOOST_REQUIRE(count <= max_sample_count + max_sample_count / 8 +
+			s.chunk_capacity(s.chunk_table()->first_chunk) + block_size);
+	}
+	delete[] block;
+
+	BOOST_CHECK(s.evicted_sample_count() > 0);
+	BOOST_CHECK(s.evicted_sample_count() % 16 == 0);
+	BOOST_CHECK(s.start_time() == pv::util::Timestamp(s.evicted_sample_count()) / samplerate);
+
+	// The first sample held is the oldest one that wasn't evicted
+	const uint64_t count = s.get_sample_count();
+	uint32_t *sample_data = new uint32_t[count];
+	s.get_raw_samples(0, count, (uint8_t*)sample_data);
+	for (uint64_t i = 0; i < count; i++)
+		BOOST_REQUIRE_EQUAL(sample_data[i], s.evicted_sample_count() + i);
+	delete[] sample_data;
+
+	pv::data::SegmentDataIterator* it = s.begin_sample_iteration(0);
+	for (uint64_t i = 0; i < count; i += 16) {
+		BOOST_REQUIRE_EQUAL(*((uint32_t*)s.get_iterator_value(it)),
+			s.evicted_sample_count() + i);
+		s.continue_sample_iteration(it, 16);
+	}
+	s.end_sample_iteration(it);
+}
+
+BOOST_AUTO_TEST_CASE(MediumSize32RollingNumbers)
+{
+	const double samplerate = 1000;
+	Segment s(0, samplerate, sizeof(uint32_t));
+
+	// Sample numbers continue those of another segment
+	const uint64_t base = 12345;
+	s.set_first_sample_number(base);
+	BOOST_CHECK_EQUAL(s.first_sample_number(), base);
+	BOOST_CHECK_EQUAL(s.end_sample_number(), base);
+
+	const uint64_t max_sample_count = Segment::MaxChunkSize / sizeof(uint32_t);
+	s.set_max_sample_count(max_sample_count);
+
+	const uint32_t block_size = 100000;
+	uint32_t *block = new uint32_t[block_size];
+	uint32_t total = 0;
+	vector<pv::data::SegmentSpan> spans;
+
+	for (int b = 0; b < 50; b++) {
+		for (uint32_t i = 0; i < block_size; i++)
+			block[i] = base + total++;
+
+		s.append_samples(block, block_size);
+		s.evict_old_chunks();
+
+		BOOST_REQUIRE_EQUAL(s.end_sample_number(), base + total);
+		BOOST_REQUIRE_EQUAL(s.first_sample_number(),
+			base + s.evicted_sample_count());
+
+		//----- Samples are found by number no matter how many were evicted ----//
+		const uint64_t number = s.end_sample_number() - block_size;
+		BOOST_REQUIRE(s.get_sample_spans_by_number(number, block_size, spans));
+
+		uint64_t n = number;
+		for (const pv::data::SegmentSpan &span : spans)
+			for (uint64_t i = 0; i < span.sample_count; i++)
+				BOOST_REQUIRE_EQUAL(((const uint32_t*)span.data)[i], n++);
+		BOOST_REQUIRE_EQUAL(n, s.end_sample_number());
+	}
+	delete[] block;
+
+	//----- Evicted samples can't be read by number anymore ----//
+	BOOST_REQUIRE(s.evicted_sample_count() > 0);
+	BOOST_CHECK(!s.get_sample_spans_by_number(base, 1, spans));
+	BOOST_CHECK(!s.get_sample_spans_by_number(s.first_sample_number() - 1, 2, spans));
+	BOOST_CHECK(s.get_sample_spans_by_number(s.first_sample_number(), 1, spans));
+
+	BOOST_CHECK(s.origin_time() == pv::util::Timestamp(0));
+	BOOST_CHECK(s.start_time() ==
+		pv::util::Timestamp(s.first_sample_number()) / samplerate);
+}
+
+BOOST_AUTO_TEST_CASE(MediumSize32RollingReaders)
+{
+	Segment s(0, 1, sizeof(uint32_t));
+
+	const uint64_t max_sample_count = Segment::MaxChunkSize / sizeof(uint32_t);
+	s.set_max_sample_count(max_sample_count);
+
+	const uint32_t block_size = 100000;
+	const int block_count = 320;
+	const uint64_t window = 4096;
+
+	std::atomic<bool> writer_done(false);
+
+	// Sample values are their index since the start plus one, so that
+	// zeroes can be told apart
+	std::thread writer([&] {
+		std::vector<uint32_t> block(block_size);
+		uint32_t value = 1;
+
+		for (int b = 0; b < block_count; b++) {
+			for (uint32_t& v : block)
+				v = value++;
+
+			s.append_samples(block.data(), block_size);
+			s.evict_old_chunks();
+		}
+
+		writer_done = true;
+	});
+
+	std::vector<uint32_t> samples(window);
+	uint64_t stable_reads = 0;
+
+	while (!writer_done) {
+		const uint64_t evicted = s.evicted_sample_count();
+		const uint64_t count = s.get_sample_count();
+		if (count < window)
+			continue;
+
+		// Read both ends of the segment, the start is where a wrong index
+		// base shows up first
+		for (uint64_t start : {(uint64_t)0, count - window}) {
+			s.get_raw_samples(start, window, (uint8_t*)samples.data());
+
+			if (s.evicted_sample_count() == evicted) {
+				// Nothing was evicted, the samples must be the ones counted
+				for (uint64_t i = 0; i < window; i++)
+					BOOST_REQUIRE_EQUAL(samples[i], evicted + start + i + 1);
+				stable_reads++;
+			} else {
+				// The indices shifted, but the samples must still be
+				// consecutive or zeroes past the end
+				for (uint64_t i = 1; i < window; i++)
+					BOOST_REQUIRE((samples[i] == samples[i - 1] + 1) ||
+						(samples[i] == 0));
+			}
+		}
+	}
+
+	writer.join();
+
+	BOOST_CHECK(s.evicted_sample_count() > 0);
+	BOOST_CHECK(stable_reads > 0);
+}
+
+BOOST_AUTO_TEST_CASE(MediumSize32Spans)
+{
+	Segment s(0, 1, sizeof(uint32_t));
+
+	const uint32_t block_size = 100000;
+	uint32_t *block = new uint32_t[block_size];
+	uint32_t total = 0;
+
+	for (int b = 0; b < 20; b++) {
+		for (uint32_t i = 0; i < block_size; i++)
+			block[i] = total++;
+
+		s.append_samples(block, block_size);
+	}
+	delete[] block;
+
+	//----- Spans cover the range in order, one per chunk ----//
+	const uint64_t start = 1234;
+	const uint64_t count = total - 2 * start;
+
+	vector<pv::data::SegmentSpan> spans;
+	s.get_sample_spans(start, count, spans);
+	BOOST_CHECK(spans.size() > 1);
+	BOOST_CHECK(spans.size() <= s.chunk_table()->chunks.size());
+
+	uint64_t sample = start;
+	for (const pv::data::SegmentSpan &span : spans) {
+		BOOST_REQUIRE(span.sample_count > 0);
+		const uint32_t *samples = (const uint32_t*)span.data;
+		for (uint64_t i = 0; i < span.sample_count; i++)
+			BOOST_REQUIRE_EQUAL(samples[i], sample++);
+	}
+	BOOST_CHECK_EQUAL(sample, start + count);
+
+	// Spans point into the chunks without copying them
+	BOOST_CHECK(spans.front().data ==
+		s.chunk_table()->chunks.front().data.get() + start * sizeof(uint32_t));
+
+	//----- Pinned chunks outlive their eviction ----//
+	s.set_max_sample_count(total / 4);
+	BOOST_REQUIRE(s.evict_old_chunks() > start);
+
+	const uint32_t *first = (const uint32_t*)spans.front().data;
+	for (uint64_t i = 0; i < spans.front().sample_count; i++)
+		BOOST_REQUIRE_EQUAL(first[i], start + i);
+}
+
+BOOST_AUTO_TEST_CASE(MediumSize8MemoryAccounting)
+{
+	const int owner = 0;
+	const uint64_t initial_usage = MemoryBudget::total_usage();
+
+	{
+		Segment s(0, 1, sizeof(uint8_t));
+		s.memory_account_.set_owner(&owner);
+
+		BOOST_CHECK_EQUAL(MemoryBudget::usage(&owner, MemoryAccount::SampleData),
+			s.chunk_capacity(0) + 7);
+
+		//----- Every chunk held is accounted for ----//
+		const uint64_t block_size = 100000;
+		uint8_t* const block = new uint8_t[block_size];
+		memset(block, 0, block_size);
+
+		for (int b = 0; b < 200; b++)
+			s.append_samples(block, block_size);
+
+		uint64_t expected_size = 0;
+		const auto table = s.chunk_table();
+		for (uint64_t i = 0; i < table->chunks.size(); i++)
+			expected_size += s.chunk_capacity(table->first_chunk + i) + 7;
+
+		BOOST_CHECK_EQUAL(MemoryBudget::usage(&owner), expected_size);
+		BOOST_CHECK_EQUAL(MemoryBudget::total_usage(), initial_usage + expected_size);
+
+		//----- Evicted chunks are no longer accounted for ----//
+		s.set_max_sample_count(Segment::MaxChunkSize);
+		s.append_samples(block, block_size);
+		BOOST_REQUIRE(s.evict_old_chunks() > 0);
+		delete[] block;
+
+		const uint64_t evicted_usage = MemoryBudget::usage(&owner);
+		BOOST_CHECK(evicted_usage < expected_size);
+		BOOST_CHECK(evicted_usage <= 3 * (Segment::MaxChunkSize + 7));
+
+		//----- The budget is exceeded once more memory is used ----//
+		MemoryBudget::set_budget(MemoryBudget::total_usage());
+		BOOST_CHECK(!MemoryBudget::exceeded());
+		MemoryBudget::set_budget(MemoryBudget::total_usage() - 1);
+		BOOST_CHECK(MemoryBudget::exceeded());
+		MemoryBudget::set_budget(0);
+		BOOST_CHECK(!MemoryBudget::exceeded());
+	}
+
+	// Destroying the segment releases its account
+	BOOST_CHECK_EQUAL(MemoryBudget::usage(&owner), 0);
+	BOOST_CHECK_EQUAL(MemoryBudget::total_usage(), initial_usage);
+}
+
+BOOST_AUTO_TEST_CASE(MaxSize8CachedChunkAccounting)
+{
+	const int owner = 0;
+
+	{
+		Segment s(0, 1, sizeof(uint8_t));
+		s.memory_account_.set_owner(&owner);
+		s.set_chunk_compression(Segment::RunLengthCompression);
+
+		uint32_t num_samples = 5*pv::data::Segment::MaxChunkSize + 1000;
+
+		uint8_t *data = new uint8_t[num_samples];
+		for (uint32_t i = 0; i < num_samples; i++)
+			data[i] = (i / 4096) % 256;
+
+		s.append_samples(data, num_samples);
+		s.free_unused_memory();
+
+		// Wait for the background compression to finish
+		for (int i = 0; (i < 500) && (s.compressed_sample_count() < num_samples); i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		BOOST_REQUIRE_EQUAL(s.compressed_sample_count(), num_samples);
+
+		//----- Decompressed chunks are accounted for while cached ----//
+		uint8_t *sample_data = new uint8_t[num_samples];
+		s.get_raw_samples(0, num_samples, sample_data);
+		BOOST_CHECK(memcmp(data, sample_data, num_samples) == 0);
+		delete[] sample_data;
+		delete[] data;
+
+		uint64_t cached_size = 0;
+		for (const auto &c : s.chunk_cache_)
+			cached_size += c.size;
+
+		BOOST_CHECK_EQUAL(s.chunk_cache_.size(), Segment::MaxCachedChunks);
+		BOOST_CHECK(cached_size >= Segment::MaxCachedChunks * Segment::MaxChunkSize);
+		BOOST_CHECK_EQUAL(MemoryBudget::usage(&owner, MemoryAccount::SampleData),
+			cached_size);
+
+		//----- Evicting chunks drops their cached copies ----//
+		s.set_max_sample_count(1000);
+		BOOST_REQUIRE(s.evict_old_chunks() > 0);
+
+		cached_size = 0;
+		for (const auto &c : s.chunk_cache_) {
+			BOOST_CHECK(c.chunk_num >= s.chunk_table()->first_chunk);
+			cached_size += c.size;
+		}
+
+		BOOST_CHECK(s.chunk_cache_.size() < Segment::MaxCachedChunks);
+		BOOST_CHECK_EQUAL(MemoryBudget::usage(&owner, MemoryAccount::SampleData),
+			cached_size);
+	}
+
+	BOOST_CHECK_EQUAL(MemoryBudget::usage(&owner), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()